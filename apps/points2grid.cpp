@@ -58,6 +58,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <points2grid/config.h>
 #include <points2grid/Interpolation.hpp>
 #include <points2grid/Global.hpp>
+#include <points2grid/InputFiles.hpp>
 
 #include <math.h>
 #include <time.h>
@@ -88,6 +89,8 @@ int main(int argc, char **argv)
     // parameters
     char inputName[1024] = {0};
     char inputURL[2048] = {0};
+    std::vector<std::string> inputSpecs;
+    std::vector<std::string> inputNames;
     char outputName[1024] = {0};
 
     int input_format = INPUT_LAS;
@@ -98,6 +101,12 @@ int main(int argc, char **argv)
     double GRID_DIST_Y = 6.0;
     double searchRadius = (double) sqrt(2.0) * GRID_DIST_X;
     int window_size = 0;
+    int num_threads = 1;
+    double idw_power = Interpolation::WEIGHTER;
+    bool single_read = false;
+    double memory_budget = 0;
+    int grid_file_io = GRID_FILE_MMAP;
+    int decoder_threads = 1;
     std::vector<int> las_exclude_classifications;
 
     bool user_defined_bounds = false;
@@ -125,18 +134,38 @@ int main(int argc, char **argv)
      "the default value is --all")
     ("input_format", po::value<std::string>(), "'ascii' expects input point cloud in ASCII format\n"
      "'las' expects input point cloud in LAS format (default)")
+    ("single_read", "parse ASCII input only once, keeping the points in a binary temporary file for the second pass")
     ("interpolation_mode", po::value<std::string>()->default_value("auto"), "'incore' stores working data in memory\n"
      "'outcore' stores working data on the filesystem\n"
-     "'auto' (default) guesses based on the size of the data file");
+     "'spill' writes the points to one file per row band, then grids the bands one after another in memory\n"
+     "'sparse' stores working data in memory, allocating only the tiles of the grid the points reach\n"
+     "'auto' (default) guesses based on the size of the data file")
+    ("idw_power", po::value<double>(), "exponent of the inverse distance weights of the idw output. "
+     "Whole numbers are fastest. The default value is 2")
+    ("memory_budget", po::value<double>(), "megabytes of memory the grid may use before the out-of-core mode is chosen, and the size the out-of-core mode keeps to. "
+     "The default is three quarters of the memory limit of the container (cgroup) or the available system memory")
+    ("decoder_threads", po::value<int>(), "number of threads decoding and filtering LAS points ahead of the interpolation, "
+     "each taking every n-th block of the file. 0 decodes on the interpolation thread. The default value is 1")
+    ("grid_file_io", po::value<std::string>()->default_value("mmap"), "how the out-of-core interpolation moves its tiles between disk and memory:\n"
+     "'mmap' (default) maps the tile files and lets the kernel page them\n"
+     "'pread' reads a tile whole into a buffer and writes it back with pread()/pwrite()\n"
+     "'direct' is 'pread' with O_DIRECT, bypassing the page cache where the file system allows it")
+    ("threads", po::value<int>(), "number of worker threads used by the in-core interpolation, which splits the grid into one row band per thread, "
+     "by the out-of-core interpolation, which shares its tiles out among the threads, and by the ASCII parser. "
+     "The default value is 1");
 
 
     df.add_options()
 #ifdef CURL_FOUND
-    ("data_file_name,i", po::value<std::string>(), "path to unzipped plain text data file")
+    ("data_file_name,i", po::value<std::vector<std::string> >()->multitoken(), "path to unzipped plain text data file. "
+     "May be given more than once, and may be a directory, standing for the LAS files in it, or a pattern with '*', '?' and [...] in its file name")
+    ("data_file_list", po::value<std::string>(), "file listing more data_file_name values, one per line")
     ("data_file_url,l", po::value<std::string>(), "URL of unzipped plain text data file"
      "You must specify either a data_file_name or data_file_url.");
 #else
-    ("data_file_name,i", po::value<std::string>(), "required. path to unzipped plain text data file");
+    ("data_file_name,i", po::value<std::vector<std::string> >()->multitoken(), "required. path to unzipped plain text data file. "
+     "May be given more than once, and may be a directory, standing for the LAS files in it, or a pattern with '*', '?' and [...] in its file name")
+    ("data_file_list", po::value<std::string>(), "file listing more data_file_name values, one per line");
 #endif
 
     ot.add_options()
@@ -310,28 +339,33 @@ int main(int argc, char **argv)
 
 
 
-#ifdef CURL_FOUND
         if(vm.count("data_file_name")) {
-            strncpy(inputName, vm["data_file_name"].as<std::string>().c_str(), sizeof(inputName));
+            inputSpecs = vm["data_file_name"].as<std::vector<std::string> >();
+            for(size_t i = 0; i < inputSpecs.size(); i++) {
+                if(inputSpecs[i].empty()) {
+                    throw std::logic_error("data_file_name must not be an empty string");
+                }
+            }
         }
+        if(vm.count("data_file_list")) {
+            if(read_input_list(vm["data_file_list"].as<std::string>(), inputSpecs) < 0) {
+                throw std::logic_error("data_file_list can not be read");
+            }
+        }
+
+#ifdef CURL_FOUND
         if(vm.count("data_file_url")) {
             strncpy(inputURL, vm["data_file_url"].as<std::string>().c_str(), sizeof(inputURL));
         }
 
-        if (!strcmp(inputName, "") && !strcmp(inputURL, ""))
+        if (inputSpecs.empty() && !strcmp(inputURL, ""))
         {
             throw std::logic_error("you must specify a valid data file");
         }
 #else
-        if(!vm.count("data_file_name")) {
+        if(inputSpecs.empty()) {
             throw std::logic_error("data_file_name  must be specified");
         }
-        else {
-            strncpy(inputName, vm["data_file_name"].as<std::string>().c_str(), sizeof(inputName));
-            if (!strcmp(inputName, "")) {
-                throw std::logic_error("data_file_name must not be an empty string");
-            }
-        }
 #endif
 
         if (!vm.count("output_file_name")) {
@@ -345,6 +379,52 @@ int main(int argc, char **argv)
             searchRadius = vm["search_radius"].as<float>();
         }
 
+        if(vm.count("idw_power")) {
+            idw_power = vm["idw_power"].as<double>();
+            if(!(idw_power > 0)) {
+                throw std::logic_error("idw_power must be greater than 0");
+            }
+        }
+
+        single_read = vm.count("single_read") > 0;
+
+        if(vm.count("memory_budget")) {
+            memory_budget = vm["memory_budget"].as<double>();
+            if(!(memory_budget > 0)) {
+                throw std::logic_error("memory_budget must be greater than 0");
+            }
+        }
+
+        if(vm.count("threads")) {
+            num_threads = vm["threads"].as<int>();
+            if(num_threads < 1) {
+                throw std::logic_error("threads must be at least 1");
+            }
+        }
+
+        if(vm.count("decoder_threads")) {
+            decoder_threads = vm["decoder_threads"].as<int>();
+            if(decoder_threads < 0) {
+                throw std::logic_error("decoder_threads must not be negative");
+            }
+        }
+
+        if(vm.count("grid_file_io")) {
+            std::string io(vm["grid_file_io"].as<std::string>());
+            if (io.compare("mmap") == 0) {
+                grid_file_io = GRID_FILE_MMAP;
+            }
+            else if (io.compare("pread") == 0) {
+                grid_file_io = GRID_FILE_PREAD;
+            }
+            else if (io.compare("direct") == 0) {
+                grid_file_io = GRID_FILE_DIRECT;
+            }
+            else {
+                throw std::logic_error("'" + io + "' is not a recognized grid_file_io");
+            }
+        }
+
         if(vm.count("interpolation_mode")) {
             std::string im(vm["interpolation_mode"].as<std::string>());
             if (im.compare("auto") == 0) {
@@ -356,6 +436,12 @@ int main(int argc, char **argv)
             else if (im.compare("outcore") == 0) {
                 interpolation_mode = INTERP_OUTCORE;
             }
+            else if (im.compare("spill") == 0) {
+                interpolation_mode = INTERP_SPILL;
+            }
+            else if (im.compare("sparse") == 0) {
+                interpolation_mode = INTERP_SPARSE;
+            }
             else {
                 throw std::logic_error("'" + im + "' is not a recognized interpolation_mode");
             }
@@ -405,11 +491,19 @@ int main(int argc, char **argv)
                 cout << "Error while downloading input from: " << inputURL << endl;
                 exit(1);
             }
+            inputSpecs.push_back(inputName);
         }
 #endif
 
+        if(expand_input_files(inputSpecs, inputNames) < 0) {
+            throw std::logic_error("no data file found");
+        }
+
         cout << "Parameters ************************" << endl;
-        cout << "inputName: '" << inputName << "'" << endl;
+        if(inputNames.size() == 1)
+            cout << "inputName: '" << inputNames[0] << "'" << endl;
+        else
+            cout << "inputs: " << inputNames.size() << " files" << endl;
         cout << "input_format: " << input_format << endl;
         cout << "outputName: '" << outputName << "'" << endl;
         cout << "GRID_DIST_X: " << GRID_DIST_X << endl;
@@ -418,6 +512,12 @@ int main(int argc, char **argv)
         cout << "output_format: " << output_format << endl;
         cout << "type: " << type << endl;
         cout << "fill window size: " << window_size << endl;
+        cout << "idw power: " << idw_power << endl;
+        cout << "threads: " << num_threads << endl;
+        cout << "decoder threads: " << decoder_threads << endl;
+        cout << "single read: " << single_read << endl;
+        if(memory_budget > 0)
+            cout << "memory budget: " << memory_budget << " MB" << endl;
         cout << "************************************" << endl;
     }
     catch (std::exception& e) {
@@ -430,9 +530,16 @@ int main(int argc, char **argv)
 
     Interpolation *ip = new Interpolation(GRID_DIST_X, GRID_DIST_Y, searchRadius,
                                           window_size, interpolation_mode);
+    ip->setThreads(num_threads);
+    ip->setIdwPower(idw_power);
+    ip->setAsciiSingleRead(single_read);
+    ip->setMemoryBudget(memory_budget * 1024 * 1024);
+    ip->setGridFileIO(grid_file_io);
+    ip->setDecoderThreads(decoder_threads);
+    ip->setOutputType(type);
 
 
-    int init_result = user_defined_bounds ? ip->init(inputName, n, s, e, w) : ip->init(inputName, input_format);
+    int init_result = user_defined_bounds ? ip->init(inputNames, input_format, n, s, e, w) : ip->init(inputNames, input_format);
     if(init_result < 0)
     {
         fprintf(stderr, "Interpolation::init() error\n");
@@ -452,7 +559,7 @@ int main(int argc, char **argv)
     printf("Init + Min/Max time: %10.2f\n", (double)(t1 - t0)/CLOCKS_PER_SEC);
 
     t0 = clock();
-    if(ip->interpolation(inputName, outputName, input_format, output_format, type) < 0)
+    if(ip->interpolation(inputNames, outputName, input_format, output_format, type) < 0)
     {
         fprintf(stderr, "Interpolation::interpolation() error\n");
         return -1;
@@ -461,7 +568,7 @@ int main(int argc, char **argv)
     t1 = clock();
     printf("DEM generation + Output time: %10.2f\n", (double)(t1 - t0)/CLOCKS_PER_SEC);
 
-    printf("# of data: %d\n", ip->getDataCount());
+    printf("# of data: %llu\n", (unsigned long long)ip->getDataCount());
     printf("dimension: %d x %d\n", ip->getGridSizeX(), ip->getGridSizeY());
 
     delete ip;
@@ -0,0 +1,83 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// grid buffers start on a cache line boundary
+static const size_t GRID_ALIGNMENT = 64;
+
+// zeroed memory, NULL on failure, like calloc. Large blocks come as fresh
+// zero pages from the system, which cost nothing until they are written.
+inline void *aligned_calloc(size_t size, size_t alignment = GRID_ALIGNMENT)
+{
+#ifdef _WIN32
+    return _aligned_recalloc(NULL, 1, size, alignment);
+#else
+    // posix_memalign() has no zeroing variant, so the block is taken from
+    // calloc() with room to align it, and the pointer calloc() returned is
+    // kept just below the aligned one
+    char *base = (char *)calloc(size + alignment + sizeof(void *), 1);
+    if(base == NULL)
+        return NULL;
+
+    uintptr_t p = ((uintptr_t)(base + sizeof(void *)) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    ((void **)p)[-1] = base;
+    return (void *)p;
+#endif
+}
+
+inline void aligned_free(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(((void **)p)[-1]);
+#endif
+}
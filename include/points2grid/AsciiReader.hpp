@@ -0,0 +1,126 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <points2grid/export.hpp>
+
+// Reads ASCII point files (a header line, then one "x,y,z" line per point)
+// through a memory map. Each call to read() takes the next few megabytes
+// per thread, splits them at line ends, and parses the pieces in parallel.
+// Points still come out in file order.
+class P2G_DLL AsciiReader
+{
+public:
+    AsciiReader();
+    ~AsciiReader();
+
+    int open(const std::string& fileName, int threads);
+    void close();
+
+    // goes back to the first point
+    void rewind();
+
+    // replaces x, y and z with the next block of points; false at the end
+    bool read(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z);
+
+    // parses one line the way atof(strtok(line, ",\n")) did, but without
+    // the locale; false when the line has fewer than three values
+    static bool parseLine(const char *begin, const char *end, double& x, double& y, double& z);
+
+public:
+    // bytes of text each thread parses per read()
+    static const size_t CHUNK_SIZE = 4 << 20;
+
+private:
+    struct Piece
+    {
+        const char *begin;
+        const char *end;
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+    };
+
+    static void parsePiece(Piece *piece);
+    const char *nextLine(const char *p) const;
+
+    boost::iostreams::mapped_file_source m_file;
+    const char *m_data;
+    const char *m_end;
+    const char *m_first;
+    const char *m_pos;
+    int m_threads;
+    std::vector<Piece> m_pieces;
+};
+
+// Parsed points kept in a binary temporary file, so a second pass over an
+// ASCII input reads them back instead of parsing the text again. The file
+// is removed when closed.
+class P2G_DLL PointSpill
+{
+public:
+    PointSpill();
+    ~PointSpill();
+
+    int create();
+    void close();
+    bool isOpen() const { return m_fp != NULL; }
+
+    int write(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z);
+
+    // reads the blocks back in the order they were written
+    int rewind();
+    bool read(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z);
+
+private:
+    PointSpill(const PointSpill&);
+    PointSpill& operator=(const PointSpill&);
+
+    FILE *m_fp;
+};
@@ -46,18 +46,52 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <math.h>
+#include <stddef.h>
 #include <points2grid/export.hpp>
+#include <points2grid/Global.hpp>
 
 class P2G_DLL CoreInterp
 {
 public:
-    CoreInterp() {};
+    CoreInterp() : num_threads(1), output_type(OUTPUT_TYPE_ALL), idw_power(2), memory_budget(DEFAULT_MEMORY_BUDGET), grid_file_io(GRID_FILE_MMAP) {};
     virtual ~CoreInterp() {};
 
     virtual int init() = 0;
     virtual int update(double data_x, double data_y, double data_z) = 0;
+
+    // Feeds n points at once, with the same grid relative coordinates as
+    // update(). Engines override it to avoid a virtual call per point and
+    // to work on the whole batch; the arrays are only read.
+    virtual int update_batch(const double *data_x, const double *data_y, const double *data_z, size_t n)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            if(update(data_x[i], data_y[i], data_z[i]) < 0)
+                return -1;
+        }
+        return 0;
+    }
     virtual int finish(const std::string& outputName, int outputFormat, unsigned int outputType) = 0;
 
+    // number of worker threads an engine may use; must be set before init()
+    void setThreads(int threads) { num_threads = threads < 1 ? 1 : threads; }
+
+    // OUTPUT_TYPE_* mask the engine has to produce; engines may skip the
+    // accumulators of the other types. Must be set before init()
+    void setOutputType(unsigned int type) { output_type = type; }
+
+    // exponent of the inverse distance weights, Interpolation::WEIGHTER
+    // by default; must be set before init()
+    void setIdwPower(double power) { idw_power = power; }
+
+    // bytes of memory the engine may use for its working data; the
+    // out-of-core engine sizes its row bands from it. Must be set before init()
+    void setMemoryBudget(double bytes) { memory_budget = bytes; }
+
+    // GRID_FILE_IO mode of the out-of-core tiles; must be set before init()
+    void setGridFileIO(int mode) { grid_file_io = mode; }
+
 protected:
     double GRID_DIST_X;
     double GRID_DIST_Y;
@@ -73,5 +107,18 @@ protected:
 
     // for DEM filling
     int window_size;
+
+    int num_threads;
+    unsigned int output_type;
+    double idw_power;
+    double memory_budget;
+    int grid_file_io;
+
+    // idw_power when it is a whole number the weights can be computed
+    // from by multiplication, otherwise -1
+    int integer_idw_power() const
+    {
+        return idw_power >= 0 && idw_power <= 64 && idw_power == floor(idw_power) ? (int)idw_power : -1;
+    }
 };
 
@@ -0,0 +1,103 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#pragma once
+
+#include <vector>
+#include <points2grid/export.hpp>
+
+// one grid row of the cells covered by a point's search radius
+struct StencilSpan
+{
+    int row;
+    int first;  // first and last covered column, inclusive
+    int last;
+    double dy2; // squared y distance from the point to the row's cell centers
+};
+
+// The cells within the search radius of one point: a span of columns per
+// row, and the squared x distance of every column the spans touch, so that
+// the squared distance of cell (i, span.row) is dx2[i - first_col] + span.dy2.
+class P2G_DLL StencilCover
+{
+public:
+    StencilCover() : num_spans(0), first_col(0) {};
+
+    inline double distance_sqr(const StencilSpan& span, int col) const { return dx2[col - first_col] + span.dy2; }
+
+public:
+    int num_spans;
+    std::vector<StencilSpan> spans;
+
+    int first_col;
+    std::vector<double> dx2;
+};
+
+// Per-radius table of the columns a search disk can reach in each row
+// around the point's own cell, replacing the four quadrant walks.
+// The table is conservative; cover() trims every row to the cells whose
+// squared distance is within the radius, computed exactly like the
+// quadrant walks did, and clips it once to the grid or band.
+class P2G_DLL DiskStencil
+{
+public:
+    DiskStencil();
+
+    void init(double dist_x, double dist_y, double r_sqr);
+
+    // cells of the point (data_x, data_y) within the search radius, clipped
+    // to columns [col_lo, col_hi) and rows [row_lo, row_hi)
+    void cover(double data_x, double data_y,
+               int col_lo, int col_hi, int row_lo, int row_hi,
+               StencilCover& c) const;
+
+private:
+    double GRID_DIST_X;
+    double GRID_DIST_Y;
+    double radius_sqr;
+
+    // the disk reaches rows lower_grid_y - max_rows .. lower_grid_y + max_rows + 1,
+    // and columns lower_grid_x - half_width[k] .. lower_grid_x + half_width[k] + 1
+    // in row lower_grid_y + k - max_rows; a negative width means none
+    int max_rows;
+    std::vector<int> half_width;
+};
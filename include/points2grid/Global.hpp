@@ -50,6 +50,10 @@ static const unsigned int OUTPUT_TYPE_DEN = 0x00010000;
 static const unsigned int OUTPUT_TYPE_STD = 0x00100000;
 static const unsigned int OUTPUT_TYPE_ALL = 0x00111111;
 
+// bytes of memory the interpolation may use when no budget is given and
+// none can be detected: 200 million full 64 byte grid cells
+static const double DEFAULT_MEMORY_BUDGET = 200000000.0 * 64;
+
 enum OUTPUT_FORMAT {
     OUTPUT_FORMAT_ALL = 0,
     OUTPUT_FORMAT_ARC_ASCII,
@@ -65,6 +69,17 @@ enum INPUT_FORMAT {
 enum INTERPOLATION_TYPE {
     INTERP_AUTO = 0,
     INTERP_INCORE = 1,
-    INTERP_OUTCORE = 2
+    INTERP_OUTCORE = 2,
+    INTERP_SPILL = 3,
+    INTERP_SPARSE = 4
+};
+
+// how an out-of-core tile moves between its file and memory: mapped, and
+// paged by the kernel, or read whole into a buffer and written back with
+// pread()/pwrite(), the page cache bypassed with O_DIRECT
+enum GRID_FILE_IO {
+    GRID_FILE_MMAP = 0,
+    GRID_FILE_PREAD = 1,
+    GRID_FILE_DIRECT = 2
 };
 
@@ -0,0 +1,97 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <points2grid/GridPoint.hpp>
+#include <points2grid/Global.hpp>
+#include <points2grid/export.hpp>
+
+// flag bits, one byte per cell
+static const unsigned char CELL_HAS_DATA = 0x01; // GridPoint::empty
+static const unsigned char CELL_FILLED = 0x02;   // GridPoint::filled
+
+// output types that need the per-cell point count; min and max use it to
+// tell a cell no point reached yet
+static const unsigned int COUNTED_OUTPUT_TYPES = OUTPUT_TYPE_MIN | OUTPUT_TYPE_MAX | OUTPUT_TYPE_MEAN | OUTPUT_TYPE_DEN | OUTPUT_TYPE_STD;
+
+// Accumulators of an in-core grid in structure-of-arrays form. Only the
+// arrays needed by the requested OUTPUT_TYPE_* mask are allocated, the
+// others stay NULL, so a --max run keeps a double and a count per cell
+// instead of a whole GridPoint. An empty cell is all zero bytes, so the
+// arrays need no initialization pass.
+class P2G_DLL GridCells
+{
+public:
+    GridCells();
+    ~GridCells();
+
+    int allocate(size_t num_cells, unsigned int output_type);
+    void release();
+
+    GridPoint getGridPoint(size_t k) const;
+
+    // bytes per cell for the accumulators of an output type mask
+    static size_t getCellSize(unsigned int output_type);
+
+    // the mask actually accumulated for a requested output type mask
+    static unsigned int getStats(unsigned int output_type);
+
+public:
+    double *Zmin;
+    double *Zmax;
+    double *Zmean;
+    double *Zidw;
+    double *sum;
+    double *Zstd;
+    double *Zstd_tmp;
+    unsigned int *count;
+    unsigned char *flags;
+
+    size_t size;
+    unsigned int stats;
+
+private:
+    GridCells(const GridCells&);
+    GridCells& operator=(const GridCells&);
+};
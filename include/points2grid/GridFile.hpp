@@ -64,7 +64,28 @@ public:
     int map();
     int unmap();
     bool isInMemory();
+    // false until the first map() has created the file
+    bool isInitialized() const { return !m_firstMap; }
     unsigned int getMemSize();
+    // page-cache hints for an unmapped tile; they only use the file name,
+    // so the background I/O thread may call them while the tile's owner
+    // maps and unmaps it
+    int prefetch() const;
+    int writeback() const;
+
+    // a GRID_FILE_IO mode; must be set before the first map()
+    void setIOMode(int mode);
+    int getIOMode() const { return m_ioMode; }
+
+    // what the pread()/pwrite() modes moved, and the seconds they waited
+    unsigned long long getBytesRead() const { return m_bytesRead; }
+    unsigned long long getBytesWritten() const { return m_bytesWritten; }
+    double getIOSeconds() const { return m_ioSeconds; }
+
+    // bytes per pread()/pwrite() call, a multiple of DIRECT_IO_ALIGNMENT
+    static const size_t IO_CHUNK_SIZE = 8 << 20;
+    // buffer, offset and size alignment O_DIRECT asks for
+    static const size_t DIRECT_IO_ALIGNMENT = 4096;
     inline std::string getFileName() const { return m_filename; }
 
     GridPoint *interp;
@@ -72,6 +93,9 @@ public:
 private:
     //ofstream fout;
 
+    int load();
+    int store();
+
     boost::iostreams::mapped_file m_mf;
     int m_id;
     int m_size_x;
@@ -79,4 +103,15 @@ private:
     bool m_inMemory;
     bool m_firstMap;
     std::string m_filename;
+
+    int m_ioMode;
+    // the pread()/pwrite() modes' copy of the tile, m_bufferSize bytes
+    // rounded up for O_DIRECT
+    char *m_buffer;
+    size_t m_bufferSize;
+    // whether store() has written the file since it was created
+    bool m_stored;
+    unsigned long long m_bytesRead;
+    unsigned long long m_bytesWritten;
+    double m_ioSeconds;
 };
@@ -64,6 +64,19 @@ public:
             int overlap_upper_bound,
             bool initialized,
             char * fname);
+    // a tile: rows as above, and columns [left_bound, right_bound] with
+    // the halo columns [overlap_left_bound, overlap_right_bound]
+    GridMap(int id,
+            int lower_bound,
+            int upper_bound,
+            int overlap_lower_bound,
+            int overlap_upper_bound,
+            int left_bound,
+            int right_bound,
+            int overlap_left_bound,
+            int overlap_right_bound,
+            bool initialized,
+            char * fname);
     ~GridMap();
 
 public:
@@ -72,6 +85,10 @@ public:
     int getUpperBound();
     int getOverlapLowerBound();
     int getOverlapUpperBound();
+    int getLeftBound();
+    int getRightBound();
+    int getOverlapLeftBound();
+    int getOverlapRightBound();
     GridFile *getGridFile();
 
     bool isInitialized();
@@ -89,6 +106,10 @@ private:
     int m_upperBound;
     int m_overlapLowerBound;
     int m_overlapUpperBound;
+    int m_leftBound;
+    int m_rightBound;
+    int m_overlapLeftBound;
+    int m_overlapRightBound;
 
     bool m_initialized;
     int m_id;
@@ -48,17 +48,18 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <points2grid/export.hpp>
 
+// doubles first, then the count and the one-byte flags, so the record
+// packs into 64 bytes
 typedef P2G_DLL struct 
 {
     double Zmin;
     double Zmax;
     double Zmean;
-    unsigned int count;
     double Zidw;
     double Zstd;    // M2 from https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
     double Zstd_tmp;  // mean from above.
     double sum;
-    int empty;
-    int filled;
+    unsigned int count;
+    unsigned char empty;
+    unsigned char filled;
 } GridPoint;
-
@@ -47,16 +47,23 @@ POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include <iostream>
+#include <vector>
+#include <boost/atomic.hpp>
 #include <points2grid/GridPoint.hpp>
+#include <points2grid/GridCells.hpp>
+#include <points2grid/DiskStencil.hpp>
+#include <points2grid/SpanKernels.hpp>
 #include <points2grid/CoreInterp.hpp>
 #include <points2grid/GridFile.hpp>
 
 using namespace std;
 
+struct BandWorkers;
+
 class P2G_DLL InCoreInterp : public CoreInterp
 {
 public:
-    InCoreInterp() {};
+    InCoreInterp() : sparse(false), band_workers(NULL) {};
     InCoreInterp(double dist_x, double dist_y,
                  int size_x, int size_y,
                  double r_sqr,
@@ -67,22 +74,89 @@ public:
 
     virtual int init();
     virtual int update(double data_x, double data_y, double data_z);
+    virtual int update_batch(const double *data_x, const double *data_y, const double *data_z, size_t n);
     virtual int finish(const std::string& outputName, int outputFormat, unsigned int outputType);
     virtual int finish(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt);
     void calculate_grid_values();
-    const GridPoint& get_grid_point(int i, int j);
+    GridPoint get_grid_point(int i, int j);
+
+    // allocate the grid in tiles of SPARSE_TILE_SIZE cells square on the
+    // first point that reaches them, instead of all at once; call before init()
+    void setSparse(bool s) { sparse = s; }
+
+    // tiles allocated so far
+    size_t getNumTiles() const;
+
+    // bytes an engine for a size_x by size_y grid of the given output
+    // types needs, including the point buffers of multi-threaded mode
+    static double memory_required(int size_x, int size_y, unsigned int type, int threads);
+
+public:
+    // points buffered per thread before they are routed to the row bands
+    static const unsigned int BATCH_SIZE = 1 << 20;
+
+    // cells along each side of a tile in sparse mode
+    static const int SPARSE_TILE_SIZE = 128;
 
 private:
-    GridPoint **interp;
+    // accumulators for the requested output types, in tiles_y rows of
+    // tiles_x tiles of tile_w by tile_h cells, each tile holding its rows in
+    // the order the writers read them. A dense grid is a single tile. In
+    // sparse mode a tile no point reached is NULL and has no data.
+    std::vector<GridCells *> tiles;
+    int tile_w, tile_h;
+    int tiles_x, tiles_y;
+    bool sparse;
+    // set by whichever band thread fails to allocate a tile
+    boost::atomic<bool> tile_error;
+    unsigned int stats;
     double radius_sqr;
 
+    inline GridCells *tile_at(int x, int y) const { return tiles[(size_t)(y / tile_h) * tiles_x + x / tile_w]; }
+    inline size_t tile_index(int x, int y) const { return (size_t)(y % tile_h) * tile_w + x % tile_w; }
+
+    // update_point instantiated for the accumulated output types, picked in init()
+    typedef void (InCoreInterp::*UpdateFunction)(double data_x, double data_y, double data_z, int row_lo, int row_hi, StencilCover& cover);
+    UpdateFunction update_fn;
+
+    DiskStencil stencil;
+    StencilCover cover;
+
+    // span updates for the instruction set of the running CPU
+    const SpanKernels *kernels;
+    int idw_int_power;
+
+    // multi-threaded mode: the grid is split into num_threads row bands,
+    // band b owning rows [band_bound[b], band_bound[b+1]). Buffered points
+    // are routed to every band their search radius reaches, in input order,
+    // so each cell sees exactly the same sequence of updates as in serial mode.
+    // The band threads apply one batch while the caller fills the next.
+    int halo_rows;
+    std::vector<int> band_bound;
+    std::vector<double> pending_x;
+    std::vector<double> pending_y;
+    std::vector<double> pending_z;
+    std::vector< std::vector<unsigned int> > band_points;
+    BandWorkers *band_workers;
+
 private:
-    void update_first_quadrant(double data_z, int base_x, int base_y, double x, double y);
-    void update_second_quadrant(double data_z, int base_x, int base_y, double x, double y);
-    void update_third_quadrant(double data_z, int base_x, int base_y, double x, double y);
-    void update_fourth_quadrant(double data_z, int base_x, int base_y, double x, double y);
+    template<unsigned int Stats>
+    void update_point(double data_x, double data_y, double data_z, int row_lo, int row_hi, StencilCover& cover);
+    GridCells *touch_tile(int tx, int ty);
+    void finalize_tile(GridCells& t);
+    bool data_near_tile(int tx, int ty, int dist) const;
+    void fill_tile(int tx, int ty);
+    void flush_pending();
+    void wait_bands();
+    void stop_bands();
+    void band_worker(int band);
+    void update_band(int band);
+
+    // update_point for the output types whose bits are set in a six-bit
+    // index (bit i standing for OUTPUT_TYPE 0x1 << 4*i), searched from Index down
+    template<int Index>
+    static UpdateFunction select_update(int index);
 
-    void updateGridPoint(int x, int y, double data_z, double distance);
     void printArray();
     int outputFile(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt);
 };
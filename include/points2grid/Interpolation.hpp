@@ -48,6 +48,9 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 #include <iostream>
+#include <set>
+#include <vector>
+#include <stdint.h>
 
 using namespace std;
 
@@ -55,7 +58,10 @@ using namespace std;
 #include <points2grid/GridPoint.hpp>
 #include <points2grid/CoreInterp.hpp>
 #include <points2grid/OutCoreInterp.hpp>
+#include <points2grid/SpillInterp.hpp>
 #include <points2grid/InCoreInterp.hpp>
+#include <points2grid/AsciiReader.hpp>
+#include <points2grid/LasReader.hpp>
 #include <points2grid/export.hpp>
 
 //class GridPoint;
@@ -71,7 +77,15 @@ public:
     int init(const std::string& inputName, double n, double s, double e, double w);
     int interpolation(const std::string& inputName, const std::string& outputName, int inputFormat,
                       int outputFormat, unsigned int type);
-    unsigned int getDataCount();
+
+    // several inputs gridded as one. The extent of LAS inputs comes from
+    // their headers alone; with the grid bounds given, the LAS files that
+    // can not reach the grid within the search radius are never read
+    int init(const std::vector<std::string>& inputNames, int inputFormat);
+    int init(const std::vector<std::string>& inputNames, int inputFormat, double n, double s, double e, double w);
+    int interpolation(const std::vector<std::string>& inputNames, const std::string& outputName, int inputFormat,
+                      int outputFormat, unsigned int type);
+    uint64_t getDataCount();
 
     unsigned int getGridSizeX();
     unsigned int getGridSizeY();
@@ -82,21 +96,55 @@ public:
 	void setLasExcludeClassification(std::vector<int> classification);
     void setLasExcludeReturn(bool keep_first_return);
 
+    // number of worker threads handed to the interpolation engine;
+    // must be called before init()
+    void setThreads(int threads);
+
+    // OUTPUT_TYPE_* mask that will be passed to interpolation(); the
+    // in-core engine only keeps the accumulators it needs, so smaller
+    // masks fit larger grids in memory. Must be called before init()
+    void setOutputType(unsigned int type);
+
+    // exponent of the inverse distance weights, WEIGHTER by default;
+    // must be called before init()
+    void setIdwPower(double power);
+
+    // parse ASCII input only once: init() keeps the points in a binary
+    // temporary file and interpolation() reads them back from it.
+    // Must be called before init()
+    void setAsciiSingleRead(bool single_read);
+
+    // bytes of memory the grid may use; it decides between the in-core
+    // and out-of-core engines and sizes the out-of-core row bands. The
+    // default, 0, is MEMORY_BUDGET_SHARE of the memory detected by
+    // detect_available_memory(). Must be called before init()
+    void setMemoryBudget(double bytes);
+
+    // GRID_FILE_IO mode of the out-of-core tiles, GRID_FILE_MMAP by
+    // default. Must be called before init()
+    void setGridFileIO(int mode);
+
+    // threads decoding LAS points ahead of the gridding, 1 by default; 0
+    // decodes them on the gridding thread. Must be called before
+    // interpolation()
+    void setDecoderThreads(int threads);
+
     // depricated
     void setRadius(double r);
 
-    unsigned long las_point_count;
+    uint64_t las_point_count;
 
 public:
     double GRID_DIST_X;
     double GRID_DIST_Y;
 
     static const int MAX_POINT_SIZE = 16000000;
+    // default IDW power, and the weight power of the null filling window
     static const int WEIGHTER = 2;
 
-    // update this to the maximum grid that will fit in memory
-    // as a rule of thumb, memory requirement = MEM_LIMIT*55 bytes
-    static const unsigned int MEM_LIMIT = 200000000;
+    // share of the detected available memory used as the default budget,
+    // leaving the rest for point buffers, the page cache and the process
+    static const double MEMORY_BUDGET_SHARE;
 
 private:
     double min_x;
@@ -107,17 +155,27 @@ private:
     unsigned int GRID_SIZE_X;
     unsigned int GRID_SIZE_Y;
 
-    unsigned int data_count;
+    uint64_t data_count;
     double radius_sqr;
     int window_size;
     int interpolation_mode;
-
-    bool exclude_point_class(int classification);
-    bool exclude_point_return(int current_return, int max_returns);
-
-    bool filter_returns;
-    bool keep_first_return;
-    std::vector<int> las_exclude_classification;
+    int num_threads;
+    unsigned int output_type;
+    double idw_power;
+    bool ascii_single_read;
+    double memory_budget;
+    int grid_file_io;
+    PointSpill spill;
+
+    bool fits_in_core();
+    int update_shifted(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z);
+    void resolve_memory_budget();
+    int create_engine(bool userDefinedGrid);
+
+    LasFilter las_filter;
+    int decoder_threads;
+    // the inputs init() found outside the grid
+    std::set<std::string> skipped_inputs;
 
 
     CoreInterp *interp;
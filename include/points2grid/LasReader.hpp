@@ -0,0 +1,155 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <points2grid/export.hpp>
+
+class las_file;
+struct las_point_filter;
+struct LasDecoders;
+
+// Which LAS points are left out of the grid, by classification, by
+// return and by position
+struct P2G_DLL LasFilter
+{
+    LasFilter() : filter_returns(false), keep_first_return(false), clip(false) {}
+
+    std::vector<int> exclude_classes;
+
+    // keep only the first, or only the last, return of every pulse
+    bool filter_returns;
+    bool keep_first_return;
+
+    // keep only the points within [clip_min, clip_max], in file coordinates
+    bool clip;
+    double clip_min[2];
+    double clip_max[2];
+
+    // the filter las_file::filter_points() applies to raw records
+    void compile(las_point_filter& compiled) const;
+};
+
+// The extent and point count of a LAS file, from its header
+struct P2G_DLL LasHeader
+{
+    double mins[3];
+    double maxs[3];
+    uint64_t count;
+};
+
+// Reads the headers of files on up to threads threads, without touching
+// their points. -1, after naming the file, when one is not a LAS file
+P2G_DLL int read_las_headers(const std::vector<std::string>& files, int threads, std::vector<LasHeader>& headers);
+
+// Reads the points of a LAS file in file order, filtered and shifted to
+// the grid origin. The filter runs on the raw records of a block, and only
+// the points it keeps have their coordinates decoded. With decoder threads, batch k of BATCH_SIZE records is
+// decoded by thread k % decoders into one of its two buffers, so decoding
+// and the page faults on the file mapping overlap with the caller gridding
+// the batch before. With no decoder threads read() decodes on the
+// calling thread.
+class P2G_DLL LasReader
+{
+public:
+    LasReader();
+    ~LasReader();
+
+    int open(const std::string& fileName, int decoders, const LasFilter& filter, double origin_x, double origin_y);
+    void close();
+
+    // replaces x, y and z with the next points that pass the filter;
+    // false at the end
+    bool read(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z);
+
+    uint64_t pointsCount() const;
+
+public:
+    // records per batch handed between the threads
+    static const size_t BATCH_SIZE = 1 << 16;
+    // records decoded at a time within a batch, so the decoded block is
+    // still in cache when it is filtered
+    static const size_t DECODE_BLOCK = 4096;
+
+private:
+    LasReader(const LasReader&);
+    LasReader& operator=(const LasReader&);
+
+    struct Batch
+    {
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+        bool full;
+    };
+
+    // a decoder's block of coordinates and the records of it that passed
+    struct Scratch
+    {
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+        std::vector<uint32_t> selected;
+    };
+
+    void decodeBatch(uint64_t k, Batch& batch, Scratch& scratch) const;
+    void decoder(int t);
+
+    las_file *m_las;
+    las_point_filter *m_filter;
+    double m_originX;
+    double m_originY;
+    uint64_t m_numBatches;
+    uint64_t m_next;
+    int m_decoders;
+
+    // two batches per decoder thread; batch k goes to m_batches[2 * (k % m_decoders) + (k / m_decoders) % 2]
+    std::vector<Batch> m_batches;
+    LasDecoders *m_threads;
+
+    // the inline decoder's scratch buffers
+    Scratch m_scratch;
+};
@@ -0,0 +1,73 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#pragma once
+
+#include <string>
+
+#include <points2grid/export.hpp>
+
+// Bytes of memory this process can use: the smallest of what its cgroup v2
+// or v1 memory limit leaves and the memory the system reports as
+// available. 0 when none of them can be read.
+P2G_DLL double detect_available_memory();
+
+// The steps of detect_available_memory(), on the contents of the files it
+// reads. A memory.max or memory.limit_in_bytes limit, 0 for "max", v1's
+// huge "unlimited" value or nothing; also reads memory.current and
+// memory.usage_in_bytes
+P2G_DLL double parse_cgroup_limit(const std::string& contents);
+
+// the value of key in a memory.stat, 0 if it is missing
+P2G_DLL double parse_cgroup_stat(const std::string& contents, const std::string& key);
+
+// MemAvailable of a /proc/meminfo in bytes, 0 if it is missing
+P2G_DLL double parse_meminfo_available(const std::string& contents);
+
+// what a cgroup limit leaves once the usage, less the inactive page cache
+// the kernel reclaims first, is taken off; 0 without a limit, at least 1
+// with one
+P2G_DLL double cgroup_headroom(double limit, double usage, double inactive_file);
+
+// the smaller of two limits, where 0 stands for none
+P2G_DLL double smaller_memory_limit(double a, double b);
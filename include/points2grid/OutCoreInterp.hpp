@@ -46,21 +46,27 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <stdio.h>
 #include <string.h>
 #include <string>
 #include <iostream>
 #include <queue>
 #include <list>
+#include <vector>
 
 #include <points2grid/CoreInterp.hpp>
 
 #include <points2grid/GridPoint.hpp>
 #include <points2grid/GridMap.hpp>
+#include <points2grid/DiskStencil.hpp>
 #include <points2grid/export.hpp>
 
 using namespace std;
 
 class UpdateInfo;
+struct ReconcileQueue;
+struct IngestPool;
+struct TileIO;
 
 class P2G_DLL OutCoreInterp : public CoreInterp
 {
@@ -76,37 +82,130 @@ public:
 
     virtual int init();
     virtual int update(double data_x, double data_y, double data_z);
+    virtual int update_batch(const double *data_x, const double *data_y, const double *data_z, size_t n);
     virtual int finish(const std::string& outputName, int outputFormat, unsigned int outputType);
     virtual int finish(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt);
     void isUserDefinedGrid(bool defined);
 
 private:
-    void updateInterpArray(int fileNum, double data_x, double data_y, double data_z);
-    void update_first_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y);
-    void update_second_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y);
-    void update_third_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y);
-    void update_fourth_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y);
-
-    void updateGridPoint(int fileNum, int x, int y, double data_z, double distance);
-    int findFileNum(double data_y);
-    void finalize();
+    // the mapped tiles of one thread applying points, and its own stencil
+    // cover; the thread owns the tiles whose number modulo num_workers is
+    // its index
+    struct TileCache
+    {
+        int worker;
+        int max_resident;
+        int num_resident;
+        unsigned long use_clock;
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long evictions;
+        StencilCover cover;
+    };
+
+    void updateInterpArray(int fileNum, double data_x, double data_y, double data_z, StencilCover& cover);
+    void updateGridPoint(GridPoint& gp, double data_z, double distance_sqr);
+    int findFileNum(double data_x, double data_y);
+    void chooseTiles();
+    double tileBytes(int tiles_x, int tiles_y) const;
+    double memoryRequired(int tiles_x, int tiles_y) const;
+    double queueBytes(int num_files, size_t limit) const;
+    int loadTile(int fileNum, TileCache& cache);
+    void drainQueue(int fileNum, StencilCover& cover);
+    int applyPoint(int fileNum, const UpdateInfo& point, TileCache& cache);
+    int routePoint(int fileNum, const UpdateInfo& point);
+    int flushQueues(TileCache& cache);
+    void startWorkers();
+    int stopWorkers();
+    void ingestWorker(int worker);
+    void startTileIO();
+    void stopTileIO();
+    void requestTileIO(int fileNum, bool prefetch);
+    void tileIOThread();
+    int readRegion(int fileNum, int x0, int x1, int y0, int y1, vector<GridPoint>& buffer);
+    void tileNeighbours(int fileNum, vector<int>& neighbours) const;
+    int reconcileTile(int fileNum, bool into_interior, vector<GridPoint>& buffer);
+    void reconcileWorker(ReconcileQueue *queue);
+    int reconcileHalos();
+    void divideCells(int fileNum);
+    void fillCells(int fileNum);
+    int openTileRow(int ty, vector<FILE *>& files);
+    void closeTileRow(vector<FILE *>& files);
+    int readGridRow(int j, vector<FILE *>& files, vector<GridPoint>& row);
+    int writeRows(FILE **arcFiles, FILE **gridFiles, bool report);
+    void writeRowsWorker(FILE **arcFiles, FILE **gridFiles, int *status);
+    int writeFiles(FILE **arcFiles, FILE **gridFiles);
     int outputFile(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt);
     void get_temp_file_name(char *fname, size_t fname_len);
 
 public:
-    static const unsigned int QUEUE_LIMIT = 1000;
+    // the fewest points a tile queue holds before the tile is loaded;
+    // init() raises the limit as far as the memory budget allows
+    static const unsigned int MIN_QUEUE_LIMIT = 1000;
+
+    // the grid is split into tiles small enough that at least this many
+    // fit in the memory budget together, so interleaved input does not
+    // swap a tile for every queue that fills
+    static const unsigned int MIN_RESIDENT_TILES = 4;
+
+    // points each worker thread's ingest queue holds
+    static const unsigned int INGEST_QUEUE_SIZE = 1 << 16;
+
+    // tile cache statistics of the last run
+    unsigned long getCacheHits() const;
+    unsigned long getCacheMisses() const;
+    unsigned long getCacheEvictions() const;
+    unsigned long getPrefetches() const { return prefetches; }
+    unsigned long getWritebacks() const { return writebacks; }
+
+    int getTilesX() const { return tiles_x; }
+    int getTilesY() const { return tiles_y; }
+    int getNumWorkers() const { return num_workers; }
+    int getResidentTiles() const { return max_resident; }
+    size_t getQueueLimit() const { return queue_limit; }
 
 private:
     double radius_sqr;
 
+    DiskStencil stencil;
+    int idw_int_power;
+
+    // halo columns and rows around every tile: the reach of the search
+    // radius, or of the null filling window if that is wider
+    int overlapSizeX;
     int overlapSize;
+
+    // tiles_x by tiles_y tiles of local_grid_size_x by local_grid_size_y
+    // cells, the last column and row of tiles possibly smaller; tile
+    // (tx, ty) is gridMap[ty * tiles_x + tx]
+    int tiles_x;
+    int tiles_y;
     int local_grid_size_x;
     int local_grid_size_y;
 
     int numFiles;
-    list<UpdateInfo> *qlist;
+    vector<UpdateInfo> *qlist;
+    size_t queue_limit;
+
+    // mapped tiles, least recently used evicted first; max_resident is
+    // shared out among the caches of the num_workers threads applying
+    // points. With more than one, the calling thread only routes the
+    // points to the workers' queues in pool.
+    int max_resident;
+    int num_workers;
+    vector<TileCache> caches;
+    vector<unsigned long> last_use;
+    IngestPool *pool;
+
+    // hints the page cache from a background thread while tiles swap: the
+    // tile whose queue nears queue_limit is read ahead, as it is the next
+    // to be mapped, and an evicted tile starts its writeback. Only run
+    // when the tiles do not all stay mapped.
+    TileIO *tile_io;
+    size_t prefetch_level;
+    unsigned long prefetches;
+    unsigned long writebacks;
     GridMap **gridMap;
-    int openFile;
 
     bool user_defined_grid;
 };
@@ -121,5 +220,7 @@ public:
     double data_x;
     double data_y;
     double data_z;
+
+    static bool lessRow(const UpdateInfo& a, const UpdateInfo& b) { return a.data_y < b.data_y; }
 };
 
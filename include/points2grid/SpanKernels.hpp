@@ -0,0 +1,140 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#pragma once
+
+#include <math.h>
+#include <points2grid/export.hpp>
+
+// Per-accumulator updates of one contiguous span of n cells by a point of
+// elevation z, in structure-of-arrays form. Every instruction set variant
+// produces bit-identical results to the scalar one: the same IEEE operations
+// are done in the same order, only several cells at a time.
+struct SpanKernels
+{
+    const char *name;
+
+    // a cell whose count is still 0 takes z, so the accumulators start out
+    // as zero bytes; count must not include the point yet
+    void (*min)(double *Zmin, const unsigned int *count, int n, double z);
+    void (*max)(double *Zmax, const unsigned int *count, int n, double z);
+    void (*count)(unsigned int *count, int n);
+    void (*mean)(double *Zmean, int n, double z);
+
+    // Welford's update; count must already include the point
+    void (*std)(double *Zstd, double *Zstd_tmp, const unsigned int *count, int n, double z);
+
+    // dx2[i] + dy2 is the squared distance from the point to cell i, and
+    // the weight is the distance raised to an integer power >= 0
+    void (*idw)(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power);
+};
+
+// kernels for the best instruction set of the running CPU, picked once
+P2G_DLL const SpanKernels& getSpanKernels();
+
+// every variant this build and CPU can run, scalar first, ending with NULL
+P2G_DLL const SpanKernels *const *getAvailableSpanKernels();
+
+extern const SpanKernels scalar_span_kernels;
+extern const SpanKernels sse2_span_kernels;
+extern const SpanKernels avx2_span_kernels;
+extern const SpanKernels avx512_span_kernels;
+
+// IDW update for a power that is not an integer, through pow(); scalar only
+P2G_DLL void span_idw_pow(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, double power);
+
+// the single cell updates of the scalar kernels, also used by the vector
+// kernels for the cells left over at the end of a span. static so every
+// translation unit gets its own copy built for its own instruction set.
+static inline void span_cell_min(double& Zmin, unsigned int count, double z)
+{
+    if(count == 0 || Zmin > z)
+        Zmin = z;
+}
+
+static inline void span_cell_max(double& Zmax, unsigned int count, double z)
+{
+    if(count == 0 || Zmax < z)
+        Zmax = z;
+}
+
+static inline void span_cell_std(double& Zstd, double& Zstd_tmp, unsigned int count, double z)
+{
+    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
+    double delta = z - Zstd_tmp;
+    Zstd_tmp += delta/count;
+    Zstd += delta * (z - Zstd_tmp);
+}
+
+// distance^power from the squared distance, for an integer power >= 0:
+// even powers by repeated squaring, odd ones with a single sqrt. Power 2
+// is the squared distance itself. The vector kernels use the same steps.
+static inline double span_weight(double distance_sqr, int power)
+{
+    int m = power >> 1;
+    double base = distance_sqr;
+    double dist = (m & 1) ? distance_sqr : 1;
+
+    for(m >>= 1; m != 0; m >>= 1) {
+        base *= base;
+        if(m & 1)
+            dist *= base;
+    }
+
+    if(power & 1)
+        dist = sqrt(distance_sqr) * dist;
+
+    return dist;
+}
+
+static inline void span_cell_idw(double& Zidw, double& sum, double dist, double z)
+{
+    if(sum != -1) {
+        if(dist != 0) {
+            Zidw += z/dist;
+            sum += 1/dist;
+        } else {
+            Zidw = z;
+            sum = -1;
+        }
+    }
+}
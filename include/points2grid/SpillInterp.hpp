@@ -0,0 +1,146 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <points2grid/CoreInterp.hpp>
+#include <points2grid/InCoreInterp.hpp>
+#include <points2grid/AsciiReader.hpp>
+#include <points2grid/export.hpp>
+
+using namespace std;
+
+// Out-of-core engine working in two sequential passes. update() appends
+// every point to the spill file of each row band its search radius, or
+// the null filling window, reaches. finish() then grids the bands one by
+// one, several at a time when the memory budget and the threads allow,
+// each with an InCoreInterp over the band and its halo rows, and writes
+// their rows to the outputs as they complete, top band first.
+class P2G_DLL SpillInterp : public CoreInterp
+{
+public:
+    SpillInterp() {};
+    SpillInterp(double dist_x, double dist_y,
+                int size_x, int size_y,
+                double r_sqr,
+                double _min_x, double _max_x,
+                double _min_y, double _max_y,
+                int _window_size);
+    ~SpillInterp();
+
+    virtual int init();
+    virtual int update(double data_x, double data_y, double data_z);
+    virtual int finish(const std::string& outputName, int outputFormat, unsigned int outputType);
+    virtual int finish(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt);
+
+    int getNumBands() const { return num_bands; }
+    int getParallelBands() const { return parallel_bands; }
+    // point copies written to the spill files rather than kept in memory
+    unsigned long getSpilledPoints() const { return num_spilled; }
+
+public:
+    // the fewest points a band buffers before appending them to its
+    // spill file; init() raises it as far as the memory budget allows
+    static const unsigned int MIN_BLOCK_POINTS = 4096;
+
+    // larger blocks make the spill I/O no more sequential
+    static const unsigned int MAX_BLOCK_POINTS = 1 << 20;
+
+private:
+    struct Band
+    {
+        // rows [lower, upper] are written out, rows [overlap_lower,
+        // overlap_upper] are gridded
+        int lower;
+        int upper;
+        int overlap_lower;
+        int overlap_upper;
+
+        // the points after the last block spilled, in input order
+        PointSpill spill;
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+
+        InCoreInterp *grid;
+        int status;
+    };
+
+    void chooseBands();
+    double memoryRequired(int bands, int parallel) const;
+    double blockBytes(size_t points) const;
+    int engineRows(const Band& band) const;
+    void gridBand(Band *band);
+    int openOutput(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt);
+    void writeBand(Band& band);
+    void closeOutput();
+
+private:
+    double radius_sqr;
+    double radius;
+
+    // rows a point reaches beyond its own, and rows of halo every band
+    // needs for the null filling of its own rows
+    int reach_rows;
+    int halo_rows;
+
+    int num_bands;
+    int band_rows;
+    int parallel_bands;
+    size_t block_points;
+    Band *bands;
+
+    unsigned long num_points;
+    unsigned long num_spilled;
+
+    // the open outputs, indexed like the OUTPUT_TYPE_* bits
+    std::vector<FILE *> arcFiles;
+    std::vector<FILE *> gridFiles;
+    // GDALDataset pointers and the rasters filled for them, when built
+    // with GDAL
+    std::vector<void *> gdalFiles;
+    std::vector<float *> gdalRasters;
+};
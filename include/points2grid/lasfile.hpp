@@ -24,10 +24,62 @@
 #include <boost/algorithm/string.hpp>
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <stdexcept>
+#include <stdint.h>
+#include <string.h>
 #include <points2grid/export.hpp>
 
 
+// record lengths of the point data formats; files may pad records beyond
+// these, in which case the header's record length wins
+template<int Format> struct las_point_record;
+template<> struct las_point_record<0> { enum { size = 20 }; };
+template<> struct las_point_record<1> { enum { size = 28 }; };
+template<> struct las_point_record<2> { enum { size = 26 }; };
+template<> struct las_point_record<3> { enum { size = 34 }; };
+template<> struct las_point_record<4> { enum { size = 57 }; };
+template<> struct las_point_record<5> { enum { size = 63 }; };
+// the LAS 1.4 formats: 4 bit return fields and a full classification byte
+template<> struct las_point_record<6> { enum { size = 30 }; };
+template<> struct las_point_record<7> { enum { size = 36 }; };
+template<> struct las_point_record<8> { enum { size = 38 }; };
+template<> struct las_point_record<9> { enum { size = 59 }; };
+template<> struct las_point_record<10> { enum { size = 67 }; };
+
+// A point filter compiled for las_file::filter_points(): a bit per
+// classification, set for the classes kept, which returns are kept and,
+// when clip is set, the box of raw record coordinates kept
+struct las_point_filter {
+    enum { RETURNS_ALL = 0, RETURNS_FIRST, RETURNS_LAST };
+
+    las_point_filter() : returns(RETURNS_ALL), clip(false) {
+        for (int i = 0 ; i < 8 ; i ++)
+            class_mask[i] = 0xFFFFFFFFu;
+        clip_min[0] = clip_min[1] = std::numeric_limits<int>::min();
+        clip_max[0] = clip_max[1] = std::numeric_limits<int>::max();
+    }
+
+    bool keeps_all() const {
+        if (returns != RETURNS_ALL || clip)
+            return false;
+        for (int i = 0 ; i < 8 ; i ++) {
+            if (class_mask[i] != 0xFFFFFFFFu)
+                return false;
+        }
+        return true;
+    }
+
+    // 256 classes for the formats 6-10, the first 32 for the others
+    uint32_t class_mask[8];
+    int returns;
+
+    bool clip;
+    int clip_min[2];
+    int clip_max[2];
+};
+
 
 class P2G_DLL las_file : public boost::noncopyable {
 public:
@@ -38,7 +90,9 @@ public:
         close();
     }
 
-    void open(const std::string& filename, int offset = 0, int count = -1) {
+    // offset is in bytes past the first point record, count -1 for every
+    // point after it
+    void open(const std::string& filename, uint64_t offset = 0, int64_t count = -1) {
         using namespace boost::interprocess;
 
         start_offset_ = offset;
@@ -57,8 +111,9 @@ public:
         char versionMajor = readAs<char>(24);
         char versionMinor = readAs<char>(25);
 
-        if ((int)(versionMajor * 10 + versionMinor) >= 13) {
-            throw std::runtime_error("Only version 1.0-1.2 files are supported");
+        int version = versionMajor * 10 + versionMinor;
+        if (version > 14) {
+            throw std::runtime_error("Only version 1.0-1.4 files are supported");
         }
 
         points_offset_ = readAs<unsigned int>(32*3);
@@ -66,6 +121,23 @@ public:
         points_struct_size_ = readAs<unsigned short>(32*3 + 8 + 1);
         points_count_ = readAs<unsigned int>(32*3 + 11);
 
+        // LAZ marks its compressed records with the top bits of the format
+        if (points_format_id_ & 0xC0) {
+            throw std::runtime_error("Compressed (LAZ) files are not supported");
+        }
+        if (points_format_id_ > 10) {
+            throw std::runtime_error("Unknown point format");
+        }
+
+        // LAS 1.4 keeps the legacy 32 bit count at 0, or below the real one,
+        // when the points do not fit it or are in the new formats
+        if (version >= 14) {
+            if (readAs<unsigned short>(32*3 - 2) < 375) {
+                throw std::runtime_error("LAS 1.4 header is too short");
+            }
+            points_count_ = readAs<uint64_t>(247);
+        }
+
         // std::cerr << "points count: " << points_count_ << std::endl;
 
         size_t start = 32*3 + 35;
@@ -80,13 +152,23 @@ public:
         // std::cerr << "points offset: " << points_offset_ << std::endl;
 
 
-        uint64_t diff = pregion_->get_size() - points_offset_;
-
-        if (diff % stride() != 0)
+        if (pregion_->get_size() < points_offset_)
             throw std::runtime_error("Point record data size is inconsistent");
 
-        if (diff / stride() != points_count_)
-            throw std::runtime_error("Point record count is inconsistent with computed point records size");
+        uint64_t diff = pregion_->get_size() - points_offset_;
+
+        if (version >= 13) {
+            // waveform data and extended variable length records may follow
+            // the points
+            if (diff / stride() < points_count_)
+                throw std::runtime_error("Point record count is inconsistent with computed point records size");
+        } else {
+            if (diff % stride() != 0)
+                throw std::runtime_error("Point record data size is inconsistent");
+
+            if (diff / stride() != points_count_)
+                throw std::runtime_error("Point record count is inconsistent with computed point records size");
+        }
 
         updateMinsMaxes();
 
@@ -113,30 +195,42 @@ public:
 
         switch(points_format_id_) {
             case 0:
-                return 20;
+                return las_point_record<0>::size;
             case 1:
-                return 28;
+                return las_point_record<1>::size;
             case 2:
-                return 26;
+                return las_point_record<2>::size;
             case 3:
-                return 34;
+                return las_point_record<3>::size;
             case 4:
-                return 57;
+                return las_point_record<4>::size;
             case 5:
-                return 63;
+                return las_point_record<5>::size;
+            case 6:
+                return las_point_record<6>::size;
+            case 7:
+                return las_point_record<7>::size;
+            case 8:
+                return las_point_record<8>::size;
+            case 9:
+                return las_point_record<9>::size;
+            case 10:
+                return las_point_record<10>::size;
             default:
                 break;
         }
         throw std::runtime_error("Unknown point format");
     }
 
-    size_t points_count() const {
+    uint64_t points_count() const {
         if (count_ == -1)
             return points_count_;
 
-        return std::min(points_count_, (unsigned int)count_);
+        return std::min(points_count_, (uint64_t)count_);
     }
 
+    int point_format() const { return points_format_id_; }
+
     double* minimums() { return mins_; }
     double* maximums() { return maxs_; }
 
@@ -145,7 +239,7 @@ public:
 
     bool is_open() { return is_open_; }
 
-    inline double getX(size_t point)
+    inline double getX(uint64_t point)
     {
         char *position = (char*)points_offset() + stride()* point;
 
@@ -156,7 +250,7 @@ public:
         return x;
     }
 
-    inline double getY(size_t point)
+    inline double getY(uint64_t point)
     {
         char *position = (char *)points_offset() + stride() * point + sizeof(int);
 
@@ -167,7 +261,7 @@ public:
         return y;
     }
 
-    inline double getZ(size_t point)
+    inline double getZ(uint64_t point)
     {
         char *position = (char *)points_offset() + stride() * point + sizeof(int) + sizeof(int);
 
@@ -178,39 +272,256 @@ public:
         return z;
     }
 
-    inline int getClassification(size_t point)
+    // formats 6-10 widen the return fields and the classification
+    bool extended_format() const { return points_format_id_ >= 6; }
+
+    inline int getClassification(uint64_t point)
     {
-        int classification_offset = 15;
-        char *position = (char *)points_offset() + stride() * point + classification_offset;
+        unsigned char *position = (unsigned char *)points_offset() + stride() * point;
 
-        int *classi = (int *)position;
+        if (extended_format())
+            return position[16];
+        return position[15] & 0x1F;
+    }
 
-        int classification = *classi & 0x1F;
+    inline int getReturnNumber(uint64_t point)
+    {
+        unsigned char *position = (unsigned char *)points_offset() + stride() * point + 14;
 
-        return classification;
+        if (extended_format())
+            return *position & 0x0F; // bits 0-3
+        return *position & 0x07; // Return number in bitfield, bits 0, 1 and 2
     }
 
-    inline int getReturnNumber(size_t point)
+    inline int getNumberOfReturns(uint64_t point)
     {
-        int return_number_offset = 14;
-        char *position = (char *)points_offset() + stride() * point + return_number_offset;
+        unsigned char *position = (unsigned char *)points_offset() + stride() * point + 14;
 
-        int *return_num = (int *)position;
+        if (extended_format())
+            return (*position >> 4) & 0x0F; // bits 4-7
+        return (*position >> 3) & 0x07; // Number of returns in bitfield, bits 3, 4 and 5
+    }
 
-        return *return_num & 0x07; // Return number in bitfield, bits 0, 1 and 2
+    // Decodes the n points starting at first into structure-of-arrays
+    // buffers. returns gets the return number in bits 0-3 and the number
+    // of returns in bits 4-7, whatever the format, and classes the
+    // classification; either may be NULL when it is not needed.
+    void decode_points(uint64_t first, size_t n, double *x, double *y, double *z,
+                       unsigned char *returns = NULL, unsigned char *classes = NULL)
+    {
+        if (!decode_format<0>(first, n, x, y, z, returns, classes) &&
+            !decode_format<1>(first, n, x, y, z, returns, classes) &&
+            !decode_format<2>(first, n, x, y, z, returns, classes) &&
+            !decode_format<3>(first, n, x, y, z, returns, classes) &&
+            !decode_format<4>(first, n, x, y, z, returns, classes) &&
+            !decode_format<5>(first, n, x, y, z, returns, classes) &&
+            !decode_format<6>(first, n, x, y, z, returns, classes) &&
+            !decode_format<7>(first, n, x, y, z, returns, classes) &&
+            !decode_format<8>(first, n, x, y, z, returns, classes) &&
+            !decode_format<9>(first, n, x, y, z, returns, classes) &&
+            !decode_format<10>(first, n, x, y, z, returns, classes)) {
+            if (extended_format())
+                decode<0, true>(first, n, x, y, z, returns, classes);
+            else
+                decode<0, false>(first, n, x, y, z, returns, classes);
+        }
     }
 
-    inline int getNumberOfReturns(size_t point)
+    // Writes the indices, relative to first, of the points among n that
+    // pass the filter to selected and returns how many there are. Only the
+    // return and classification bytes are read.
+    size_t filter_points(uint64_t first, size_t n, const las_point_filter& filter, uint32_t *selected)
     {
-        int return_number_offset = 14;
-        char *position = (char *)points_offset() + stride() * point + return_number_offset;
+        if (filter.keeps_all()) {
+            for (size_t i = 0 ; i < n ; i ++)
+                selected[i] = (uint32_t)i;
+            return n;
+        }
+
+        if (filter.clip) {
+            if (extended_format())
+                return filter_records<true, true>(first, n, filter, selected);
+            return filter_records<false, true>(first, n, filter, selected);
+        }
+        if (extended_format())
+            return filter_records<true, false>(first, n, filter, selected);
+        return filter_records<false, false>(first, n, filter, selected);
+    }
 
-        int *return_num = (int *)position;
+    // Restricts filter to the points within [min_x, max_x] x [min_y, max_y],
+    // widened by a unit of the record scale so that rounding never drops a
+    // point inside. The clip is left off when the header extent is already
+    // inside the box.
+    void clip_filter(las_point_filter& filter, double min_x, double min_y, double max_x, double max_y) const
+    {
+        if (mins_[0] >= min_x && maxs_[0] <= max_x && mins_[1] >= min_y && maxs_[1] <= max_y) {
+            filter.clip = false;
+            return;
+        }
 
-        return (*return_num >> 3) & 0x07; // Number of returns in bitfield, bits 3, 4 and 5
+        double lo[2] = { min_x, min_y }, hi[2] = { max_x, max_y };
+        for (int k = 0 ; k < 2 ; k ++) {
+            double a = (lo[k] - offset_[k]) / scale_[k];
+            double b = (hi[k] - offset_[k]) / scale_[k];
+            if (a > b)
+                std::swap(a, b);
+            filter.clip_min[k] = raw_bound(std::floor(a) - 1);
+            filter.clip_max[k] = raw_bound(std::ceil(b) + 1);
+        }
+        filter.clip = true;
+    }
+
+    // decodes the coordinates of the m points first + selected[i]
+    void decode_selected(uint64_t first, const uint32_t *selected, size_t m, double *x, double *y, double *z)
+    {
+        switch (stride()) {
+            case las_point_record<0>::size: gather<las_point_record<0>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<1>::size: gather<las_point_record<1>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<2>::size: gather<las_point_record<2>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<3>::size: gather<las_point_record<3>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<4>::size: gather<las_point_record<4>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<5>::size: gather<las_point_record<5>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<6>::size: gather<las_point_record<6>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<7>::size: gather<las_point_record<7>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<8>::size: gather<las_point_record<8>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<9>::size: gather<las_point_record<9>::size>(first, selected, m, x, y, z); break;
+            case las_point_record<10>::size: gather<las_point_record<10>::size>(first, selected, m, x, y, z); break;
+            default: gather<0>(first, selected, m, x, y, z); break;
+        }
     }
 
 private:
+    // points decoded into the integer buffers at a time
+    enum { DECODE_CHUNK = 256 };
+
+    // v clamped to the range of a raw record coordinate
+    static int raw_bound(double v) {
+        if (v <= (double)std::numeric_limits<int>::min())
+            return std::numeric_limits<int>::min();
+        if (v >= (double)std::numeric_limits<int>::max())
+            return std::numeric_limits<int>::max();
+        return (int)v;
+    }
+
+    // The bytes of a chunk are copied out of the records first, so the
+    // filter itself runs without branches over small arrays, and the
+    // survivors are compacted by always storing and advancing by the
+    // keep flag
+    template<bool Extended, bool Clip>
+    size_t filter_records(uint64_t first, size_t n, const las_point_filter& filter, uint32_t *selected) {
+        const size_t step = stride();
+        const unsigned char *position = (const unsigned char *)points_offset() + step * first;
+        const unsigned int class_offset = Extended ? 16 : 15;
+        const unsigned int class_bits = Extended ? 0xFF : 0x1F;
+        const unsigned int first_only = filter.returns == las_point_filter::RETURNS_FIRST;
+        const unsigned int last_only = filter.returns == las_point_filter::RETURNS_LAST;
+        unsigned char rb[DECODE_CHUNK], cb[DECODE_CHUNK];
+        int xb[Clip ? DECODE_CHUNK : 1], yb[Clip ? DECODE_CHUNK : 1];
+        size_t m = 0;
+
+        for (size_t done = 0 ; done < n ; done += DECODE_CHUNK) {
+            size_t count = std::min(n - done, (size_t)DECODE_CHUNK);
+
+            for (size_t i = 0 ; i < count ; i ++) {
+                rb[i] = position[14];
+                cb[i] = position[class_offset] & class_bits;
+                if (Clip) {
+                    memcpy(&xb[i], position, sizeof(int));
+                    memcpy(&yb[i], position + 4, sizeof(int));
+                }
+                position += step;
+            }
+
+            for (size_t i = 0 ; i < count ; i ++) {
+                unsigned int r = rb[i];
+                unsigned int number = Extended ? r & 0x0F : r & 0x07;
+                unsigned int returns = Extended ? r >> 4 : (r >> 3) & 0x07;
+                unsigned int c = cb[i];
+
+                unsigned int keep = (filter.class_mask[c >> 5] >> (c & 31)) & 1;
+                keep &= ~(first_only & (number != 1)) & ~(last_only & (number != returns)) & 1;
+                if (Clip) {
+                    keep &= (xb[i] >= filter.clip_min[0]) & (xb[i] <= filter.clip_max[0]) &
+                            (yb[i] >= filter.clip_min[1]) & (yb[i] <= filter.clip_max[1]);
+                }
+
+                selected[m] = (uint32_t)(done + i);
+                m += keep;
+            }
+        }
+
+        return m;
+    }
+
+    template<size_t Stride>
+    void gather(uint64_t first, const uint32_t *selected, size_t m, double *x, double *y, double *z) {
+        const size_t step = Stride ? Stride : stride();
+        const char *base = (const char *)points_offset() + step * first;
+        int xi[DECODE_CHUNK], yi[DECODE_CHUNK], zi[DECODE_CHUNK];
+
+        for (size_t done = 0 ; done < m ; done += DECODE_CHUNK) {
+            size_t count = std::min(m - done, (size_t)DECODE_CHUNK);
+
+            for (size_t i = 0 ; i < count ; i ++) {
+                const char *position = base + step * selected[done + i];
+                memcpy(&xi[i], position, sizeof(int));
+                memcpy(&yi[i], position + sizeof(int), sizeof(int));
+                memcpy(&zi[i], position + 2 * sizeof(int), sizeof(int));
+            }
+
+            scale_values(xi, count, scale_[0], offset_[0], x + done);
+            scale_values(yi, count, scale_[1], offset_[1], y + done);
+            scale_values(zi, count, scale_[2], offset_[2], z + done);
+        }
+    }
+
+    template<int Format>
+    bool decode_format(uint64_t first, size_t n, double *x, double *y, double *z,
+                       unsigned char *returns, unsigned char *classes) {
+        if (points_format_id_ != Format || stride() != las_point_record<Format>::size)
+            return false;
+
+        decode<las_point_record<Format>::size, (Format >= 6)>(first, n, x, y, z, returns, classes);
+        return true;
+    }
+
+    // Stride is the record length, or 0 to use stride() for padded records;
+    // Extended for the formats 6-10
+    template<size_t Stride, bool Extended>
+    void decode(uint64_t first, size_t n, double *x, double *y, double *z,
+                unsigned char *returns, unsigned char *classes) {
+        const size_t step = Stride ? Stride : stride();
+        const char *position = (const char *)points_offset() + step * first;
+        int xi[DECODE_CHUNK], yi[DECODE_CHUNK], zi[DECODE_CHUNK];
+
+        for (size_t done = 0 ; done < n ; done += DECODE_CHUNK) {
+            size_t count = std::min(n - done, (size_t)DECODE_CHUNK);
+
+            // records are not aligned, so copy the fields out bytewise
+            for (size_t i = 0 ; i < count ; i ++) {
+                memcpy(&xi[i], position, sizeof(int));
+                memcpy(&yi[i], position + sizeof(int), sizeof(int));
+                memcpy(&zi[i], position + 2 * sizeof(int), sizeof(int));
+                unsigned char r = (unsigned char)position[14];
+                if (returns)
+                    returns[done + i] = Extended ? r : (unsigned char)((r & 0x07) | ((r >> 3) & 0x07) << 4);
+                if (classes)
+                    classes[done + i] = Extended ? (unsigned char)position[16] : (unsigned char)position[15] & 0x1F;
+                position += step;
+            }
+
+            // separate loops so the compiler vectorizes the conversions
+            scale_values(xi, count, scale_[0], offset_[0], x + done);
+            scale_values(yi, count, scale_[1], offset_[1], y + done);
+            scale_values(zi, count, scale_[2], offset_[2], z + done);
+        }
+    }
+
+    static void scale_values(const int *values, size_t n, double scale, double offset, double *out) {
+        for (size_t i = 0 ; i < n ; i ++)
+            out[i] = values[i] * scale + offset;
+    }
+
     void updateMinsMaxes() {
         if (start_offset_ == 0 && count_ == -1)
             return; // no update required if no subrange is requested
@@ -222,7 +533,7 @@ private:
         int x[3] = { smallest, smallest, smallest };
 
         char *ip = (char *)points_offset();
-        for (size_t i = 0 ; i < points_count() ; i ++) {
+        for (uint64_t i = 0 ; i < points_count() ; i ++) {
             int *p = (int *)ip;
             for (int j = 0 ; j < 3 ; j ++) {
                 n[j] = std::min(n[j], p[j]);
@@ -255,11 +566,11 @@ private:
     boost::shared_ptr<boost::interprocess::file_mapping> pmapping_;
     boost::shared_ptr<boost::interprocess::mapped_region> pregion_;
 
-    unsigned int start_offset_;
-    int count_;
-    unsigned int points_offset_;
+    uint64_t start_offset_;
+    int64_t count_;
+    uint64_t points_offset_;
     unsigned char points_format_id_;
-    unsigned int points_count_;
+    uint64_t points_count_;
     unsigned short points_struct_size_;
 
     double scale_[3], offset_[3], mins_[3], maxs_[3];
@@ -0,0 +1,369 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <points2grid/config.h>
+#include <points2grid/AsciiReader.hpp>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#ifdef __has_include
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+
+// the number at the start of a field, as atof() would read it
+double parse_double(const char *p, const char *end)
+{
+    while(p < end && isspace((unsigned char)*p))
+        p++;
+
+#ifdef __cpp_lib_to_chars
+    const char *q = (p < end && *p == '+') ? p + 1 : p;
+    double value;
+    std::from_chars_result r = std::from_chars(q, end, value);
+    if(r.ec == std::errc() && (r.ptr == end || isspace((unsigned char)*r.ptr)))
+        return value;
+#endif
+
+    // hex, out of range or not a number at all: let strtod decide
+    char buf[128];
+    size_t len = (size_t)(end - p) < sizeof(buf) - 1 ? (size_t)(end - p) : sizeof(buf) - 1;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    return strtod(buf, NULL);
+}
+
+// the next field of a line, skipping empty ones like strtok() does
+bool next_field(const char *&p, const char *end, double& value)
+{
+    while(p < end && *p == ',')
+        p++;
+    if(p == end)
+        return false;
+
+    const char *field_end = (const char *)memchr(p, ',', end - p);
+    if(field_end == NULL)
+        field_end = end;
+
+    value = parse_double(p, field_end);
+    p = field_end;
+    return true;
+}
+
+}
+
+//////////////////////////////////////////////////////////////////////
+// AsciiReader
+//////////////////////////////////////////////////////////////////////
+
+AsciiReader::AsciiReader()
+: m_data(NULL)
+, m_end(NULL)
+, m_first(NULL)
+, m_pos(NULL)
+, m_threads(1)
+{
+}
+
+AsciiReader::~AsciiReader()
+{
+    close();
+}
+
+int AsciiReader::open(const std::string& fileName, int threads)
+{
+    close();
+
+    try {
+        m_file.open(fileName);
+    }
+    catch(std::exception& e) {
+        cerr << "AsciiReader::open() " << e.what() << endl;
+        return -1;
+    }
+
+    if(!m_file.is_open())
+    {
+        cerr << "AsciiReader::open() file open error: " << fileName << endl;
+        return -1;
+    }
+
+    m_data = m_file.data();
+    m_end = m_data + m_file.size();
+    m_threads = threads < 1 ? 1 : threads;
+    m_pieces.resize(m_threads);
+
+    // throw the first line away - it contains the header
+    m_first = nextLine(m_data);
+    m_pos = m_first;
+
+    return 0;
+}
+
+void AsciiReader::close()
+{
+    if(m_file.is_open())
+        m_file.close();
+    m_data = m_end = m_first = m_pos = NULL;
+}
+
+void AsciiReader::rewind()
+{
+    m_pos = m_first;
+}
+
+// the start of the line after the one p is in
+const char *AsciiReader::nextLine(const char *p) const
+{
+    if(p >= m_end)
+        return m_end;
+
+    const char *nl = (const char *)memchr(p, '\n', m_end - p);
+    return nl == NULL ? m_end : nl + 1;
+}
+
+bool AsciiReader::read(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z)
+{
+    x.clear();
+    y.clear();
+    z.clear();
+
+    while(x.empty() && m_pos < m_end)
+    {
+        // split the next block at line ends, one piece per thread
+        size_t block = (size_t)(m_end - m_pos);
+        if(block > CHUNK_SIZE * m_threads)
+            block = CHUNK_SIZE * m_threads;
+
+        int num_pieces = 0;
+        const char *p = m_pos;
+        for(int t = 0; t < m_threads && p < m_end; t++)
+        {
+            const char *stop = t == m_threads - 1 ? m_pos + block : p + block / m_threads;
+            if(stop > m_end)
+                stop = m_end;
+
+            m_pieces[num_pieces].begin = p;
+            m_pieces[num_pieces].end = stop > p ? nextLine(stop - 1) : p;
+            p = m_pieces[num_pieces].end;
+            num_pieces++;
+        }
+        m_pos = p;
+
+        if(num_pieces == 1)
+        {
+            parsePiece(&m_pieces[0]);
+        } else {
+            boost::thread_group workers;
+            for(int t = 0; t < num_pieces; t++)
+                workers.create_thread(boost::bind(&AsciiReader::parsePiece, &m_pieces[t]));
+            workers.join_all();
+        }
+
+        for(int t = 0; t < num_pieces; t++)
+        {
+            const Piece& piece = m_pieces[t];
+            x.insert(x.end(), piece.x.begin(), piece.x.end());
+            y.insert(y.end(), piece.y.begin(), piece.y.end());
+            z.insert(z.end(), piece.z.begin(), piece.z.end());
+        }
+    }
+
+    return !x.empty();
+}
+
+void AsciiReader::parsePiece(Piece *piece)
+{
+    const char *p = piece->begin;
+    double data_x, data_y, data_z;
+
+    piece->x.clear();
+    piece->y.clear();
+    piece->z.clear();
+
+    while(p < piece->end)
+    {
+        const char *nl = (const char *)memchr(p, '\n', piece->end - p);
+        const char *line_end = nl == NULL ? piece->end : nl;
+
+        if(parseLine(p, line_end, data_x, data_y, data_z))
+        {
+            piece->x.push_back(data_x);
+            piece->y.push_back(data_y);
+            piece->z.push_back(data_z);
+        }
+
+        p = line_end + 1;
+    }
+}
+
+bool AsciiReader::parseLine(const char *begin, const char *end, double& x, double& y, double& z)
+{
+    const char *p = begin;
+
+    return next_field(p, end, x) &&
+           next_field(p, end, y) &&
+           next_field(p, end, z);
+}
+
+//////////////////////////////////////////////////////////////////////
+// PointSpill
+//////////////////////////////////////////////////////////////////////
+
+PointSpill::PointSpill()
+: m_fp(NULL)
+{
+}
+
+PointSpill::~PointSpill()
+{
+    close();
+}
+
+int PointSpill::create()
+{
+    close();
+
+#ifdef _WIN32
+    m_fp = tmpfile();
+#else
+    // like the out-of-core grid files, honour TMPDIR; the file is unlinked
+    // right away so it goes when it is closed, even after a crash
+    const char *tmpdir = getenv("TMPDIR");
+    std::string name = std::string(tmpdir ? tmpdir : "/tmp") + "/p2gXXXXXX";
+    std::vector<char> path(name.begin(), name.end());
+    path.push_back('\0');
+
+    int fd = mkstemp(&path[0]);
+    if(fd >= 0)
+    {
+        unlink(&path[0]);
+        if((m_fp = fdopen(fd, "w+b")) == NULL)
+            ::close(fd);
+    }
+#endif
+
+    if(m_fp == NULL)
+    {
+        cerr << "PointSpill::create() temporary file error" << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+void PointSpill::close()
+{
+    if(m_fp != NULL)
+        fclose(m_fp);
+    m_fp = NULL;
+}
+
+// a block is its point count followed by its x, y and z arrays
+int PointSpill::write(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z)
+{
+    size_t n = x.size();
+
+    if(n == 0)
+        return 0;
+
+    if(fwrite(&n, sizeof(n), 1, m_fp) != 1 ||
+            fwrite(&x[0], sizeof(double), n, m_fp) != n ||
+            fwrite(&y[0], sizeof(double), n, m_fp) != n ||
+            fwrite(&z[0], sizeof(double), n, m_fp) != n)
+    {
+        cerr << "PointSpill::write() write error" << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+int PointSpill::rewind()
+{
+    if(fflush(m_fp) != 0 || fseek(m_fp, 0, SEEK_SET) != 0)
+    {
+        cerr << "PointSpill::rewind() seek error" << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+bool PointSpill::read(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z)
+{
+    size_t n;
+
+    if(fread(&n, sizeof(n), 1, m_fp) != 1)
+        return false;
+
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+
+    if(fread(&x[0], sizeof(double), n, m_fp) != n ||
+            fread(&y[0], sizeof(double), n, m_fp) != n ||
+            fread(&z[0], sizeof(double), n, m_fp) != n)
+    {
+        cerr << "PointSpill::read() short read" << endl;
+        return false;
+    }
+
+    return true;
+}
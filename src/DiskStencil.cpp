@@ -0,0 +1,147 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <points2grid/DiskStencil.hpp>
+
+#include <math.h>
+#include <algorithm>
+
+DiskStencil::DiskStencil()
+: GRID_DIST_X(0)
+, GRID_DIST_Y(0)
+, radius_sqr(0)
+, max_rows(-1)
+{
+}
+
+void DiskStencil::init(double dist_x, double dist_y, double r_sqr)
+{
+    GRID_DIST_X = dist_x;
+    GRID_DIST_Y = dist_y;
+    radius_sqr = r_sqr;
+
+    double radius = sqrt(radius_sqr);
+
+    // a point's offset inside its cell is only known up to rounding, so
+    // every bound below keeps one extra row or column, and a row's nearest
+    // cell center is taken half a cell closer than it can actually be
+    max_rows = (int)floor(radius / GRID_DIST_Y) + 1;
+    half_width.resize(2 * max_rows + 2);
+
+    for(int k = -max_rows; k <= max_rows + 1; k++)
+    {
+        int m = k >= 1 ? k - 1 : -k;
+        double dy = m > 0 ? (m - 0.5) * GRID_DIST_Y : 0;
+
+        if(dy * dy > radius_sqr)
+            half_width[k + max_rows] = -1;
+        else
+            half_width[k + max_rows] = (int)floor(sqrt(radius_sqr - dy * dy) / GRID_DIST_X) + 1;
+    }
+}
+
+void DiskStencil::cover(double data_x, double data_y,
+                        int col_lo, int col_hi, int row_lo, int row_hi,
+                        StencilCover& c) const
+{
+    int i, j;
+
+    int lower_grid_x = (int)floor((double)data_x/GRID_DIST_X);
+    int lower_grid_y = (int)floor((double)data_y/GRID_DIST_Y);
+
+    // distances to the cell centers left/below and right/above the point,
+    // the same terms the quadrant walks started from
+    double x = data_x - lower_grid_x * GRID_DIST_X;
+    double y = data_y - lower_grid_y * GRID_DIST_Y;
+    double x_right = GRID_DIST_X - x;
+    double y_above = GRID_DIST_Y - y;
+
+    int max_cols = half_width[max_rows];
+    int first_col = std::max(lower_grid_x - max_cols, col_lo);
+    int last_col = std::min(lower_grid_x + max_cols + 1, col_hi - 1);
+    int first_row = std::max(lower_grid_y - max_rows, row_lo);
+    int last_row = std::min(lower_grid_y + max_rows + 1, row_hi - 1);
+
+    c.num_spans = 0;
+    if(first_col > last_col || first_row > last_row)
+        return;
+
+    c.first_col = first_col;
+    if(c.dx2.size() < (size_t)(last_col - first_col + 1))
+        c.dx2.resize(last_col - first_col + 1);
+    if(c.spans.size() < (size_t)(last_row - first_row + 1))
+        c.spans.resize(last_row - first_row + 1);
+
+    for(i = first_col; i <= last_col; i++)
+    {
+        double dx = i > lower_grid_x ? (i - (lower_grid_x + 1))*GRID_DIST_X + x_right :
+                                       (lower_grid_x - i)*GRID_DIST_X + x;
+        c.dx2[i - first_col] = dx * dx;
+    }
+
+    for(j = first_row; j <= last_row; j++)
+    {
+        int w = half_width[j - lower_grid_y + max_rows];
+        if(w < 0)
+            continue;
+
+        double dy = j > lower_grid_y ? (j - (lower_grid_y + 1))*GRID_DIST_Y + y_above :
+                                       (lower_grid_y - j)*GRID_DIST_Y + y;
+
+        StencilSpan& span = c.spans[c.num_spans];
+        span.row = j;
+        span.dy2 = dy * dy;
+        span.first = std::max(lower_grid_x - w, first_col);
+        span.last = std::min(lower_grid_x + w + 1, last_col);
+
+        // the squared distance falls towards the point's column and rises
+        // away from it, so the covered cells are one run inside the span
+        while(span.first <= span.last && c.distance_sqr(span, span.first) > radius_sqr)
+            span.first++;
+        while(span.last >= span.first && c.distance_sqr(span, span.last) > radius_sqr)
+            span.last--;
+
+        if(span.first <= span.last)
+            c.num_spans++;
+    }
+}
@@ -0,0 +1,197 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <points2grid/GridCells.hpp>
+#include <points2grid/Aligned.hpp>
+
+#include <iostream>
+
+namespace
+{
+
+template<typename T>
+int allocate_array(T *&array, size_t num_cells)
+{
+    array = (T *)aligned_calloc(sizeof(T) * num_cells);
+    return array == NULL ? -1 : 0;
+}
+
+template<typename T>
+void release_array(T *&array)
+{
+    if(array != NULL)
+        aligned_free(array);
+    array = NULL;
+}
+
+}
+
+GridCells::GridCells()
+: Zmin(NULL)
+, Zmax(NULL)
+, Zmean(NULL)
+, Zidw(NULL)
+, sum(NULL)
+, Zstd(NULL)
+, Zstd_tmp(NULL)
+, count(NULL)
+, flags(NULL)
+, size(0)
+, stats(0)
+{
+}
+
+GridCells::~GridCells()
+{
+    release();
+}
+
+unsigned int GridCells::getStats(unsigned int output_type)
+{
+    output_type &= OUTPUT_TYPE_ALL;
+    return output_type == 0 ? OUTPUT_TYPE_ALL : output_type;
+}
+
+size_t GridCells::getCellSize(unsigned int output_type)
+{
+    unsigned int s = getStats(output_type);
+    size_t bytes = sizeof(unsigned char);
+
+    if(s & OUTPUT_TYPE_MIN)
+        bytes += sizeof(double);
+    if(s & OUTPUT_TYPE_MAX)
+        bytes += sizeof(double);
+    if(s & OUTPUT_TYPE_MEAN)
+        bytes += sizeof(double);
+    if(s & OUTPUT_TYPE_IDW)
+        bytes += 2 * sizeof(double);
+    if(s & OUTPUT_TYPE_STD)
+        bytes += 2 * sizeof(double);
+    if(s & COUNTED_OUTPUT_TYPES)
+        bytes += sizeof(unsigned int);
+
+    return bytes;
+}
+
+int GridCells::allocate(size_t num_cells, unsigned int output_type)
+{
+    int rc = 0;
+
+    release();
+
+    size = num_cells;
+    stats = getStats(output_type);
+
+    if(stats & OUTPUT_TYPE_MIN)
+        rc |= allocate_array(Zmin, size);
+    if(stats & OUTPUT_TYPE_MAX)
+        rc |= allocate_array(Zmax, size);
+    if(stats & OUTPUT_TYPE_MEAN)
+        rc |= allocate_array(Zmean, size);
+    if(stats & OUTPUT_TYPE_IDW)
+    {
+        rc |= allocate_array(Zidw, size);
+        rc |= allocate_array(sum, size);
+    }
+    if(stats & OUTPUT_TYPE_STD)
+    {
+        rc |= allocate_array(Zstd, size);
+        rc |= allocate_array(Zstd_tmp, size);
+    }
+    if(stats & COUNTED_OUTPUT_TYPES)
+        rc |= allocate_array(count, size);
+    rc |= allocate_array(flags, size);
+
+    if(rc != 0)
+    {
+        std::cerr << "GridCells::allocate() allocation error" << std::endl;
+        release();
+        return -1;
+    }
+
+    // every accumulator starts out as zero bytes, see SpanKernels::min
+    return 0;
+}
+
+void GridCells::release()
+{
+    release_array(Zmin);
+    release_array(Zmax);
+    release_array(Zmean);
+    release_array(Zidw);
+    release_array(sum);
+    release_array(Zstd);
+    release_array(Zstd_tmp);
+    release_array(count);
+    release_array(flags);
+    size = 0;
+}
+
+GridPoint GridCells::getGridPoint(size_t k) const
+{
+    GridPoint gp = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+    if(Zmin != NULL)
+        gp.Zmin = Zmin[k];
+    if(Zmax != NULL)
+        gp.Zmax = Zmax[k];
+    if(Zmean != NULL)
+        gp.Zmean = Zmean[k];
+    if(Zidw != NULL)
+    {
+        gp.Zidw = Zidw[k];
+        gp.sum = sum[k];
+    }
+    if(Zstd != NULL)
+    {
+        gp.Zstd = Zstd[k];
+        gp.Zstd_tmp = Zstd_tmp[k];
+    }
+    if(count != NULL)
+        gp.count = count[k];
+
+    gp.empty = (flags[k] & CELL_HAS_DATA) ? 1 : 0;
+    gp.filled = (flags[k] & CELL_FILLED) ? 1 : 0;
+
+    return gp;
+}
@@ -46,11 +46,18 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <points2grid/config.h>
 #include <points2grid/GridFile.hpp>
+#include <points2grid/Global.hpp>
+#include <points2grid/Aligned.hpp>
 #include <float.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#endif
 
 GridFile::GridFile(int id, char *fname, int size_x, int size_y)
 : m_id(id)
@@ -59,12 +66,27 @@ GridFile::GridFile(int id, char *fname, int size_x, int size_y)
 , m_inMemory(false)
 , m_firstMap(true)
 , m_filename(fname)
+, m_ioMode(GRID_FILE_MMAP)
+, m_buffer(NULL)
+, m_bufferSize(0)
+, m_stored(false)
+, m_bytesRead(0)
+, m_bytesWritten(0)
+, m_ioSeconds(0)
 {
 
 }
 
 GridFile::~GridFile()
 {
+    // the file goes away, so a buffered tile is not worth writing back
+    if(m_buffer != NULL)
+    {
+        aligned_free(m_buffer);
+        m_buffer = NULL;
+        m_inMemory = false;
+        interp = NULL;
+    }
     unmap();
 #ifdef _WIN32
     _unlink(m_filename.c_str());
@@ -85,6 +107,10 @@ int GridFile::map()
     if (m_inMemory) {
         return 0;
     }
+
+    if (m_ioMode != GRID_FILE_MMAP) {
+        return load();
+    }
     
     boost::iostreams::mapped_file_params params;
     params.path = m_filename;
@@ -109,13 +135,18 @@ int GridFile::map()
     }
 
     if (m_firstMap) {
-        // initialize every point in the file
-        GridPoint init_value = {DBL_MAX, -DBL_MAX, 0, 0, 0, 0, 0, 0};
-        for(int i = 0; i < m_size_x * m_size_y; i++)
-            memcpy(interp + i, &init_value, sizeof(GridPoint));
+        // the new file reads as zeros, which is an empty GridPoint, so it
+        // stays sparse until points reach its pages
         cerr << m_id << ". file size: " << params.new_file_size << endl;
         m_firstMap = false;
     }
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+    else {
+        // start readahead of whatever prefetch() has not brought in yet, so
+        // the pages fault in behind the first accesses instead of one by one
+        madvise(m_mf.data(), m_mf.size(), MADV_WILLNEED);
+    }
+#endif
     
     m_inMemory = true;
     return 0;
@@ -123,6 +154,17 @@ int GridFile::map()
 
 int GridFile::unmap()
 {
+    if(m_inMemory && m_ioMode != GRID_FILE_MMAP)
+    {
+        int status = store();
+
+        aligned_free(m_buffer);
+        m_buffer = NULL;
+        m_inMemory = false;
+        interp = NULL;
+        return status;
+    }
+
     if(m_inMemory)
     {
         m_mf.close();
@@ -142,3 +184,201 @@ unsigned int GridFile::getMemSize()
 {
     return m_size_x * m_size_y * sizeof(GridPoint);
 }
+
+// ask the kernel to read the file into the page cache ahead of map()
+int GridFile::prefetch() const
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    int fd = open(m_filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return -1;
+    int rc = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+    return rc == 0 ? 0 : -1;
+#else
+    return 0;
+#endif
+}
+
+// start writing back the dirty pages left by unmap() without waiting for
+// them, so the page cache does not stall a later map() to reclaim them
+int GridFile::writeback() const
+{
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+    int fd = open(m_filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return -1;
+    int rc = sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+    close(fd);
+    return rc == 0 ? 0 : -1;
+#else
+    return 0;
+#endif
+}
+
+void GridFile::setIOMode(int mode)
+{
+#ifndef _WIN32
+    m_ioMode = mode;
+#else
+    // no pread()/pwrite() here; tiles stay mapped
+    m_ioMode = GRID_FILE_MMAP;
+#endif
+}
+
+#ifndef _WIN32
+static double io_clock()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// opens the tile's file, with O_DIRECT if asked and the file system
+// takes it; direct is cleared when it does not
+static int open_tile(const std::string& name, int flags, bool& direct)
+{
+#ifdef O_DIRECT
+    if(direct)
+    {
+        int fd = open(name.c_str(), flags | O_DIRECT, 0644);
+        if(fd >= 0 || errno != EINVAL)
+            return fd;
+    }
+#endif
+    direct = false;
+    return open(name.c_str(), flags, 0644);
+}
+
+// whether n bytes at p are all zero
+static bool all_zero(const char *p, size_t n)
+{
+    return n == 0 || (p[0] == 0 && memcmp(p, p + 1, n - 1) == 0);
+}
+#endif
+
+// reads the tile into an owned buffer, in IO_CHUNK_SIZE pieces. A new
+// tile is all zeros, an empty GridPoint, and has no file until store()
+int GridFile::load()
+{
+#ifndef _WIN32
+    bool direct = m_ioMode == GRID_FILE_DIRECT;
+    size_t size = sizeof(GridPoint) * m_size_x * m_size_y;
+
+    m_bufferSize = (size + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    m_buffer = (char *)aligned_calloc(m_bufferSize, DIRECT_IO_ALIGNMENT);
+    if(m_buffer == NULL)
+    {
+        cerr << "GridFile::load() buffer allocation error: " << m_bufferSize << " bytes" << endl;
+        return -1;
+    }
+
+    if(m_firstMap)
+    {
+        cerr << m_id << ". file size: " << size << endl;
+        m_firstMap = false;
+    }
+    else if(m_stored)
+    {
+        double t0 = io_clock();
+        int fd = open_tile(m_filename, O_RDONLY, direct);
+        if(fd < 0)
+        {
+            cerr << "GridFile::load() can not open " << m_filename << ": " << strerror(errno) << endl;
+            aligned_free(m_buffer);
+            m_buffer = NULL;
+            return -1;
+        }
+
+        // the file may end early, the rest of the buffer is zero already
+        size_t off = 0;
+        while(off < m_bufferSize)
+        {
+            ssize_t n = pread(fd, m_buffer + off, min((size_t)IO_CHUNK_SIZE, m_bufferSize - off), off);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+            {
+                cerr << "GridFile::load() read error " << m_filename << ": " << strerror(errno) << endl;
+                close(fd);
+                aligned_free(m_buffer);
+                m_buffer = NULL;
+                return -1;
+            }
+            if(n == 0)
+                break;
+            off += n;
+        }
+        close(fd);
+
+        m_bytesRead += off;
+        m_ioSeconds += io_clock() - t0;
+    }
+
+    if(m_ioMode == GRID_FILE_DIRECT && !direct)
+    {
+        cerr << m_id << ". O_DIRECT refused, using buffered pread()/pwrite()" << endl;
+        m_ioMode = GRID_FILE_PREAD;
+    }
+
+    interp = (GridPoint *)m_buffer;
+    m_inMemory = true;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// writes the buffer back in IO_CHUNK_SIZE pieces. The first time, the
+// file is created at full size and the chunks still all zero are left as
+// holes, keeping the file as sparse as a mapped one
+int GridFile::store()
+{
+#ifndef _WIN32
+    bool direct = m_ioMode == GRID_FILE_DIRECT;
+    double t0 = io_clock();
+
+    int fd = open_tile(m_filename, O_WRONLY | O_CREAT, direct);
+    if(fd < 0)
+    {
+        cerr << "GridFile::store() can not open " << m_filename << ": " << strerror(errno) << endl;
+        return -1;
+    }
+    if(!m_stored && ftruncate(fd, m_bufferSize) < 0)
+    {
+        cerr << "GridFile::store() can not size " << m_filename << ": " << strerror(errno) << endl;
+        close(fd);
+        return -1;
+    }
+
+    size_t off = 0;
+    while(off < m_bufferSize)
+    {
+        size_t len = min((size_t)IO_CHUNK_SIZE, m_bufferSize - off);
+        if(!m_stored && all_zero(m_buffer + off, len))
+        {
+            off += len;
+            continue;
+        }
+
+        ssize_t n = pwrite(fd, m_buffer + off, len, off);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            cerr << "GridFile::store() write error " << m_filename << ": " << strerror(errno) << endl;
+            close(fd);
+            return -1;
+        }
+        off += n;
+        m_bytesWritten += n;
+    }
+    close(fd);
+
+    m_stored = true;
+    m_ioSeconds += io_clock() - t0;
+    return 0;
+#else
+    return -1;
+#endif
+}
@@ -62,6 +62,8 @@ GridMap::GridMap(int id,
     m_upperBound = upper_bound;
     m_overlapLowerBound = overlap_lower_bound;
     m_overlapUpperBound = overlap_upper_bound;
+    m_leftBound = m_overlapLeftBound = 0;
+    m_rightBound = m_overlapRightBound = size_x - 1;
 
     m_gridFile = new GridFile(m_id, fname, size_x, m_overlapUpperBound - m_overlapLowerBound + 1);
     
@@ -69,6 +71,36 @@ GridMap::GridMap(int id,
         m_initialized = initialized;
 
 }
+
+GridMap::GridMap(int id,
+                 int lower_bound,
+                 int upper_bound,
+                 int overlap_lower_bound,
+                 int overlap_upper_bound,
+                 int left_bound,
+                 int right_bound,
+                 int overlap_left_bound,
+                 int overlap_right_bound,
+                 bool initialized,
+                 char *fname)
+{
+    m_id = id;
+    m_lowerBound = lower_bound;
+    m_upperBound = upper_bound;
+    m_overlapLowerBound = overlap_lower_bound;
+    m_overlapUpperBound = overlap_upper_bound;
+    m_leftBound = left_bound;
+    m_rightBound = right_bound;
+    m_overlapLeftBound = overlap_left_bound;
+    m_overlapRightBound = overlap_right_bound;
+
+    m_gridFile = new GridFile(m_id, fname,
+                              m_overlapRightBound - m_overlapLeftBound + 1,
+                              m_overlapUpperBound - m_overlapLowerBound + 1);
+
+    if (m_gridFile != 0)
+        m_initialized = initialized;
+}
 GridMap::~GridMap()
 {
     if(m_gridFile != 0)
@@ -91,6 +123,22 @@ int GridMap::getOverlapUpperBound()
 {
     return m_overlapUpperBound;
 }
+int GridMap::getLeftBound()
+{
+    return m_leftBound;
+}
+int GridMap::getRightBound()
+{
+    return m_rightBound;
+}
+int GridMap::getOverlapLeftBound()
+{
+    return m_overlapLeftBound;
+}
+int GridMap::getOverlapRightBound()
+{
+    return m_overlapRightBound;
+}
 
 bool GridMap::isInitialized()
 {
@@ -50,6 +50,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <points2grid/Global.hpp>
 #include <points2grid/GridPoint.hpp>
 #include <points2grid/InCoreInterp.hpp>
+#include <points2grid/Aligned.hpp>
 
 #include <time.h>
 #include <stdio.h>
@@ -57,11 +58,37 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <float.h>
 #include <math.h>
 
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 #ifdef HAVE_GDAL
 #include "gdal_priv.h"
 #include "ogr_spatialref.h"
 #endif
 
+// The band threads and the batch of points they are applying. Each batch
+// has a number; a band thread applies every batch once, in order.
+struct BandWorkers
+{
+    BandWorkers() : batch(0), busy(0), stop(false) {}
+
+    boost::thread_group threads;
+    boost::mutex mutex;
+    boost::condition_variable ready;
+    boost::condition_variable done;
+
+    unsigned long batch;
+    // bands still applying the current batch
+    int busy;
+    bool stop;
+
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+};
+
 InCoreInterp::InCoreInterp(double dist_x, double dist_y,
                            int size_x, int size_y,
                            double r_sqr,
@@ -84,94 +111,185 @@ InCoreInterp::InCoreInterp(double dist_x, double dist_y,
 
     window_size = _window_size;
 
+    update_fn = NULL;
+    kernels = NULL;
+    idw_int_power = -1;
+    halo_rows = 0;
+    band_workers = NULL;
+
+    tile_w = tile_h = 1;
+    tiles_x = tiles_y = 0;
+    sparse = false;
+    tile_error = false;
+    stats = 0;
+
     cerr << "InCoreInterp created successfully" << endl;
 }
 
 InCoreInterp::~InCoreInterp()
 {
-    for(int i = 0; i < GRID_SIZE_X; ++i){
-        free(interp[i]);
-    }
-    free(interp);
+    stop_bands();
+
+    for(size_t t = 0; t < tiles.size(); t++)
+        delete tiles[t];
+}
+
+template<int Index>
+InCoreInterp::UpdateFunction InCoreInterp::select_update(int index)
+{
+    static const unsigned int Stats =
+        ((Index & 0x01) ? OUTPUT_TYPE_MIN : 0) |
+        ((Index & 0x02) ? OUTPUT_TYPE_MAX : 0) |
+        ((Index & 0x04) ? OUTPUT_TYPE_MEAN : 0) |
+        ((Index & 0x08) ? OUTPUT_TYPE_IDW : 0) |
+        ((Index & 0x10) ? OUTPUT_TYPE_DEN : 0) |
+        ((Index & 0x20) ? OUTPUT_TYPE_STD : 0);
+
+    if(index == Index)
+        return &InCoreInterp::update_point<Stats>;
+    return select_update<Index - 1>(index);
+}
+
+// nothing requested is treated as everything, like GridCells::getStats()
+template<>
+InCoreInterp::UpdateFunction InCoreInterp::select_update<0>(int)
+{
+    return &InCoreInterp::update_point<OUTPUT_TYPE_ALL>;
 }
 
 int InCoreInterp::init()
 {
-    int i, j;
+    int i;
+
+    stats = GridCells::getStats(output_type);
 
-    interp = (GridPoint**)malloc(sizeof(GridPoint *) * GRID_SIZE_X);
-    //interp = new GridPoint*[GRID_SIZE_X];
-    if(interp == NULL)
+    if(sparse) {
+        tile_w = max(min(GRID_SIZE_X, SPARSE_TILE_SIZE), 1);
+        tile_h = max(min(GRID_SIZE_Y, SPARSE_TILE_SIZE), 1);
+    } else {
+        tile_w = max(GRID_SIZE_X, 1);
+        tile_h = max(GRID_SIZE_Y, 1);
+    }
+    tiles_x = (GRID_SIZE_X + tile_w - 1) / tile_w;
+    tiles_y = (GRID_SIZE_Y + tile_h - 1) / tile_h;
+    tiles.assign((size_t)tiles_x * tiles_y, (GridCells *)NULL);
+
+    if(!sparse && tiles.size() > 0 && touch_tile(0, 0) == NULL)
     {
         cerr << "InCoreInterp::init() new allocate error" << endl;
         return -1;
     }
 
-    for(i = 0; i < GRID_SIZE_X; i++)
+    if(sparse)
+        cerr << "InCoreInterp::init() using sparse tiles of " << tile_w << " x " << tile_h << " cells" << endl;
+
+    // pick the update kernel compiled for exactly the accumulated types
+    int index = 0;
+    for(i = 0; i < 6; i++)
+        if(stats & (1u << (4 * i)))
+            index |= 1 << i;
+    update_fn = select_update<63>(index);
+
+    stencil.init(GRID_DIST_X, GRID_DIST_Y, radius_sqr);
+    kernels = &getSpanKernels();
+    idw_int_power = integer_idw_power();
+
+    if(num_threads > 1)
     {
-        interp[i] = (GridPoint *)malloc(sizeof(GridPoint) * GRID_SIZE_Y);
-        //interp[i] = new GridPoint[GRID_SIZE_Y];
-        if(interp[i] == NULL)
-        {
-            cerr << "InCoreInterp::init() new allocate error" << endl;
-            return -1;
+        // one row band per thread; a point reaches at most halo_rows
+        // rows below and halo_rows + 1 rows above its own grid row
+        int num_bands = min(num_threads, GRID_SIZE_Y);
+        int band_rows = (int)ceil((double)GRID_SIZE_Y / num_bands);
+
+        // in sparse mode the bands are whole rows of tiles, so no two
+        // threads allocate the same tile
+        if(sparse) {
+            band_rows = (band_rows + tile_h - 1) / tile_h * tile_h;
+            num_bands = (GRID_SIZE_Y + band_rows - 1) / band_rows;
         }
-    }
 
-    for(i = 0; i < GRID_SIZE_X; i++)
-        for(j = 0; j < GRID_SIZE_Y; j++)
-        {
-            interp[i][j].Zmin = DBL_MAX;
-            interp[i][j].Zmax = -DBL_MAX;
-            interp[i][j].Zmean = 0;
-            interp[i][j].count = 0;
-            interp[i][j].Zidw = 0;
-            interp[i][j].sum = 0;
-            interp[i][j].Zstd = 0;
-            interp[i][j].Zstd_tmp = 0;
-            interp[i][j].empty = 0;
-            interp[i][j].filled = 0;
-        }
+        band_bound.resize(num_bands + 1);
+        for(i = 0; i <= num_bands; i++)
+            band_bound[i] = min(i * band_rows, GRID_SIZE_Y);
+
+        halo_rows = (int)ceil(sqrt(radius_sqr) / GRID_DIST_Y);
+        band_points.resize(num_bands);
+
+        pending_x.reserve(BATCH_SIZE);
+        pending_y.reserve(BATCH_SIZE);
+        pending_z.reserve(BATCH_SIZE);
+
+        stop_bands();
+        band_workers = new BandWorkers;
+        band_workers->x.reserve(BATCH_SIZE);
+        band_workers->y.reserve(BATCH_SIZE);
+        band_workers->z.reserve(BATCH_SIZE);
+        for(i = 0; i < num_bands; i++)
+            band_workers->threads.create_thread(boost::bind(&InCoreInterp::band_worker, this, i));
+
+        cerr << "InCoreInterp::init() using " << num_bands << " row bands of " << band_rows << " rows" << endl;
+    }
 
     cerr << "InCoreInterp::init() done" << endl;
 
     return 0;
 }
 
+double InCoreInterp::memory_required(int size_x, int size_y, unsigned int type, int threads)
+{
+    double bytes = (double)size_x * size_y * GridCells::getCellSize(type);
+
+    // the pending points and the batch the bands are applying, and its
+    // indices in the list of each band they reach, which for most points is
+    // one or two bands
+    if(threads > 1)
+        bytes += (double)BATCH_SIZE * (6 * sizeof(double) + 2 * sizeof(unsigned int));
+
+    return bytes;
+}
+
 int InCoreInterp::update(double data_x, double data_y, double data_z)
 {
-    double x;
-    double y;
+    return update_batch(&data_x, &data_y, &data_z, 1);
+}
 
+int InCoreInterp::update_batch(const double *data_x, const double *data_y, const double *data_z, size_t n)
+{
     int lower_grid_x;
     int lower_grid_y;
 
-    //cerr << GRID_DIST_X << " " << GRID_DIST_Y;
-    lower_grid_x = (int)floor((double)data_x/GRID_DIST_X);
-    lower_grid_y = (int)floor((double)data_y/GRID_DIST_Y);
-
-    if(lower_grid_x > GRID_SIZE_X || lower_grid_y > GRID_SIZE_Y)
+    for(size_t i = 0; i < n; i++)
     {
-        cerr << "larger at (" << lower_grid_x << "," << lower_grid_y << "): ("<< data_x << ", " << data_y << ")" << endl;
-        return 0;
-    }
+        lower_grid_x = (int)floor((double)data_x[i]/GRID_DIST_X);
+        lower_grid_y = (int)floor((double)data_y[i]/GRID_DIST_Y);
 
-    //printf("lower_grid_x: %d, grid_y: %d, arrX: %.2f, arrY: %.2f\n", lower_grid_x, lower_grid_y, arrX[i], arrY[i]);
-    x = (data_x - (lower_grid_x) * GRID_DIST_X);
-    y = (data_y - (lower_grid_y) * GRID_DIST_Y);
+        if(lower_grid_x > GRID_SIZE_X || lower_grid_y > GRID_SIZE_Y)
+        {
+            cerr << "larger at (" << lower_grid_x << "," << lower_grid_y << "): ("<< data_x[i] << ", " << data_y[i] << ")" << endl;
+            continue;
+        }
 
-    //cerr << "(" << data_x << " " << data_y << ")=(" << lower_grid_x << ", " << lower_grid_y << "): ";
-    //printf("(%f %f) = (%d, %d): ", data_x, data_y, lower_grid_x, lower_grid_y);
+        if(band_points.empty())
+        {
+            (this->*update_fn)(data_x[i], data_y[i], data_z[i], 0, GRID_SIZE_Y, cover);
+            continue;
+        }
+
+        pending_x.push_back(data_x[i]);
+        pending_y.push_back(data_y[i]);
+        pending_z.push_back(data_z[i]);
 
-    //if(lower_grid_y == 30 && data_y > GRID_DIST_Y * lower_grid_y)
-    //printf("(%f %f) = (%d, %d)\n", data_x, data_y, lower_grid_x, lower_grid_y);
+        if(pending_x.size() == BATCH_SIZE)
+            flush_pending();
+    }
 
-    update_first_quadrant(data_z, lower_grid_x+1, lower_grid_y+1, GRID_DIST_X - x, GRID_DIST_Y - y);
-    update_second_quadrant(data_z, lower_grid_x, lower_grid_y+1, x, GRID_DIST_Y - y);
-    update_third_quadrant(data_z, lower_grid_x, lower_grid_y, x, y);
-    update_fourth_quadrant(data_z, lower_grid_x+1, lower_grid_y, GRID_DIST_X - x, y);
+    // a sparse tile could not be allocated
+    if(tile_error)
+    {
+        cerr << "InCoreInterp::update() tile allocation error" << endl;
+        return -1;
+    }
 
-    //cerr << "test" << endl;
     return 0;
 }
 
@@ -187,8 +305,20 @@ int InCoreInterp::finish(const std::string& outputName, int outputFormat, unsign
     //struct tms tbuf;
     clock_t t0, t1;
 
+    if((outputType & OUTPUT_TYPE_ALL) & ~stats)
+    {
+        cerr << "InCoreInterp::finish output type was not accumulated, see setOutputType()" << endl;
+        return -1;
+    }
+
     calculate_grid_values();
 
+    if(tile_error)
+    {
+        cerr << "InCoreInterp::finish tile allocation error" << endl;
+        return -1;
+    }
+
     t0 = clock();
 
     if((rc = outputFile(outputName, outputFormat, outputType, adfGeoTransform, wkt)) < 0)
@@ -208,92 +338,60 @@ int InCoreInterp::finish(const std::string& outputName, int outputFormat, unsign
 
 void InCoreInterp::calculate_grid_values()
 {
-    for(int i = 0; i < GRID_SIZE_X; i++)
-        for(int j = 0; j < GRID_SIZE_Y; j++)
-        {
-            if(interp[i][j].Zmin == DBL_MAX) {
-                //		interp[i][j].Zmin = NAN;
-                interp[i][j].Zmin = 0;
-            }
-
-            if(interp[i][j].Zmax == -DBL_MAX) {
-                //interp[i][j].Zmax = NAN;
-                interp[i][j].Zmax = 0;
-            }
-
-            if(interp[i][j].count != 0) {
-                interp[i][j].Zmean /= interp[i][j].count;
-                interp[i][j].empty = 1;
-            } else {
-                //interp[i][j].Zmean = NAN;
-                interp[i][j].Zmean = 0;
-            }
-
-	    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
-            if(interp[i][j].count != 0) {
-  	        interp[i][j].Zstd = interp[i][j].Zstd / (interp[i][j].count);
-		interp[i][j].Zstd = sqrt(interp[i][j].Zstd);
-	    } else {
-                interp[i][j].Zstd = 0;
-            }
+    int tx, ty;
 
+    if(!band_points.empty())
+    {
+        flush_pending();
+        wait_bands();
+    }
 
-            if(interp[i][j].sum != 0 && interp[i][j].sum != -1)
-                interp[i][j].Zidw /= interp[i][j].sum;
-            else if (interp[i][j].sum == -1) {
-                // do nothing
-            } else {
-                //interp[i][j].Zidw = NAN;
-                interp[i][j].Zidw = 0;
-            }
-        }
+    for(size_t t = 0; t < tiles.size(); t++)
+        if(tiles[t] != NULL)
+            finalize_tile(*tiles[t]);
 
     // Sriram's edit: Fill zeros using the window size parameter
     if (window_size != 0) {
-        int window_dist = window_size / 2;
-        for (int i = 0; i < GRID_SIZE_X; i++)
-            for (int j = 0; j < GRID_SIZE_Y; j++)
+        // an absent tile with data within the window of its cells gets
+        // filled cells, so it is allocated, empty
+        for(ty = 0; ty < tiles_y; ty++)
+            for(tx = 0; tx < tiles_x; tx++)
             {
-                if (interp[i][j].empty == 0) {
-                    double new_sum=0.0;
-                    for (int p = i - window_dist; p <= i + window_dist; p++) {
-                        for (int q = j - window_dist; q <= j + window_dist; q++) {
-                            if ((p >= 0) && (p < GRID_SIZE_X) && (q >=0) && (q < GRID_SIZE_Y)) {
-                                if ((p == i) && (q == j))
-                                    continue;
-
-                                if (interp[p][q].empty != 0) {
-                                    double distance = max(abs(p-i), abs(q-j));
-                                    interp[i][j].Zmean += interp[p][q].Zmean/(pow(distance,Interpolation::WEIGHTER));
-                                    interp[i][j].Zidw += interp[p][q].Zidw/(pow(distance,Interpolation::WEIGHTER));
-				    interp[i][j].Zstd += interp[p][q].Zstd/(pow(distance,Interpolation::WEIGHTER));
-				    interp[i][j].Zstd_tmp += interp[p][q].Zstd_tmp/(pow(distance,Interpolation::WEIGHTER));
-                                    interp[i][j].Zmin += interp[p][q].Zmin/(pow(distance,Interpolation::WEIGHTER));
-                                    interp[i][j].Zmax += interp[p][q].Zmax/(pow(distance,Interpolation::WEIGHTER));
-
-                                    new_sum += 1/(pow(distance,Interpolation::WEIGHTER));
-                                }
-                            }
-                        }
-                    }
-                    if (new_sum > 0) {
-                        interp[i][j].Zmean /= new_sum;
-                        interp[i][j].Zidw /= new_sum;
-                        interp[i][j].Zstd /= new_sum;
-                        interp[i][j].Zstd_tmp /= new_sum;
-                        interp[i][j].Zmin /= new_sum;
-                        interp[i][j].Zmax /= new_sum;
-                        interp[i][j].filled = 1;
-                    }
-                }
+                if(tiles[(size_t)ty * tiles_x + tx] == NULL && data_near_tile(tx, ty, window_size / 2)
+                   && touch_tile(tx, ty) == NULL)
+                    return;
             }
+
+        for(ty = 0; ty < tiles_y; ty++)
+            for(tx = 0; tx < tiles_x; tx++)
+                if(tiles[(size_t)ty * tiles_x + tx] != NULL)
+                    fill_tile(tx, ty);
     }
 }
 
 
-const GridPoint& InCoreInterp::get_grid_point(int i, int j)
+GridPoint InCoreInterp::get_grid_point(int i, int j)
+{
+    GridCells *t = tile_at(i, j);
+
+    if(t == NULL)
+    {
+        GridPoint gp = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        return gp;
+    }
+
+    return t->getGridPoint(tile_index(i, j));
+}
+
+size_t InCoreInterp::getNumTiles() const
 {
-    return interp[i][j];
+    size_t n = 0;
+
+    for(size_t t = 0; t < tiles.size(); t++)
+        if(tiles[t] != NULL)
+            n++;
+
+    return n;
 }
 
 
@@ -301,161 +399,338 @@ const GridPoint& InCoreInterp::get_grid_point(int i, int j)
 // Private Methods
 //////////////////////////////////////////////////////
 
-void InCoreInterp::update_first_quadrant(double data_z, int base_x, int base_y, double x, double y)
+// the tile at tile column tx and tile row ty, allocated, empty, if no
+// point has reached it yet. NULL and tile_error set if allocation fails.
+GridCells *InCoreInterp::touch_tile(int tx, int ty)
 {
-    int i;
-    int j;
-    //double temp;
+    GridCells *&tile = tiles[(size_t)ty * tiles_x + tx];
 
-    //printf("radius: %f ", radius_sqrt);
-
-    for(i = base_x; i < GRID_SIZE_X; i++)
+    if(tile == NULL)
     {
-        for(j = base_y; j < GRID_SIZE_Y; j++)
+        GridCells *t = new GridCells();
+
+        if(t->allocate((size_t)tile_w * tile_h, output_type) < 0)
         {
-            /*
-              temp = (   ((i - base_x)*GRID_DIST + x) * ((i - base_x)*GRID_DIST + x) +
-              ((j - base_y)*GRID_DIST + y) * ((j - base_y)*GRID_DIST + y)) ;
-              printf("%f ", temp);
-            */
+            delete t;
+            tile_error = true;
+            return NULL;
+        }
+        tile = t;
+    }
 
-            double distance = 	((i - base_x)*GRID_DIST_X + x) * ((i - base_x)*GRID_DIST_X + x) +
-                                ((j - base_y)*GRID_DIST_Y + y) * ((j - base_y)*GRID_DIST_Y + y) ;
+    return tile;
+}
 
-            if(distance <= radius_sqr)
-            {
-                //printf("(%d %d) ", i, j);
-                //interp[i][j]++;
+void InCoreInterp::finalize_tile(GridCells& t)
+{
+    size_t k;
+    size_t num_cells = t.size;
+
+    // a cell has data once any point reached it; only an IDW grid keeps
+    // no count. The min and max of an empty cell are still zero.
+    if(t.count != NULL) {
+        for(k = 0; k < num_cells; k++)
+            t.flags[k] = t.count[k] != 0 ? CELL_HAS_DATA : 0;
+    } else {
+        for(k = 0; k < num_cells; k++)
+            t.flags[k] = t.sum[k] != 0 ? CELL_HAS_DATA : 0;
+    }
 
-                // update GridPoint
-                updateGridPoint(i, j, data_z, sqrt(distance));
+    if(t.Zmean != NULL)
+        for(k = 0; k < num_cells; k++)
+        {
+            if(t.count[k] != 0) {
+                t.Zmean[k] /= t.count[k];
+            } else {
+                //Zmean = NAN;
+                t.Zmean[k] = 0;
+            }
+        }
 
-            } else if(j == base_y) {
-                //printf("return ");
-                return;
+    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
+    if(t.Zstd != NULL)
+        for(k = 0; k < num_cells; k++)
+        {
+            if(t.count[k] != 0) {
+                t.Zstd[k] = t.Zstd[k] / (t.count[k]);
+                t.Zstd[k] = sqrt(t.Zstd[k]);
             } else {
-                //printf("break ");
-                break;
+                t.Zstd[k] = 0;
             }
         }
-    }
 
-    //cerr << "test2" << endl;
-}
+    if(t.Zidw != NULL)
+        for(k = 0; k < num_cells; k++)
+        {
+            double sum = t.sum[k];
 
+            if(sum != 0 && sum != -1)
+                t.Zidw[k] /= sum;
+            else if (sum == -1) {
+                // do nothing
+            } else {
+                //Zidw = NAN;
+                t.Zidw[k] = 0;
+            }
+        }
+}
 
-void InCoreInterp::update_second_quadrant(double data_z, int base_x, int base_y, double x, double y)
+// whether a cell with data lies within dist cells of the absent tile at
+// tile column tx and tile row ty
+bool InCoreInterp::data_near_tile(int tx, int ty, int dist) const
 {
-    int i;
-    int j;
+    int x0 = tx * tile_w;
+    int y0 = ty * tile_h;
+    int x1 = min(x0 + tile_w, GRID_SIZE_X);
+    int y1 = min(y0 + tile_h, GRID_SIZE_Y);
 
-    for(i = base_x; i >= 0; i--)
-    {
-        for(j = base_y; j < GRID_SIZE_Y; j++)
+    for(int q = max(y0 - dist, 0); q < min(y1 + dist, GRID_SIZE_Y); q++)
+        for(int p = max(x0 - dist, 0); p < min(x1 + dist, GRID_SIZE_X); p++)
         {
-            double distance = 	((base_x - i)*GRID_DIST_X + x) * ((base_x - i)*GRID_DIST_X + x) +
-                                ((j - base_y)*GRID_DIST_Y + y) * ((j - base_y)*GRID_DIST_Y + y);
+            // the tile itself has no cells
+            if(q >= y0 && q < y1 && p == x0)
+                p = x1;
+            if(p >= min(x1 + dist, GRID_SIZE_X))
+                break;
 
-            if(distance <= radius_sqr)
-            {
-                //printf("(%d %d) ", i, j);
-                //interp[i][j]++;
+            const GridCells *t = tile_at(p, q);
+            if(t != NULL && (t->flags[tile_index(p, q)] & CELL_HAS_DATA))
+                return true;
+        }
 
-                updateGridPoint(i, j, data_z, sqrt(distance));
+    return false;
+}
 
-            } else if(j == base_y) {
-                return;
-            } else {
-                break;
+// only empty cells are written and only non-empty cells are read, so the
+// cells and tiles can be visited in storage order
+void InCoreInterp::fill_tile(int tx, int ty)
+{
+    // the value arrays that get blended; count and sum are not
+    static double *GridCells::*const fields[6] = {&GridCells::Zmean, &GridCells::Zidw, &GridCells::Zstd,
+                                                  &GridCells::Zstd_tmp, &GridCells::Zmin, &GridCells::Zmax};
+    double *GridCells::*values[6];
+    GridCells *t = tiles[(size_t)ty * tiles_x + tx];
+    int num_values = 0;
+
+    for (int v = 0; v < 6; v++)
+        if (t->*fields[v] != NULL)
+            values[num_values++] = fields[v];
+
+    int window_dist = window_size / 2;
+    int x0 = tx * tile_w;
+    int y0 = ty * tile_h;
+    int x1 = min(x0 + tile_w, GRID_SIZE_X);
+    int y1 = min(y0 + tile_h, GRID_SIZE_Y);
+
+    for (int j = y0; j < y1; j++)
+        for (int i = x0; i < x1; i++)
+        {
+            size_t c = (size_t)(j - y0) * tile_w + (i - x0);
+
+            if ((t->flags[c] & CELL_HAS_DATA) == 0) {
+                // the window clipped to the grid, which mostly lies in this tile
+                bool inside = max(i - window_dist, 0) >= x0 && min(i + window_dist, GRID_SIZE_X - 1) < x1 &&
+                              max(j - window_dist, 0) >= y0 && min(j + window_dist, GRID_SIZE_Y - 1) < y1;
+                double new_sum=0.0;
+                for (int p = i - window_dist; p <= i + window_dist; p++) {
+                    for (int q = j - window_dist; q <= j + window_dist; q++) {
+                        if ((p >= 0) && (p < GRID_SIZE_X) && (q >=0) && (q < GRID_SIZE_Y)) {
+                            if ((p == i) && (q == j))
+                                continue;
+
+                            GridCells *nt = t;
+                            size_t n;
+                            if (inside)
+                                n = (size_t)(q - y0) * tile_w + (p - x0);
+                            else if ((nt = tile_at(p, q)) != NULL)
+                                n = tile_index(p, q);
+                            else
+                                continue;
+
+                            if (nt->flags[n] & CELL_HAS_DATA) {
+                                double distance = max(abs(p-i), abs(q-j));
+                                for (int v = 0; v < num_values; v++)
+                                    (t->*values[v])[c] += (nt->*values[v])[n]/(pow(distance,Interpolation::WEIGHTER));
+
+                                new_sum += 1/(pow(distance,Interpolation::WEIGHTER));
+                            }
+                        }
+                    }
+                }
+                if (new_sum > 0) {
+                    for (int v = 0; v < num_values; v++)
+                        (t->*values[v])[c] /= new_sum;
+                    t->flags[c] |= CELL_FILLED;
+                }
             }
         }
-    }
-
 }
 
-
-void InCoreInterp::update_third_quadrant(double data_z, int base_x, int base_y, double x, double y)
+// update every cell within the search radius of a point, restricted to the
+// grid rows in [row_lo, row_hi)
+template<unsigned int Stats>
+void InCoreInterp::update_point(double data_x, double data_y, double data_z, int row_lo, int row_hi, StencilCover& cover)
 {
-    int i;
-    int j;
+    stencil.cover(data_x, data_y, 0, GRID_SIZE_X, row_lo, row_hi, cover);
 
-    for(i = base_x; i >= 0; i--)
+    for(int s = 0; s < cover.num_spans; s++)
     {
-        for(j = base_y; j >= 0; j--)
+        const StencilSpan& span = cover.spans[s];
+        int ty = span.row / tile_h;
+
+        // the piece of the span in each tile it crosses
+        for(int first = span.first; first <= span.last; )
         {
-            double distance = 	((base_x - i)*GRID_DIST_X + x) * ((base_x - i)*GRID_DIST_X + x) +
-                                ((base_y - j)*GRID_DIST_Y + y) * ((base_y - j)*GRID_DIST_Y + y);
+            int tx = first / tile_w;
+            int last = min(span.last, (tx + 1) * tile_w - 1);
+            int n = last - first + 1;
+            GridCells *t = touch_tile(tx, ty);
 
-            if(distance <= radius_sqr)
-            {
-                //if(j == 30)
-                //printf("(%d %d)\n", i, j);
-                //interp[i][j]++;
-                updateGridPoint(i, j, data_z, sqrt(distance));
-            } else if(j == base_y) {
+            if(t == NULL)
                 return;
-            } else {
-                break;
+
+            size_t k = (size_t)(span.row - ty * tile_h) * tile_w + (first - tx * tile_w);
+
+            // Stats is a compile-time constant, so only the accumulators of the
+            // requested output types are touched
+            if(Stats & OUTPUT_TYPE_MIN)
+                kernels->min(t->Zmin + k, t->count + k, n, data_z);
+            if(Stats & OUTPUT_TYPE_MAX)
+                kernels->max(t->Zmax + k, t->count + k, n, data_z);
+            if(Stats & COUNTED_OUTPUT_TYPES)
+                kernels->count(t->count + k, n);
+            if(Stats & OUTPUT_TYPE_MEAN)
+                kernels->mean(t->Zmean + k, n, data_z);
+            if(Stats & OUTPUT_TYPE_STD)
+                kernels->std(t->Zstd + k, t->Zstd_tmp + k, t->count + k, n, data_z);
+            if(Stats & OUTPUT_TYPE_IDW)
+            {
+                const double *dx2 = &cover.dx2[first - cover.first_col];
+
+                if(idw_int_power >= 0)
+                    kernels->idw(t->Zidw + k, t->sum + k, dx2, span.dy2, n, data_z, idw_int_power);
+                else
+                    span_idw_pow(t->Zidw + k, t->sum + k, dx2, span.dy2, n, data_z, idw_power);
             }
+
+            first = last + 1;
         }
     }
 }
 
-void InCoreInterp::update_fourth_quadrant(double data_z, int base_x, int base_y, double x, double y)
+// hand the buffered points to the band threads, once they are done with the
+// previous batch, and route each to every band its search radius reaches.
+// Bands never share a row, so no locking is needed, and each band sees its
+// points in input order.
+void InCoreInterp::flush_pending()
 {
-    int i, j;
+    size_t i;
+    int b;
+    int num_bands = (int)band_points.size();
+    int band_rows = band_bound[1];
 
-    for(i = base_x; i < GRID_SIZE_X; i++)
+    if(pending_x.empty())
+        return;
+
+    wait_bands();
+
+    band_workers->x.swap(pending_x);
+    band_workers->y.swap(pending_y);
+    band_workers->z.swap(pending_z);
+    pending_x.clear();
+    pending_y.clear();
+    pending_z.clear();
+
+    const std::vector<double>& y = band_workers->y;
+
+    for(b = 0; b < num_bands; b++)
+        band_points[b].clear();
+
+    for(i = 0; i < y.size(); i++)
     {
-        for(j = base_y; j >= 0; j--)
-        {
-            double distance = 	((i - base_x)*GRID_DIST_X + x) * ((i - base_x)*GRID_DIST_X + x) +
-                                ((base_y - j)*GRID_DIST_Y + y) * ((base_y - j)*GRID_DIST_Y + y);
+        int lower_grid_y = (int)floor(y[i]/GRID_DIST_Y);
+        int first_row = lower_grid_y - halo_rows;
+        int last_row = lower_grid_y + halo_rows + 1;
 
-            if(distance <= radius_sqr)
-            {
-                //printf("(%d %d) ", i, j);
-                //interp[i][j]++;
-                updateGridPoint(i, j, data_z, sqrt(distance));
-            } else if (j == base_y) {
-                return ;
-            } else {
-                break;
-            }
-        }
+        if(last_row < 0 || first_row >= GRID_SIZE_Y)
+            continue;
+
+        int first_band = first_row < 0 ? 0 : first_row / band_rows;
+        int last_band = last_row >= GRID_SIZE_Y ? num_bands - 1 : last_row / band_rows;
+
+        for(b = first_band; b <= last_band; b++)
+            band_points[b].push_back((unsigned int)i);
     }
+
+    boost::mutex::scoped_lock lock(band_workers->mutex);
+    band_workers->batch++;
+    band_workers->busy = num_bands;
+    band_workers->ready.notify_all();
 }
 
-void InCoreInterp::updateGridPoint(int x, int y, double data_z, double distance)
+// wait until the band threads have applied the batch handed to them
+void InCoreInterp::wait_bands()
 {
-    // Add checks for invalid indices that result from user-defined grids
-    if (x >= GRID_SIZE_X || x < 0 || y >= GRID_SIZE_Y || y < 0) return;
+    if(band_workers == NULL)
+        return;
 
-    if(interp[x][y].Zmin > data_z)
-        interp[x][y].Zmin = data_z;
-    if(interp[x][y].Zmax < data_z)
-        interp[x][y].Zmax = data_z;
+    boost::mutex::scoped_lock lock(band_workers->mutex);
+    while(band_workers->busy > 0)
+        band_workers->done.wait(lock);
+}
 
-    interp[x][y].Zmean += data_z;
-    interp[x][y].count++;
+void InCoreInterp::stop_bands()
+{
+    if(band_workers == NULL)
+        return;
 
-    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
-    double delta = data_z - interp[x][y].Zstd_tmp;
-    interp[x][y].Zstd_tmp += delta/interp[x][y].count;
-    interp[x][y].Zstd += delta * (data_z - interp[x][y].Zstd_tmp);
-
-    double dist = pow(distance, Interpolation::WEIGHTER);
-
-    if(interp[x][y].sum != -1) {
-        if(dist != 0) {
-            interp[x][y].Zidw += data_z/dist;
-            interp[x][y].sum += 1/dist;
-        } else {
-            interp[x][y].Zidw = data_z;
-            interp[x][y].sum = -1;
+    wait_bands();
+    {
+        boost::mutex::scoped_lock lock(band_workers->mutex);
+        band_workers->stop = true;
+        band_workers->ready.notify_all();
+    }
+    band_workers->threads.join_all();
+
+    delete band_workers;
+    band_workers = NULL;
+}
+
+void InCoreInterp::band_worker(int band)
+{
+    unsigned long applied = 0;
+
+    for(;;)
+    {
+        {
+            boost::mutex::scoped_lock lock(band_workers->mutex);
+            while(!band_workers->stop && band_workers->batch == applied)
+                band_workers->ready.wait(lock);
+            if(band_workers->stop)
+                return;
+            applied = band_workers->batch;
         }
-    } else {
-        // do nothing
+
+        update_band(band);
+
+        boost::mutex::scoped_lock lock(band_workers->mutex);
+        if(--band_workers->busy == 0)
+            band_workers->done.notify_all();
+    }
+}
+
+void InCoreInterp::update_band(int band)
+{
+    const std::vector<unsigned int>& points = band_points[band];
+    const std::vector<double>& x = band_workers->x;
+    const std::vector<double>& y = band_workers->y;
+    const std::vector<double>& z = band_workers->z;
+    StencilCover band_cover;
+
+    for(size_t i = 0; i < points.size(); i++)
+    {
+        unsigned int p = points[i];
+        (this->*update_fn)(x[p], y[p], z[p], band_bound[band], band_bound[band + 1], band_cover);
     }
 }
 
@@ -467,9 +742,10 @@ void InCoreInterp::printArray()
     {
         for(j = 1; j < GRID_SIZE_Y; j++)
         {
-            cerr << interp[i][j].Zmin << ", " << interp[i][j].Zmax << ", ";
-            cerr << interp[i][j].Zmean << ", " << interp[i][j].Zidw << endl;
-            //printf("%.20f ", interp[i][j].Zmax);
+            GridPoint gp = get_grid_point(i, j);
+            cerr << gp.Zmin << ", " << gp.Zmax << ", ";
+            cerr << gp.Zmean << ", " << gp.Zidw << endl;
+            //printf("%.20f ", gp.Zmax);
         }
         //printf("\n");
     }
@@ -589,68 +865,74 @@ int InCoreInterp::outputFile(const std::string& outputName, int outputFormat, un
     // print data
     for(i = GRID_SIZE_Y - 1; i >= 0; i--)
     {
+        const GridCells *t = NULL;
+        size_t c = 0;
+
         for(j = 0; j < GRID_SIZE_X; j++)
         {
+            // an absent tile is all NODATA
+            if(j % tile_w == 0) {
+                t = tile_at(j, i);
+                c = tile_index(j, i);
+            } else
+                c++;
+
+            unsigned char flags = t != NULL ? t->flags[c] : 0;
+
             if(arcFiles != NULL)
             {
                 // Zmin
                 if(arcFiles[0] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(arcFiles[0], "-9999 ");
                     else
-                        fprintf(arcFiles[0], "%f ", interp[j][i].Zmin);
+                        fprintf(arcFiles[0], "%f ", t->Zmin[c]);
                 }
 
                 // Zmax
                 if(arcFiles[1] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(arcFiles[1], "-9999 ");
                     else
-                        fprintf(arcFiles[1], "%f ", interp[j][i].Zmax);
+                        fprintf(arcFiles[1], "%f ", t->Zmax[c]);
                 }
 
                 // Zmean
                 if(arcFiles[2] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(arcFiles[2], "-9999 ");
                     else
-                        fprintf(arcFiles[2], "%f ", interp[j][i].Zmean);
+                        fprintf(arcFiles[2], "%f ", t->Zmean[c]);
                 }
 
                 // Zidw
                 if(arcFiles[3] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(arcFiles[3], "-9999 ");
                     else
-                        fprintf(arcFiles[3], "%f ", interp[j][i].Zidw);
+                        fprintf(arcFiles[3], "%f ", t->Zidw[c]);
                 }
 
                 // count
                 if(arcFiles[4] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(arcFiles[4], "-9999 ");
                     else
-                        fprintf(arcFiles[4], "%d ", interp[j][i].count);
+                        fprintf(arcFiles[4], "%d ", t->count[c]);
                 }
 
 		// count
                 if(arcFiles[5] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(arcFiles[5], "-9999 ");
                     else
-                        fprintf(arcFiles[5], "%f ", interp[j][i].Zstd);
+                        fprintf(arcFiles[5], "%f ", t->Zstd[c]);
                 }
 	    }
 
@@ -659,61 +941,55 @@ int InCoreInterp::outputFile(const std::string& outputName, int outputFormat, un
                 // Zmin
                 if(gridFiles[0] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(gridFiles[0], "-9999 ");
                     else
-                        fprintf(gridFiles[0], "%f ", interp[j][i].Zmin);
+                        fprintf(gridFiles[0], "%f ", t->Zmin[c]);
                 }
 
                 // Zmax
                 if(gridFiles[1] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(gridFiles[1], "-9999 ");
                     else
-                        fprintf(gridFiles[1], "%f ", interp[j][i].Zmax);
+                        fprintf(gridFiles[1], "%f ", t->Zmax[c]);
                 }
 
                 // Zmean
                 if(gridFiles[2] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(gridFiles[2], "-9999 ");
                     else
-                        fprintf(gridFiles[2], "%f ", interp[j][i].Zmean);
+                        fprintf(gridFiles[2], "%f ", t->Zmean[c]);
                 }
 
                 // Zidw
                 if(gridFiles[3] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(gridFiles[3], "-9999 ");
                     else
-                        fprintf(gridFiles[3], "%f ", interp[j][i].Zidw);
+                        fprintf(gridFiles[3], "%f ", t->Zidw[c]);
                 }
 
                 // count
                 if(gridFiles[4] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(gridFiles[4], "-9999 ");
                     else
-                        fprintf(gridFiles[4], "%d ", interp[j][i].count);
+                        fprintf(gridFiles[4], "%d ", t->count[c]);
 		}
 
                 // count
                 if(gridFiles[5] != NULL)
                 {
-                    if(interp[j][i].empty == 0 &&
-                            interp[j][i].filled == 0)
+                    if(flags == 0)
                         fprintf(gridFiles[5], "-9999 ");
                     else
-                        fprintf(gridFiles[5], "%f ", interp[j][i].Zstd);
+                        fprintf(gridFiles[5], "%f ", t->Zstd[c]);
                 }
             }
         }
@@ -811,39 +1087,49 @@ int InCoreInterp::outputFile(const std::string& outputName, int outputFormat, un
 
                 for(j = GRID_SIZE_Y - 1; j >= 0; j--)
                 {
+                    const GridCells *t = NULL;
+                    size_t c = 0;
+
                     for(k = 0; k < GRID_SIZE_X; k++)
                     {
                         int index = (GRID_SIZE_Y - 1 - j) * GRID_SIZE_X + k;
 
-                        if(interp[k][j].empty == 0 &&
-                                interp[k][j].filled == 0)
+                        if(k % tile_w == 0) {
+                            t = tile_at(k, j);
+                            c = tile_index(k, j);
+                        } else
+                            c++;
+
+                        unsigned char flags = t != NULL ? t->flags[c] : 0;
+
+                        if(flags == 0)
                         {
                             poRasterData[index] = -9999.f;
                         } else {
                             switch (i)
                             {
                                 case 0:
-                                    poRasterData[index] = interp[k][j].Zmin;
+                                    poRasterData[index] = t->Zmin[c];
                                     break;
 
                                 case 1:
-                                    poRasterData[index] = interp[k][j].Zmax;
+                                    poRasterData[index] = t->Zmax[c];
                                     break;
 
                                 case 2:
-                                    poRasterData[index] = interp[k][j].Zmean;
+                                    poRasterData[index] = t->Zmean[c];
                                     break;
 
                                 case 3:
-                                    poRasterData[index] = interp[k][j].Zidw;
+                                    poRasterData[index] = t->Zidw[c];
                                     break;
 
                                 case 4:
-                                    poRasterData[index] = interp[k][j].count;
+                                    poRasterData[index] = t->count[c];
                                     break;
 
                                 case 5:
-                                    poRasterData[index] = interp[k][j].Zstd;
+                                    poRasterData[index] = t->Zstd[c];
                                     break;
                             }
                         }
@@ -0,0 +1,215 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <points2grid/config.h>
+#include <points2grid/InputFiles.hpp>
+
+#include <ctype.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+// the end of the bracket expression pattern starts, and whether c is in
+// it: a set of characters and ranges like "a-z", negated by a leading '!'
+static const char *match_bracket(const char *pattern, char c, bool& matched)
+{
+    const char *p = pattern + 1;
+    bool negate = *p == '!';
+    if(negate)
+        p++;
+
+    // nothing after the '[': it is an ordinary character
+    if(*p == '\0')
+    {
+        matched = c == '[';
+        return pattern + 1;
+    }
+
+    matched = false;
+    do {
+        if(p[1] == '-' && p[2] != '\0' && p[2] != ']')
+        {
+            if(p[0] <= c && c <= p[2])
+                matched = true;
+            p += 3;
+        } else {
+            if(*p == c)
+                matched = true;
+            p++;
+        }
+    } while(*p != ']' && *p != '\0');
+
+    if(*p == '\0')
+    {
+        // no closing bracket: the '[' is an ordinary character
+        matched = c == '[';
+        return pattern + 1;
+    }
+
+    matched = matched != negate;
+    return p + 1;
+}
+
+// '*' matches any run of characters, '?' any one character, and a
+// bracket expression one of a set of characters
+static bool wildcard_match(const char *pattern, const char *name)
+{
+    if(*pattern == '\0')
+        return *name == '\0';
+    if(*pattern == '*')
+        return wildcard_match(pattern + 1, name) || (*name != '\0' && wildcard_match(pattern, name + 1));
+    if(*name == '\0')
+        return false;
+    if(*pattern == '[')
+    {
+        bool matched;
+        const char *next = match_bracket(pattern, *name, matched);
+        return matched && wildcard_match(next, name + 1);
+    }
+    return (*pattern == '?' || *pattern == *name) && wildcard_match(pattern + 1, name + 1);
+}
+
+static bool is_las_name(const std::string& name)
+{
+    if(name.size() < 4)
+        return false;
+
+    std::string ext = name.substr(name.size() - 4);
+    for(size_t i = 0; i < ext.size(); i++)
+        ext[i] = (char)tolower((unsigned char)ext[i]);
+    return ext == ".las";
+}
+
+// the regular files of dir whose name matches pattern, or that are LAS
+// files when pattern is empty
+static int list_directory(const fs::path& dir, const std::string& pattern, std::vector<std::string>& files)
+{
+    std::vector<std::string> found;
+
+    try {
+        for(fs::directory_iterator it(dir), end; it != end; ++it)
+        {
+            if(!fs::is_regular_file(it->status()))
+                continue;
+
+            std::string name = it->path().filename().string();
+            if(pattern.empty() ? is_las_name(name) : wildcard_match(pattern.c_str(), name.c_str()))
+                found.push_back(it->path().string());
+        }
+    }
+    catch(std::exception& e) {
+        cerr << "expand_input_files() " << e.what() << endl;
+        return -1;
+    }
+
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+    return (int)found.size();
+}
+
+int expand_input_files(const std::vector<std::string>& specs, std::vector<std::string>& files)
+{
+    files.clear();
+
+    for(size_t i = 0; i < specs.size(); i++)
+    {
+        fs::path spec(specs[i]);
+        std::string last = spec.filename().string();
+        int n;
+
+        if(last.find_first_of("*?[") != std::string::npos)
+        {
+            fs::path dir = spec.parent_path();
+            n = list_directory(dir.empty() ? fs::path(".") : dir, last, files);
+        }
+        else if(fs::is_directory(spec))
+            n = list_directory(spec, "", files);
+        else
+        {
+            files.push_back(specs[i]);
+            continue;
+        }
+
+        if(n <= 0)
+        {
+            if(n == 0)
+                cerr << "expand_input_files() no input file matches '" << specs[i] << "'" << endl;
+            return -1;
+        }
+    }
+
+    if(files.empty())
+    {
+        cerr << "expand_input_files() no input file" << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+int read_input_list(const std::string& listName, std::vector<std::string>& specs)
+{
+    std::ifstream is(listName.c_str());
+    if(!is.good())
+    {
+        cerr << "read_input_list() can not open " << listName << endl;
+        return -1;
+    }
+
+    std::string line;
+    while(std::getline(is, line))
+    {
+        size_t b = line.find_first_not_of(" \t\r");
+        size_t e = line.find_last_not_of(" \t\r");
+        if(b == std::string::npos || line[b] == '#')
+            continue;
+        specs.push_back(line.substr(b, e - b + 1));
+    }
+
+    return 0;
+}
@@ -47,6 +47,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <points2grid/config.h>
 #include <points2grid/Interpolation.hpp>
 #include <points2grid/Global.hpp>
+#include <points2grid/GridCells.hpp>
+#include <points2grid/MemoryBudget.hpp>
 
 #include <string.h>
 #include <math.h>
@@ -71,7 +73,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 Interpolation::Interpolation(double x_dist, double y_dist, double radius,
                              int _window_size, int _interpolation_mode = INTERP_AUTO) : GRID_DIST_X (x_dist), GRID_DIST_Y(y_dist),
-                                                                                        filter_returns(false), keep_first_return(false), interp(NULL)
+                                                                                        interp(NULL)
 {
     las_point_count = 0;
 
@@ -79,6 +81,13 @@ Interpolation::Interpolation(double x_dist, double y_dist, double radius,
     radius_sqr = radius * radius;
     window_size = _window_size;
     interpolation_mode = _interpolation_mode;
+    num_threads = 1;
+    output_type = OUTPUT_TYPE_ALL;
+    idw_power = WEIGHTER;
+    ascii_single_read = false;
+    memory_budget = 0;
+    grid_file_io = GRID_FILE_MMAP;
+    decoder_threads = 1;
 
     min_x = DBL_MAX;
     min_y = DBL_MAX;
@@ -93,6 +102,11 @@ Interpolation::~Interpolation()
 }
 
 int Interpolation::init(const std::string& inputName, int inputFormat)
+{
+    return init(std::vector<std::string>(1, inputName), inputFormat);
+}
+
+int Interpolation::init(const std::vector<std::string>& inputNames, int inputFormat)
 {
     //unsigned int i;
 
@@ -111,86 +125,63 @@ int Interpolation::init(const std::string& inputName, int inputFormat)
     //t0 = times(&tbuf);
     t0 = clock();
 
-    printf("inputName: '%s'\n", inputName.c_str());
+    if (inputNames.size() == 1)
+        printf("inputName: '%s'\n", inputNames[0].c_str());
+    else
+        printf("inputs: %d files\n", (int)inputNames.size());
+
+    skipped_inputs.clear();
 
     if (inputFormat == INPUT_ASCII) {
-        FILE *fp;
-        char line[1024];
-        double data_x, data_y;
-        //double data_z;
+        AsciiReader reader;
+        std::vector<double> x, y, z;
 
-        if((fp = fopen(inputName.c_str(), "r")) == NULL)
-        {
-            cerr << "file open error" << endl;
+        if(ascii_single_read && spill.create() < 0)
             return -1;
-        }
 
-        // throw the first line away - it contains the header
-        fgets(line, sizeof(line), fp);
-
-        // read the data points to find min and max values
-        while(fgets(line, sizeof(line), fp) != NULL)
+        for(size_t f = 0; f < inputNames.size(); f++)
         {
-            data_x = atof(strtok(line, ",\n"));
-            if(min_x > data_x) min_x = data_x;
-            if(max_x < data_x) max_x = data_x;
-
-            data_y = atof(strtok(NULL, ",\n"));
-            if(min_y > data_y) min_y = data_y;
-            if(max_y < data_y) max_y = data_y;
-
-            data_count++;
-
-
-            /*
-            // tokenizing
-            string strLine(line);
-
-            // first token
-            string::size_type pos = strLine.find_first_of(",",0);
-            string::size_type lastPos = strLine.find_first_not_of(",",0);
-
-            string strX = strLine.substr(lastPos, pos - lastPos);
-
-            // second token
-            lastPos = strLine.find_first_not_of(",", pos);
-            pos = strLine.find_first_of(",", lastPos);
-
-            string strY = strLine.substr(lastPos, pos - lastPos);
+            if(reader.open(inputNames[f], num_threads) < 0)
+            {
+                cerr << "file open error" << endl;
+                return -1;
+            }
 
-            // third token
-            lastPos = strLine.find_first_not_of(",", pos);
-            pos = strLine.find_first_of("\n", lastPos);
+            // read the data points to find min and max values
+            while(reader.read(x, y, z))
+            {
+                for(size_t i = 0; i < x.size(); i++)
+                {
+                    if(min_x > x[i]) min_x = x[i];
+                    if(max_x < x[i]) max_x = x[i];
 
-            string strZ = strLine.substr(lastPos, pos - lastPos);
+                    if(min_y > y[i]) min_y = y[i];
+                    if(max_y < y[i]) max_y = y[i];
+                }
 
-            // data conversion
-            arrX[data_count] = atof(strX.c_str());
-            if(min_x > arrX[data_count]) min_x = arrX[data_count];
-            if(max_x < arrX[data_count]) max_x = arrX[data_count];
+                data_count += x.size();
 
-            arrY[data_count] = atof(strY.c_str());
-            if(min_y > arrY[data_count]) min_y = arrY[data_count];
-            if(max_y < arrY[data_count]) max_y = arrY[data_count];
+                if(spill.isOpen() && spill.write(x, y, z) < 0)
+                    return -1;
+            }
 
-            arrZ[data_count++] = atof(strZ.c_str());
-            */
+            reader.close();
         }
-
-        fclose(fp);
     } else { // las input
 
-        las_file las;
-        las.open(inputName);
-
-        min_x = las.minimums()[0];
-        min_y = las.minimums()[1];
-        max_x = las.maximums()[0];
-        max_y = las.maximums()[1];
-        data_count = las.points_count();
-        
-        las.close();
+        // the union of the extents in the headers, read in parallel
+        std::vector<LasHeader> headers;
+        if(read_las_headers(inputNames, num_threads, headers) < 0)
+            return -1;
 
+        for(size_t f = 0; f < headers.size(); f++)
+        {
+            min_x = std::min(min_x, headers[f].mins[0]);
+            min_y = std::min(min_y, headers[f].mins[1]);
+            max_x = std::max(max_x, headers[f].maxs[0]);
+            max_y = std::max(max_y, headers[f].maxs[1]);
+            data_count += headers[f].count;
+        }
     }
 
     t1 = clock();
@@ -219,45 +210,31 @@ int Interpolation::init(const std::string& inputName, int inputFormat)
     cerr << "GRID_SIZE_X " << GRID_SIZE_X << endl;
     cerr << "GRID_SIZE_Y " << GRID_SIZE_Y << endl;
 
-    if (interpolation_mode == INTERP_AUTO) {
-        // if the size is too big to fit in memory,
-        // then construct out-of-core structure
-        if(GRID_SIZE_X * GRID_SIZE_Y > MEM_LIMIT) {
-            interpolation_mode= INTERP_OUTCORE;
-        } else {
-            interpolation_mode = INTERP_INCORE;
-        }
-    }
+    return create_engine(false);
+}
 
-    if (interpolation_mode == INTERP_OUTCORE) {
-        cerr << "Using out of core interp code" << endl;;
+// plans the grid from the LAS headers: a file whose extent keeps every
+// point farther than the search radius from the grid is left out
+int Interpolation::init(const std::vector<std::string>& inputNames, int inputFormat, double n, double s, double e, double w)
+{
+    skipped_inputs.clear();
 
-        interp = new OutCoreInterp(GRID_DIST_X, GRID_DIST_Y, GRID_SIZE_X, GRID_SIZE_Y, radius_sqr, min_x, max_x, min_y, max_y, window_size);
-        if(interp == NULL)
-        {
-            cerr << "OutCoreInterp construction error" << endl;
+    if (inputFormat == INPUT_LAS) {
+        std::vector<LasHeader> headers;
+        if(read_las_headers(inputNames, num_threads, headers) < 0)
             return -1;
-        }
-
-        cerr << "Interpolation uses out-of-core algorithm" << endl;
 
-    } else {
-        cerr << "Using incore interp code" << endl;
-
-        interp = new InCoreInterp(GRID_DIST_X, GRID_DIST_Y, GRID_SIZE_X, GRID_SIZE_Y, radius_sqr, min_x, max_x, min_y, max_y, window_size);
-
-        cerr << "Interpolation uses in-core algorithm" << endl;
-    }
-
-    if(interp->init() < 0)
-    {
-        cerr << "inter->init() error" << endl;
-        return -1;
+        double r = sqrt(radius_sqr);
+        for(size_t f = 0; f < headers.size(); f++)
+        {
+            const LasHeader& h = headers[f];
+            if(h.maxs[0] < w - r || h.mins[0] > e + r || h.maxs[1] < s - r || h.mins[1] > n + r)
+                skipped_inputs.insert(inputNames[f]);
+        }
+        cerr << "inputs: " << inputNames.size() << " files, " << skipped_inputs.size() << " outside the grid" << endl;
     }
 
-    cerr << "Interpolation::init() done successfully" << endl;
-
-    return 0;
+    return init(inputNames.size() == 1 ? inputNames[0] : std::string(), n, s, e, w);
 }
 
 int Interpolation::init(const std::string& inputName, double n, double s, double e, double w)
@@ -286,17 +263,33 @@ int Interpolation::init(const std::string& inputName, double n, double s, double
     cerr << "GRID_SIZE_X " << GRID_SIZE_X << endl;
     cerr << "GRID_SIZE_Y " << GRID_SIZE_Y << endl;
 
+    return create_engine(true);
+}
+
+// picks the engine for the GRID_SIZE_X by GRID_SIZE_Y grid planned by
+// init(), hands it the settings and initializes it
+int Interpolation::create_engine(bool userDefinedGrid)
+{
+    resolve_memory_budget();
+
     if (interpolation_mode == INTERP_AUTO) {
         // if the size is too big to fit in memory,
         // then construct out-of-core structure
-        if(GRID_SIZE_X * GRID_SIZE_Y > MEM_LIMIT) {
+        if(!fits_in_core()) {
             interpolation_mode= INTERP_OUTCORE;
         } else {
             interpolation_mode = INTERP_INCORE;
         }
     }
 
-    if (interpolation_mode == INTERP_OUTCORE) {
+    if (interpolation_mode == INTERP_SPILL) {
+        cerr << "Using spill interp code" << endl;
+
+        interp = new SpillInterp(GRID_DIST_X, GRID_DIST_Y, GRID_SIZE_X, GRID_SIZE_Y, radius_sqr, min_x, max_x, min_y, max_y, window_size);
+
+        cerr << "Interpolation uses two-pass spill algorithm" << endl;
+
+    } else if (interpolation_mode == INTERP_OUTCORE) {
         cerr << "Using out of core interp code" << endl;;
 
         OutCoreInterp *ointerp = new OutCoreInterp(GRID_DIST_X, GRID_DIST_Y, GRID_SIZE_X, GRID_SIZE_Y, radius_sqr, min_x, max_x, min_y, max_y, window_size);
@@ -305,11 +298,20 @@ int Interpolation::init(const std::string& inputName, double n, double s, double
             cerr << "OutCoreInterp construction error" << endl;
             return -1;
         }
-        ointerp->isUserDefinedGrid(true);
+        ointerp->isUserDefinedGrid(userDefinedGrid);
         interp = ointerp;
 
         cerr << "Interpolation uses out-of-core algorithm" << endl;
 
+    } else if (interpolation_mode == INTERP_SPARSE) {
+        cerr << "Using sparse incore interp code" << endl;
+
+        InCoreInterp *sinterp = new InCoreInterp(GRID_DIST_X, GRID_DIST_Y, GRID_SIZE_X, GRID_SIZE_Y, radius_sqr, min_x, max_x, min_y, max_y, window_size);
+        sinterp->setSparse(true);
+        interp = sinterp;
+
+        cerr << "Interpolation uses in-core algorithm with sparse tiles" << endl;
+
     } else {
         cerr << "Using incore interp code" << endl;
 
@@ -318,6 +320,12 @@ int Interpolation::init(const std::string& inputName, double n, double s, double
         cerr << "Interpolation uses in-core algorithm" << endl;
     }
 
+    interp->setThreads(num_threads);
+    interp->setOutputType(output_type);
+    interp->setIdwPower(idw_power);
+    interp->setMemoryBudget(memory_budget);
+    interp->setGridFileIO(grid_file_io);
+
     if(interp->init() < 0)
     {
         cerr << "inter->init() error" << endl;
@@ -334,12 +342,18 @@ int Interpolation::interpolation(const std::string& inputName,
                                  int inputFormat,
                                  int outputFormat,
                                  unsigned int outputType)
+{
+    return interpolation(std::vector<std::string>(1, inputName), outputName, inputFormat, outputFormat, outputType);
+}
+
+int Interpolation::interpolation(const std::vector<std::string>& inputNames,
+                                 const std::string& outputName,
+                                 int inputFormat,
+                                 int outputFormat,
+                                 unsigned int outputType)
 {
     int rc;
     //unsigned int i;
-    double data_x, data_y;
-    double data_z;
-    int data_class, data_return_number, data_max_return;
 
     //struct tms tbuf;
     //clock_t t0, t1;
@@ -359,70 +373,80 @@ int Interpolation::interpolation(const std::string& inputName,
     */
 
     if (inputFormat == INPUT_ASCII) {
-        FILE *fp;
-        char line[1024];
+        AsciiReader reader;
+        std::vector<double> x, y, z;
 
-        if((fp = fopen(inputName.c_str(), "r")) == NULL)
+        // in single read mode init() kept the parsed points of every file;
+        // otherwise parse the text again
+        if(spill.isOpen())
         {
-            printf("file open error\n");
-            return -1;
-        }
+            if(spill.rewind() < 0)
+                return -1;
 
-        // throw the first line away - it contains the header
-        fgets(line, sizeof(line), fp);
+            while(spill.read(x, y, z))
+            {
+                if(update_shifted(x, y, z) < 0)
+                    return -1;
+            }
+        }
 
-        // read every point and generate DEM
-        while(fgets(line, sizeof(line), fp) != NULL)
+        for(size_t f = 0; f < inputNames.size() && !spill.isOpen(); f++)
         {
-            data_x = atof(strtok(line, ",\n"));
-            data_y = atof(strtok(NULL, ",\n"));
-            data_z = atof(strtok(NULL, ",\n"));
-
-            data_x -= min_x;
-            data_y -= min_y;
-
-            //if((rc = interp->update(arrX[i], arrY[i], arrZ[i])) < 0)
-            if((rc = interp->update(data_x, data_y, data_z)) < 0)
+            if(reader.open(inputNames[f], num_threads) < 0)
             {
-                cerr << "interp->update() error while processing " << endl;
+                printf("file open error\n");
                 return -1;
             }
+
+            // read every point and generate DEM
+            while(reader.read(x, y, z))
+            {
+                if(update_shifted(x, y, z) < 0)
+                    return -1;
+            }
+
+            reader.close();
         }
 
-        fclose(fp);
+        spill.close();
     } 
 
     else { // input format is LAS
 
-        las_file las;
-        las.open(inputName);
-    
-        
-        size_t count = las.points_count();
-        size_t index(0);
-        while (index < count) {
-            data_x = las.getX(index);
-            data_y = las.getY(index);
-            data_z = las.getZ(index);
-            data_class = las.getClassification(index);
-            data_return_number = las.getReturnNumber(index);
-            data_max_return = las.getNumberOfReturns(index);
-            
-            data_x -= min_x;
-            data_y -= min_y;
-
-            // If exclude point is true then point should be skipped
-            if (!exclude_point_class(data_class) && !exclude_point_return(data_return_number, data_max_return)) {
-                las_point_count++;
-				if ((rc = interp->update(data_x, data_y, data_z)) < 0) {
-					cerr << "interp->update() error while processing " << endl;
-					return -1;
-				}
-			}
-            index++;
-        }
-        
+        LasReader reader;
+        std::vector<double> x, y, z;
+
+        // a point farther than the search radius from every cell center
+        // updates no cell, so the decoders drop it before decoding
+        double r = sqrt(radius_sqr);
+        LasFilter filter = las_filter;
+        filter.clip = true;
+        filter.clip_min[0] = min_x - r;
+        filter.clip_min[1] = min_y - r;
+        filter.clip_max[0] = min_x + (GRID_SIZE_X - 1) * GRID_DIST_X + r;
+        filter.clip_max[1] = min_y + (GRID_SIZE_Y - 1) * GRID_DIST_Y + r;
+
+        for (size_t f = 0; f < inputNames.size(); f++) {
+            if (skipped_inputs.count(inputNames[f]))
+                continue;
+
+            if (reader.open(inputNames[f], decoder_threads, filter, min_x, min_y) < 0) {
+                cerr << "file open error" << endl;
+                return -1;
+            }
 
+            // the decoders hand over the points that pass the filters, in file
+            // order, already relative to the grid origin
+            while (reader.read(x, y, z)) {
+                las_point_count += x.size();
+                if ((rc = interp->update_batch(&x[0], &y[0], &z[0], x.size())) < 0) {
+                    cerr << "interp->update() error while processing " << endl;
+                    return -1;
+                }
+            }
+
+            reader.close();
+        }
     }
 
     if((rc = interp->finish(outputName, outputFormat, outputType)) < 0)
@@ -436,6 +460,24 @@ int Interpolation::interpolation(const std::string& inputName,
     return 0;
 }
 
+// feeds ASCII points to the engine relative to the grid origin
+int Interpolation::update_shifted(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z)
+{
+    for(size_t i = 0; i < x.size(); i++)
+    {
+        x[i] -= min_x;
+        y[i] -= min_y;
+    }
+
+    if(interp->update_batch(&x[0], &y[0], &z[0], x.size()) < 0)
+    {
+        cerr << "interp->update() error while processing " << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
 void Interpolation::setRadius(double r)
 {
     radius_sqr = r * r;
@@ -443,38 +485,72 @@ void Interpolation::setRadius(double r)
 
 void Interpolation::setLasExcludeClassification(std::vector<int> classification)
 {
-	las_exclude_classification = classification;
+	las_filter.exclude_classes = classification;
 }
 
 void Interpolation::setLasExcludeReturn(bool keep_first_return)
 {
-    filter_returns = true;
-    this->keep_first_return = keep_first_return;
+    las_filter.filter_returns = true;
+    las_filter.keep_first_return = keep_first_return;
 }
 
-bool Interpolation::exclude_point_class(int classification)
+void Interpolation::setThreads(int threads)
 {
-    // This checks if the classification vector contains the current classification, if it does return true
-    // to exclude point. Otherwise return false to include point
-    return std::find(las_exclude_classification.begin(), las_exclude_classification.end(), classification) != las_exclude_classification.end();
+    num_threads = threads;
 }
 
-bool Interpolation::exclude_point_return(int current_return, int max_returns)
+void Interpolation::setOutputType(unsigned int type)
 {
-    // keeping the first return return false when the current return is not equal to 1 (as we include point by returning false)
-    // keeping last return return false when current return is not equal to max_returns
-    if(filter_returns) {
-        if(keep_first_return)
-        {
-            return current_return != 1;
-        } else {
-            return current_return != max_returns; // if the current return == the max numbers of returns
-        }
+    output_type = type;
+}
+
+void Interpolation::setIdwPower(double power)
+{
+    idw_power = power;
+}
+
+void Interpolation::setAsciiSingleRead(bool single_read)
+{
+    ascii_single_read = single_read;
+}
+
+void Interpolation::setMemoryBudget(double bytes)
+{
+    memory_budget = bytes;
+}
+
+void Interpolation::setGridFileIO(int mode)
+{
+    grid_file_io = mode;
+}
+
+void Interpolation::setDecoderThreads(int threads)
+{
+    decoder_threads = threads;
+}
+
+const double Interpolation::MEMORY_BUDGET_SHARE = 0.75;
+
+void Interpolation::resolve_memory_budget()
+{
+    if(memory_budget <= 0)
+    {
+        memory_budget = detect_available_memory() * MEMORY_BUDGET_SHARE;
+        if(memory_budget <= 0)
+            memory_budget = DEFAULT_MEMORY_BUDGET;
     }
 
-    return false; // return false to include the point
+    cerr << "memory budget: " << memory_budget / (1024 * 1024) << " MB" << endl;
 }
 
+// the in-core engine only allocates the accumulators of the requested
+// output types
+bool Interpolation::fits_in_core()
+{
+    return InCoreInterp::memory_required(GRID_SIZE_X, GRID_SIZE_Y, output_type, num_threads) <= memory_budget;
+}
+
+
 
 
 
@@ -482,7 +558,7 @@ bool Interpolation::exclude_point_return(int current_return, int max_returns)
 
 
 
-unsigned int Interpolation::getDataCount()
+uint64_t Interpolation::getDataCount()
 {
     return data_count;
 }
@@ -0,0 +1,338 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <points2grid/config.h>
+#include <points2grid/LasReader.hpp>
+#include <points2grid/lasfile.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+using namespace std;
+
+//////////////////////////////////////////////////////////////////////
+// LasFilter
+//////////////////////////////////////////////////////////////////////
+
+void LasFilter::compile(las_point_filter& compiled) const
+{
+    compiled = las_point_filter();
+
+    for(size_t i = 0; i < exclude_classes.size(); i++)
+    {
+        int c = exclude_classes[i];
+        if(c >= 0 && c < 256)
+            compiled.class_mask[c >> 5] &= ~(1u << (c & 31));
+    }
+
+    if(filter_returns)
+        compiled.returns = keep_first_return ? las_point_filter::RETURNS_FIRST : las_point_filter::RETURNS_LAST;
+}
+
+//////////////////////////////////////////////////////////////////////
+// read_las_headers
+//////////////////////////////////////////////////////////////////////
+
+// the headers of files t, t + threads, ...; the message of a failure
+// goes to errors
+static void read_headers(const std::vector<std::string> *files, int t, int threads,
+                         std::vector<LasHeader> *headers, std::vector<std::string> *errors)
+{
+    for(size_t i = t; i < files->size(); i += threads)
+    {
+        try {
+            las_file las;
+            las.open((*files)[i]);
+
+            LasHeader& h = (*headers)[i];
+            for(int k = 0; k < 3; k++)
+            {
+                h.mins[k] = las.minimums()[k];
+                h.maxs[k] = las.maximums()[k];
+            }
+            h.count = las.points_count();
+        }
+        catch(std::exception& e) {
+            (*errors)[i] = e.what();
+        }
+    }
+}
+
+int read_las_headers(const std::vector<std::string>& files, int threads, std::vector<LasHeader>& headers)
+{
+    std::vector<std::string> errors(files.size());
+
+    headers.resize(files.size());
+    threads = (int)min((size_t)max(threads, 1), files.size());
+
+    if(threads <= 1)
+        read_headers(&files, 0, 1, &headers, &errors);
+    else
+    {
+        boost::thread_group readers;
+        for(int t = 0; t < threads; t++)
+            readers.create_thread(boost::bind(&read_headers, &files, t, threads, &headers, &errors));
+        readers.join_all();
+    }
+
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        if(!errors[i].empty())
+        {
+            cerr << "read_las_headers() " << files[i] << ": " << errors[i] << endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// LasReader
+//////////////////////////////////////////////////////////////////////
+
+// the decoder threads and what they wait on: a decoder for its next
+// buffer to be empty, read() for the buffer of the next batch to be full
+struct LasDecoders
+{
+    boost::mutex mutex;
+    boost::condition_variable ready;
+    boost::thread_group threads;
+    bool stop;
+};
+
+LasReader::LasReader()
+: m_las(NULL)
+, m_filter(NULL)
+, m_originX(0)
+, m_originY(0)
+, m_numBatches(0)
+, m_next(0)
+, m_decoders(0)
+, m_threads(NULL)
+{
+}
+
+LasReader::~LasReader()
+{
+    close();
+}
+
+int LasReader::open(const std::string& fileName, int decoders, const LasFilter& filter, double origin_x, double origin_y)
+{
+    close();
+
+    m_las = new las_file;
+    try {
+        m_las->open(fileName);
+    }
+    catch(std::exception& e) {
+        cerr << "LasReader::open() " << fileName << ": " << e.what() << endl;
+        delete m_las;
+        m_las = NULL;
+        return -1;
+    }
+
+    m_filter = new las_point_filter;
+    filter.compile(*m_filter);
+    if(filter.clip)
+        m_las->clip_filter(*m_filter, filter.clip_min[0], filter.clip_min[1], filter.clip_max[0], filter.clip_max[1]);
+    m_originX = origin_x;
+    m_originY = origin_y;
+    m_numBatches = (m_las->points_count() + BATCH_SIZE - 1) / BATCH_SIZE;
+    m_next = 0;
+
+    m_decoders = (int)min((uint64_t)max(decoders, 0), m_numBatches);
+    if(m_decoders == 0)
+    {
+        m_batches.resize(1);
+        return 0;
+    }
+
+    m_batches.resize(2 * m_decoders);
+    for(size_t i = 0; i < m_batches.size(); i++)
+        m_batches[i].full = false;
+
+    m_threads = new LasDecoders;
+    m_threads->stop = false;
+    for(int t = 0; t < m_decoders; t++)
+        m_threads->threads.create_thread(boost::bind(&LasReader::decoder, this, t));
+
+    return 0;
+}
+
+void LasReader::close()
+{
+    if(m_threads != NULL)
+    {
+        {
+            boost::mutex::scoped_lock lock(m_threads->mutex);
+            m_threads->stop = true;
+        }
+        m_threads->ready.notify_all();
+        m_threads->threads.join_all();
+
+        delete m_threads;
+        m_threads = NULL;
+    }
+
+    delete m_las;
+    m_las = NULL;
+    delete m_filter;
+    m_filter = NULL;
+    m_batches.clear();
+    m_numBatches = m_next = 0;
+    m_decoders = 0;
+}
+
+uint64_t LasReader::pointsCount() const
+{
+    return m_las == NULL ? 0 : m_las->points_count();
+}
+
+// filters batch k in DECODE_BLOCK pieces, and decodes the points kept
+void LasReader::decodeBatch(uint64_t k, Batch& batch, Scratch& scratch) const
+{
+    uint64_t first = k * BATCH_SIZE;
+    size_t n = (size_t)min((uint64_t)BATCH_SIZE, m_las->points_count() - first);
+
+    scratch.x.resize(DECODE_BLOCK);
+    scratch.y.resize(DECODE_BLOCK);
+    scratch.z.resize(DECODE_BLOCK);
+    scratch.selected.resize(DECODE_BLOCK);
+
+    batch.x.clear();
+    batch.y.clear();
+    batch.z.clear();
+    batch.x.reserve(n);
+    batch.y.reserve(n);
+    batch.z.reserve(n);
+
+    for(size_t done = 0; done < n; done += DECODE_BLOCK)
+    {
+        size_t m = min((size_t)DECODE_BLOCK, n - done);
+        size_t kept = m_las->filter_points(first + done, m, *m_filter, &scratch.selected[0]);
+
+        if(kept == 0)
+            continue;
+        if(kept == m)
+            m_las->decode_points(first + done, m, &scratch.x[0], &scratch.y[0], &scratch.z[0]);
+        else
+            m_las->decode_selected(first + done, &scratch.selected[0], kept, &scratch.x[0], &scratch.y[0], &scratch.z[0]);
+
+        for(size_t i = 0; i < kept; i++)
+        {
+            batch.x.push_back(scratch.x[i] - m_originX);
+            batch.y.push_back(scratch.y[i] - m_originY);
+            batch.z.push_back(scratch.z[i]);
+        }
+    }
+}
+
+void LasReader::decoder(int t)
+{
+    Scratch scratch;
+
+    for(uint64_t k = t; k < m_numBatches; k += m_decoders)
+    {
+        Batch& batch = m_batches[2 * t + (k / m_decoders) % 2];
+        {
+            boost::mutex::scoped_lock lock(m_threads->mutex);
+
+            while(batch.full && !m_threads->stop)
+                m_threads->ready.wait(lock);
+            if(m_threads->stop)
+                return;
+        }
+
+        decodeBatch(k, batch, scratch);
+
+        {
+            boost::mutex::scoped_lock lock(m_threads->mutex);
+            batch.full = true;
+        }
+        m_threads->ready.notify_all();
+    }
+}
+
+bool LasReader::read(std::vector<double>& x, std::vector<double>& y, std::vector<double>& z)
+{
+    x.clear();
+    y.clear();
+    z.clear();
+
+    // batches the filter emptied are passed over
+    while(x.empty() && m_next < m_numBatches)
+    {
+        uint64_t k = m_next++;
+
+        if(m_threads == NULL)
+        {
+            decodeBatch(k, m_batches[0], m_scratch);
+            x.swap(m_batches[0].x);
+            y.swap(m_batches[0].y);
+            z.swap(m_batches[0].z);
+            continue;
+        }
+
+        // the caller's vectors go back to the decoder as its next buffer
+        Batch& batch = m_batches[2 * (k % m_decoders) + (k / m_decoders) % 2];
+        {
+            boost::mutex::scoped_lock lock(m_threads->mutex);
+
+            while(!batch.full)
+                m_threads->ready.wait(lock);
+
+            x.swap(batch.x);
+            y.swap(batch.y);
+            z.swap(batch.z);
+            batch.full = false;
+        }
+        m_threads->ready.notify_all();
+    }
+
+    return !x.empty();
+}
@@ -0,0 +1,218 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <points2grid/config.h>
+#include <points2grid/MemoryBudget.hpp>
+
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// cgroup v1 reports "no limit" as a huge page-rounded number
+static const double UNLIMITED = 1e18;
+
+double parse_cgroup_limit(const std::string& contents)
+{
+    istringstream in(contents);
+    string value;
+
+    if(!(in >> value) || value == "max")
+        return 0;
+
+    double bytes = atof(value.c_str());
+    return bytes > 0 && bytes < UNLIMITED ? bytes : 0;
+}
+
+double parse_cgroup_stat(const std::string& contents, const std::string& key)
+{
+    istringstream in(contents);
+    string name;
+    double value;
+
+    while(in >> name >> value)
+    {
+        if(name == key)
+            return value;
+    }
+
+    return 0;
+}
+
+double parse_meminfo_available(const std::string& contents)
+{
+    istringstream in(contents);
+    string line;
+
+    while(getline(in, line))
+    {
+        if(line.compare(0, 13, "MemAvailable:") == 0)
+            return atof(line.c_str() + 13) * 1024;
+    }
+
+    return 0;
+}
+
+double cgroup_headroom(double limit, double usage, double inactive_file)
+{
+    if(limit == 0)
+        return 0;
+
+    // inactive page cache is reclaimed before the cgroup runs out
+    double used = usage - inactive_file;
+    if(used < 0)
+        used = 0;
+
+    // a cgroup at its limit still has one, so not 0
+    return limit - used > 1 ? limit - used : 1;
+}
+
+double smaller_memory_limit(double a, double b)
+{
+    if(a == 0)
+        return b;
+    if(b == 0)
+        return a;
+    return a < b ? a : b;
+}
+
+namespace
+{
+
+// the whole file, empty if it cannot be read
+std::string read_file(const std::string& path)
+{
+    ifstream in(path.c_str());
+    ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+// the memory the cgroup in dir has left: its limit less what it uses
+double cgroup_room(const std::string& dir, const char *limit, const char *usage, const char *inactive_key)
+{
+    return cgroup_headroom(parse_cgroup_limit(read_file(dir + limit)),
+                           parse_cgroup_limit(read_file(dir + usage)),
+                           parse_cgroup_stat(read_file(dir + "/memory.stat"), inactive_key));
+}
+
+// the memory left to the cgroup the process runs in, looked up both under
+// its own path and at the root, where it is inside a cgroup namespace
+double cgroup_available()
+{
+    ifstream in("/proc/self/cgroup");
+    string line;
+    double room = 0;
+
+    while(getline(in, line))
+    {
+        // hierarchy-ID:controller-list:cgroup-path
+        size_t first = line.find(':');
+        size_t second = first == string::npos ? string::npos : line.find(':', first + 1);
+        if(second == string::npos)
+            continue;
+
+        string controllers = line.substr(first + 1, second - first - 1);
+        string path = line.substr(second + 1);
+        if(path == "/")
+            path = "";
+
+        if(line.compare(0, first, "0") == 0 && controllers.empty())
+        {
+            room = smaller_memory_limit(room, cgroup_room("/sys/fs/cgroup" + path, "/memory.max", "/memory.current", "inactive_file"));
+            room = smaller_memory_limit(room, cgroup_room("/sys/fs/cgroup", "/memory.max", "/memory.current", "inactive_file"));
+        }
+        else if(("," + controllers + ",").find(",memory,") != string::npos)
+        {
+            room = smaller_memory_limit(room, cgroup_room("/sys/fs/cgroup/memory" + path, "/memory.limit_in_bytes",
+                                                          "/memory.usage_in_bytes", "total_inactive_file"));
+            room = smaller_memory_limit(room, cgroup_room("/sys/fs/cgroup/memory", "/memory.limit_in_bytes",
+                                                          "/memory.usage_in_bytes", "total_inactive_file"));
+        }
+    }
+
+    return room;
+}
+
+double system_available()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if(GlobalMemoryStatusEx(&status))
+        return (double)status.ullAvailPhys;
+    return 0;
+#else
+    // MemAvailable counts reclaimable page cache, unlike free pages
+    double available = parse_meminfo_available(read_file("/proc/meminfo"));
+    if(available > 0)
+        return available;
+
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if(pages > 0 && page_size > 0)
+        return (double)pages * page_size;
+#endif
+    return 0;
+#endif
+}
+
+}
+
+double detect_available_memory()
+{
+#ifdef _WIN32
+    return system_available();
+#else
+    return smaller_memory_limit(cgroup_available(), system_available());
+#endif
+}
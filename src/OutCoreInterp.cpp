@@ -52,11 +52,19 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
+#include <deque>
 
 #include <points2grid/config.h>
 #include <points2grid/OutCoreInterp.hpp>
 #include <points2grid/Interpolation.hpp>
 #include <points2grid/Global.hpp>
+#include <points2grid/SpanKernels.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread/thread.hpp>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -74,8 +82,6 @@ OutCoreInterp::OutCoreInterp(double dist_x, double dist_y,
                              double _min_y, double _max_y,
                              int _window_size)
 {
-    int i;
-
     GRID_DIST_X = dist_x;
     GRID_DIST_Y = dist_y;
 
@@ -91,114 +97,318 @@ OutCoreInterp::OutCoreInterp(double dist_x, double dist_y,
 
     window_size = _window_size;
 
-    overlapSize = (int)ceil(sqrt(radius_sqr)/GRID_DIST_Y);
+    stencil.init(GRID_DIST_X, GRID_DIST_Y, radius_sqr);
+
+    // a point reaches the cells within the radius on either side of its own
+    overlapSizeX = (int)floor(sqrt(radius_sqr)/GRID_DIST_X) + 1;
+    overlapSize = (int)floor(sqrt(radius_sqr)/GRID_DIST_Y) + 1;
     int window_dist = window_size / 2;
+    if (window_dist > overlapSizeX) {
+        overlapSizeX = window_dist;
+    }
     if (window_dist > overlapSize) {
         overlapSize = window_dist;
     }
 
-    // how many pieces will there be?
-    // numFiles = (GRID_SIZE_X*GRID_SIZE_Y + (2 * overlapSize + 1) * GRID_SIZE_X * numFiles) / MEM_LIMIT;
-    // (2 * overlapSize + 1) means, each component has one more row to handle the points in-between two components.
-    numFiles = (int)ceil((double)GRID_SIZE_X * GRID_SIZE_Y / (Interpolation::MEM_LIMIT - (2 * overlapSize + 1) * GRID_SIZE_X));
-    cerr << "numFiles " << numFiles << endl;
+    // the tiles are laid out in init(), once the memory budget is known
+    tiles_x = tiles_y = 0;
+    local_grid_size_x = local_grid_size_y = 0;
+    numFiles = 0;
+    gridMap = NULL;
+    qlist = NULL;
+    queue_limit = MIN_QUEUE_LIMIT;
+    max_resident = 1;
+    num_workers = 1;
+    pool = NULL;
+    tile_io = NULL;
+    prefetch_level = 0;
+    prefetches = writebacks = 0;
 
-    if(numFiles == 0)
-        cerr << "The number of files is 0!" << endl;
+    user_defined_grid = false;
+}
 
-    // TODO: if one row is too long,
-    // i.e. the shape of decomposition is long, and thin in one direction,
-    // alternative decomposition scheme may be more efficient.
+OutCoreInterp::~OutCoreInterp()
+{
+    stopWorkers();
+    stopTileIO();
 
-    // row-wise decomposition
+    delete [] qlist;
 
-    local_grid_size_x = GRID_SIZE_X;
-    local_grid_size_y = (int)ceil((double)GRID_SIZE_Y/numFiles);
+    for(int i = 0; i < numFiles; i++)
+    {
+        //cout << "gridMap " << i << " deleted" << endl;
+            GridFile* f = gridMap[i]->getGridFile();
 
+            // Try to wipe the Grid data
+            int status = remove (f->getFileName().c_str());
+            if (status != 0)
+                std::cerr << "unable to remove tmpfile '" << f->getFileName() << "'" << std::endl;
+            delete gridMap[i];
+    }
+    if(gridMap != NULL)
+        delete [] gridMap;
+}
 
-    // define overlap.. a funtion of (radius_sqr)
-    // overlap size: sqrt(radius_sqr)/GRID_DIST_Y;
+int OutCoreInterp::init()
+{
+    int i, tx, ty;
+
+    idw_int_power = integer_idw_power();
 
-    // construct a map indicating which file corresponds which area
+    // how many pieces will there be?
+    chooseTiles();
+    numFiles = tiles_x * tiles_y;
+    cerr << "tiles " << tiles_x << " x " << tiles_y << " of "
+         << local_grid_size_x << " x " << local_grid_size_y << " cells" << endl;
+
+    // construct a map indicating which file corresponds which area; every
+    // tile carries overlapSizeX halo columns and overlapSize halo rows on
+    // each side, clipped to the grid
     if((gridMap = new GridMap*[numFiles]) == NULL)
-        cerr << "OutCoreInterp::OutCoreInterp() GridMap[] allocation error" << endl;
+        cerr << "OutCoreInterp::init() GridMap[] allocation error" << endl;
 
-    for(i = 0; i < numFiles; i++)
+    for(ty = 0; ty < tiles_y; ty++)
     {
-        int lower_bound = i * local_grid_size_y;
-        int upper_bound = (i+1) * local_grid_size_y - 1;
-
-        if(upper_bound >= GRID_SIZE_Y)
-            upper_bound = GRID_SIZE_Y - 1;
-
-        int overlap_lower_bound = lower_bound - overlapSize;
-        if(overlap_lower_bound < 0)
-            overlap_lower_bound = 0;
-
-        int overlap_upper_bound = upper_bound + overlapSize + 1;
-        if(overlap_upper_bound >= GRID_SIZE_Y)
-            overlap_upper_bound = GRID_SIZE_Y - 1;
-
-        char fname[1024];
-        get_temp_file_name(fname, sizeof(fname));
-
-        gridMap[i] = new GridMap(i,
-                                 GRID_SIZE_X,
-                                 lower_bound,
-                                 upper_bound,
-                                 overlap_lower_bound,
-                                 overlap_upper_bound,
-                                 false,
-                                 fname);
-        if(gridMap[i] == NULL)
-            cerr << "OutCoreInterp::OutCoreInterp() GridMap alloc error" << endl;
-
-        cerr << "[" <<  lower_bound << "," << upper_bound << "]" << endl;
-        cerr << "[" << overlap_lower_bound << "," << overlap_upper_bound << "]" << endl;
+        for(tx = 0; tx < tiles_x; tx++)
+        {
+            i = ty * tiles_x + tx;
+
+            int left_bound = tx * local_grid_size_x;
+            int right_bound = min(left_bound + local_grid_size_x, GRID_SIZE_X) - 1;
+            int lower_bound = ty * local_grid_size_y;
+            int upper_bound = min(lower_bound + local_grid_size_y, GRID_SIZE_Y) - 1;
+
+            int overlap_left_bound = max(left_bound - overlapSizeX, 0);
+            int overlap_right_bound = min(right_bound + overlapSizeX, GRID_SIZE_X - 1);
+            int overlap_lower_bound = max(lower_bound - overlapSize, 0);
+            int overlap_upper_bound = min(upper_bound + overlapSize, GRID_SIZE_Y - 1);
+
+            char fname[1024];
+            get_temp_file_name(fname, sizeof(fname));
+
+            gridMap[i] = new GridMap(i,
+                                     lower_bound,
+                                     upper_bound,
+                                     overlap_lower_bound,
+                                     overlap_upper_bound,
+                                     left_bound,
+                                     right_bound,
+                                     overlap_left_bound,
+                                     overlap_right_bound,
+                                     false,
+                                     fname);
+            if(gridMap[i] == NULL)
+                cerr << "OutCoreInterp::init() GridMap alloc error" << endl;
+            gridMap[i]->getGridFile()->setIOMode(grid_file_io);
+        }
     }
 
     // initializing queues
-    qlist = new list<UpdateInfo> [numFiles];
+    qlist = new vector<UpdateInfo> [numFiles];
     if(qlist == NULL)
-        cerr << "OutCoreInterp::OutCoreInterp() qlist alloc error" << endl;
+        cerr << "OutCoreInterp::init() qlist alloc error" << endl;
+
+    // as many tiles stay mapped as the budget holds next to the minimum
+    // queues; the queues share whatever is left
+    double tile_bytes = tileBytes(tiles_x, tiles_y);
+    double free_bytes = memory_budget - (memoryRequired(tiles_x, tiles_y) - min(numFiles, (int)MIN_RESIDENT_TILES) * tile_bytes);
+
+    max_resident = (int)(free_bytes / tile_bytes);
+    if(max_resident > numFiles)
+        max_resident = numFiles;
+    if(max_resident < 1)
+        max_resident = 1;
+
+    double queue_bytes = free_bytes - max_resident * tile_bytes + queueBytes(numFiles, MIN_QUEUE_LIMIT);
+    queue_limit = (size_t)(queue_bytes / queueBytes(numFiles, 1));
+    if(queue_limit < MIN_QUEUE_LIMIT)
+        queue_limit = MIN_QUEUE_LIMIT;
+    cerr << "resident tiles " << max_resident << ", queue limit " << queue_limit << endl;
+
+    // every worker keeps at least one tile mapped
+    num_workers = max(min(min(num_threads, max_resident), numFiles), 1);
+    caches.resize(num_workers);
+    for(i = 0; i < num_workers; i++)
+    {
+        caches[i].worker = i;
+        caches[i].max_resident = max_resident / num_workers + (i < max_resident % num_workers ? 1 : 0);
+        caches[i].num_resident = 0;
+        caches[i].use_clock = 0;
+        caches[i].hits = caches[i].misses = caches[i].evictions = 0;
+    }
+    last_use.assign(numFiles, 0);
 
-    openFile = -1;
+    // a queue three quarters full predicts the next tile to be mapped
+    prefetch_level = queue_limit - queue_limit / 4;
+    if(numFiles > max_resident)
+        startTileIO();
 
-    user_defined_grid = false;
+    // open up a memory mapped file
+    if(loadTile(0, caches[0]) < 0)
+        return -1;
 
-    //cout << overlapSize << endl;
-    //cout << "data size: " << (size_x * size_y) << " numFiles: " << numFiles << " local_grid_size_y: " << local_grid_size_y << " overlap: " << overlapSize << endl;
-    //cout << fname << endl;
-    //cout << "GridMap is created: " << i << endl;
+    if(num_workers > 1)
+    {
+        cerr << "applying points on " << num_workers << " worker threads" << endl;
+        startWorkers();
+    }
+
+    return 0;
 }
 
-OutCoreInterp::~OutCoreInterp()
+// the tile layout storing the fewest cells, halos included, among those
+// that keep MIN_RESIDENT_TILES tiles within the memory budget. Full width
+// row bands are the tiles_x == 1 case; narrower tiles win once the rows
+// get so long that a band would be mostly halo.
+void OutCoreInterp::chooseTiles()
 {
-    /*
-      if(qlist != NULL)
-      delete qlist;
-    */
+    bool best_fits = false;
+    double best_cells = 0;
+    double best_memory = 0;
 
-    for(int i = 0; i < numFiles; i++)
+    tiles_x = tiles_y = 1;
+
+    for(int tx = 1; tx <= GRID_SIZE_X; tx++)
     {
-        //cout << "gridMap " << i << " deleted" << endl;
-            GridFile* f = gridMap[i]->getGridFile();
+        // skip the counts that only leave empty tile columns
+        int width = (GRID_SIZE_X + tx - 1) / tx;
+        if(tx > 1 && (GRID_SIZE_X + width - 1) / width != tx)
+            continue;
+
+        int ext_width = min(width + (tx > 1 ? 2 * overlapSizeX : 0), GRID_SIZE_X);
+
+        // the tallest tiles of which MIN_RESIDENT_TILES fit
+        double ext_rows = memory_budget / MIN_RESIDENT_TILES / ((double)ext_width * sizeof(GridPoint));
+        int ty;
+        if(ext_rows >= GRID_SIZE_Y)
+            ty = 1;
+        else
+        {
+            int height = max((int)ext_rows - 2 * overlapSize, 1);
+            ty = (GRID_SIZE_Y + height - 1) / height;
+        }
 
-            // Try to wipe the Grid data
-            int status = remove (f->getFileName().c_str());
-            if (status != 0)
-                std::cerr << "unable to remove tmpfile '" << f->getFileName() << "'" << std::endl;
-            delete gridMap[i];
+        // the queues and the halo copy take their share too; past the point
+        // where the queues outgrow what the smaller tiles save, more tiles
+        // only cost memory
+        while(ty < GRID_SIZE_Y && memoryRequired(tx, ty) > memory_budget &&
+                memoryRequired(tx, ty + 1) <= memoryRequired(tx, ty))
+            ty++;
+
+        int height = (GRID_SIZE_Y + ty - 1) / ty;
+        ty = (GRID_SIZE_Y + height - 1) / height;
+
+        double memory = memoryRequired(tx, ty);
+        double cells = (double)tx * ty * tileBytes(tx, ty) / sizeof(GridPoint);
+        bool fits = memory <= memory_budget;
+
+        if((fits && (!best_fits || cells < best_cells)) ||
+                (!fits && !best_fits && (tx == 1 || memory < best_memory)))
+        {
+            best_fits = fits;
+            best_cells = cells;
+            best_memory = memory;
+            tiles_x = tx;
+            tiles_y = ty;
+        }
     }
-    if(gridMap != NULL)
-        delete [] gridMap;
+
+    local_grid_size_x = (GRID_SIZE_X + tiles_x - 1) / tiles_x;
+    local_grid_size_y = (GRID_SIZE_Y + tiles_y - 1) / tiles_y;
+
+    if(!best_fits)
+        cerr << "OutCoreInterp: no tile decomposition fits in the memory budget, using "
+             << tiles_x << " x " << tiles_y << " tiles" << endl;
 }
 
-int OutCoreInterp::init()
+// bytes of the largest mapped tile with its halos
+double OutCoreInterp::tileBytes(int num_x, int num_y) const
 {
-    // open up a memory mapped file
-    openFile = 0;
-    return gridMap[openFile]->getGridFile()->map();
+    int width = (GRID_SIZE_X + num_x - 1) / num_x;
+    int height = (GRID_SIZE_Y + num_y - 1) / num_y;
+
+    if(num_x > 1)
+        width = min(width + 2 * overlapSizeX, GRID_SIZE_X);
+    if(num_y > 1)
+        height = min(height + 2 * overlapSize, GRID_SIZE_Y);
+
+    return (double)width * height * sizeof(GridPoint);
+}
+
+// bytes used with the grid split into num_x by num_y tiles: up to
+// MIN_RESIDENT_TILES mapped tiles, the halo copy finish() makes, and
+// queues of the minimum length
+double OutCoreInterp::memoryRequired(int num_x, int num_y) const
+{
+    int num_files = num_x * num_y;
+    int width = (GRID_SIZE_X + num_x - 1) / num_x;
+    int height = (GRID_SIZE_Y + num_y - 1) / num_y;
+    double copy_bytes = 0;
+
+    if(num_files > 1)
+        copy_bytes = max((double)overlapSizeX * (height + 2 * overlapSize),
+                         (double)overlapSize * (width + 2 * overlapSizeX)) * sizeof(GridPoint);
+
+    return min(num_files, (int)MIN_RESIDENT_TILES) * tileBytes(num_x, num_y) + copy_bytes + queueBytes(num_files, MIN_QUEUE_LIMIT);
+}
+
+// maps a tile of the cache, first unmapping its least recently used one
+// when the cache is full
+int OutCoreInterp::loadTile(int fileNum, TileCache& cache)
+{
+    last_use[fileNum] = ++cache.use_clock;
+
+    if(gridMap[fileNum]->getGridFile()->isInMemory())
+        return 0;
+
+    if(cache.num_resident >= cache.max_resident)
+    {
+        int victim = -1;
+        for(int i = cache.worker; i < numFiles; i += num_workers)
+        {
+            if(gridMap[i]->getGridFile()->isInMemory() && (victim < 0 || last_use[i] < last_use[victim]))
+                victim = i;
+        }
+
+        // write back to disk
+        if(gridMap[victim]->getGridFile()->unmap() < 0)
+            return -1;
+        cache.num_resident--;
+        cache.evictions++;
+        requestTileIO(victim, false);
+    }
+
+    // upload from disk to memory
+    cache.misses++;
+    if(gridMap[fileNum]->getGridFile()->map() < 0)
+        return -1;
+    cache.num_resident++;
+
+    return 0;
+}
+
+// bytes of num_files queues holding limit points each; a vector may have
+// grown to twice the points it holds
+double OutCoreInterp::queueBytes(int num_files, size_t limit) const
+{
+    return (double)num_files * limit * 2 * sizeof(UpdateInfo);
+}
+
+// applies the points queued for the open tile sorted by y, and so by row,
+// so the tile is walked once in order. A cell's sums therefore add up its
+// points in row order rather than input order, which can change their last
+// bits. Exact IDW hits are unaffected: points on the same cell center share
+// y, and the stable sort keeps them in input order, so the first still wins
+void OutCoreInterp::drainQueue(int fileNum, StencilCover& cover)
+{
+    vector<UpdateInfo>& queue = qlist[fileNum];
+
+    std::stable_sort(queue.begin(), queue.end(), UpdateInfo::lessRow);
+
+    for(size_t i = 0; i < queue.size(); i++)
+        updateInterpArray(fileNum, queue[i].data_x, queue[i].data_y, queue[i].data_z, cover);
+
+    queue.clear();
 }
 
 int OutCoreInterp::update(double data_x, double data_y, double data_z)
@@ -214,324 +424,687 @@ int OutCoreInterp::update(double data_x, double data_y, double data_z)
 
     //
     // find which file should be updated
-
-    /*
-      if(data_x < 0){
-      cout << "4. !!!! " << data_x << endl;
-      return -1;
-      }
-    */
-
-    int fileNum;
-
-    //fileNum = upper_grid_y / local_grid_size_y;
-    fileNum = findFileNum(data_y);
-    if(fileNum < 0 || fileNum > numFiles-1)
+    int fileNum = findFileNum(data_x, data_y);
+    if(fileNum < 0)
     {
         if (user_defined_grid) return 0;
         cerr << "OutCoreInterp::update() findFileNum() error!" << endl;
-        cerr << "data_x: " << data_x << " data_y: " << data_y << " grid_y: " << (int)(data_y/GRID_DIST_Y) << " fileNum: " << fileNum << " open file: " << openFile << endl;
+        cerr << "data_x: " << data_x << " data_y: " << data_y << " grid_x: " << (int)(data_x/GRID_DIST_X)
+             << " grid_y: " << (int)(data_y/GRID_DIST_Y) << endl;
         return -1;
     }
 
-    if(openFile == fileNum)
+    UpdateInfo ui(data_x, data_y, data_z);
+
+    if(pool == NULL)
+        return applyPoint(fileNum, ui, caches[0]);
+
+    return routePoint(fileNum, ui);
+}
+
+// applies a point to a tile of the cache, or queues it
+int OutCoreInterp::applyPoint(int fileNum, const UpdateInfo& point, TileCache& cache)
+{
+    if(gridMap[fileNum]->getGridFile()->isInMemory())
     {
         // write into memory;
-        updateInterpArray(fileNum, data_x, data_y, data_z);
+        cache.hits++;
+        last_use[fileNum] = ++cache.use_clock;
+        updateInterpArray(fileNum, point.data_x, point.data_y, point.data_z, cache.cover);
 
     } else {
-        UpdateInfo ui(data_x, data_y, data_z);
-        qlist[fileNum].push_back(ui);
+        qlist[fileNum].push_back(point);
 
-        if(qlist[fileNum].size() == QUEUE_LIMIT)
+        // a tile without a file yet has nothing to read ahead
+        if(qlist[fileNum].size() == prefetch_level && gridMap[fileNum]->getGridFile()->isInitialized())
+            requestTileIO(fileNum, true);
+
+        if(qlist[fileNum].size() >= queue_limit)
         {
-            //cout << "erase" << endl;
-            if(openFile != -1)
+            if(loadTile(fileNum, cache) < 0)
             {
-                // if we use mmap and write directly into disk, no need this step.
-                // munmap would be enough for this step..
-
-                // write back to disk
-                gridMap[openFile]->getGridFile()->unmap();
-                openFile = -1;
+                cerr << "OutCoreInterp::update() map error" << endl;
+                return -1;
             }
-            // upload from disk to memory
-            gridMap[fileNum]->getGridFile()->map();
-            openFile = fileNum;
 
             // pop every update information
-            list<UpdateInfo>::const_iterator iter;
+            drainQueue(fileNum, cache.cover);
+        }
+    }
+
+    return 0;
+}
+
+// applies the points still queued for the tiles of the cache, those of
+// its mapped tiles first
+int OutCoreInterp::flushQueues(TileCache& cache)
+{
+    int i;
+
+    for(i = cache.worker; i < numFiles; i += num_workers)
+    {
+        if(gridMap[i]->getGridFile()->isInMemory())
+            drainQueue(i, cache.cover);
+    }
+
+    for(i = cache.worker; i < numFiles; i += num_workers)
+    {
+        if(qlist[i].size() != 0)
+        {
+            // read ahead the tile flushed after this one
+            for(int j = i + num_workers; j < numFiles; j += num_workers)
+            {
+                if(qlist[j].size() != 0)
+                {
+                    if(gridMap[j]->getGridFile()->isInitialized() && !gridMap[j]->getGridFile()->isInMemory())
+                        requestTileIO(j, true);
+                    break;
+                }
+            }
 
-            for(iter = qlist[openFile].begin(); iter!= qlist[openFile].end(); iter++) {
-                updateInterpArray(openFile, (*iter).data_x, (*iter).data_y, (*iter).data_z);
+            if(loadTile(i, cache) < 0)
+            {
+                cerr << "OutCoreInterp::finish() map error" << endl;
+                return -1;
             }
-            // flush
-            qlist[openFile].erase(qlist[openFile].begin(), qlist[openFile].end());
+
+            // flush UpdateInfo queue
+            drainQueue(i, cache.cover);
         }
     }
 
     return 0;
 }
 
-int OutCoreInterp::finish(const std::string& outputName, int outputFormat, unsigned int outputType)
+// A point and the tile it goes to, on its way from the ingest thread to
+// the worker owning the tile
+struct TileUpdate
 {
-    return finish(outputName, outputFormat, outputType, 0, 0);
+    int fileNum;
+    UpdateInfo point;
+};
+
+// the worker threads and one single-producer single-consumer queue per
+// worker, filled by the thread calling update()
+struct IngestPool
+{
+    std::vector< boost::lockfree::spsc_queue<TileUpdate> * > queues;
+    boost::thread_group threads;
+
+    // set by the ingest thread after its last point
+    boost::atomic<bool> done;
+    // set by a worker that failed to map a tile
+    boost::atomic<bool> failed;
+};
+
+// waiting on a queue: a few yields, then short sleeps
+static void ingest_backoff(int& idle)
+{
+    if(++idle < 64)
+        boost::this_thread::yield();
+    else
+        boost::this_thread::sleep(boost::posix_time::microseconds(50));
 }
 
-int OutCoreInterp::finish(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt)
+void OutCoreInterp::startWorkers()
 {
-    int i, j;
-    GridPoint *p;
-    GridFile *gf;
-    int len_y;
-    int offset;
+    pool = new IngestPool;
+    pool->done = false;
+    pool->failed = false;
+
+    for(int i = 0; i < num_workers; i++)
+        pool->queues.push_back(new boost::lockfree::spsc_queue<TileUpdate>(INGEST_QUEUE_SIZE));
+    for(int i = 0; i < num_workers; i++)
+        pool->threads.create_thread(boost::bind(&OutCoreInterp::ingestWorker, this, i));
+}
 
-    //struct tms tbuf;
-    clock_t t0, t1;
+// lets the workers apply what is left in their queues and waits for them
+int OutCoreInterp::stopWorkers()
+{
+    if(pool == NULL)
+        return 0;
 
+    pool->done = true;
+    pool->threads.join_all();
 
-    /*
-    // managing overlap.
-    read adjacent blocks and store ghost cells and update the cells
+    bool failed = pool->failed;
+    for(size_t i = 0; i < pool->queues.size(); i++)
+        delete pool->queues[i];
+    delete pool;
+    pool = NULL;
 
-    merging multiple files
-    */
-    if(openFile != -1) {
-        gridMap[openFile]->getGridFile()->unmap();
-        openFile = -1;
+    return failed ? -1 : 0;
+}
+
+int OutCoreInterp::routePoint(int fileNum, const UpdateInfo& point)
+{
+    TileUpdate u;
+    u.fileNum = fileNum;
+    u.point = point;
+
+    boost::lockfree::spsc_queue<TileUpdate>& queue = *pool->queues[fileNum % num_workers];
+    int idle = 0;
+
+    while(!queue.push(u))
+    {
+        if(pool->failed)
+            return -1;
+        ingest_backoff(idle);
     }
 
-    ////////////////////////////////////////////////////////////
-    // flushing
-    // can be moved inside the communications
-    for(i = 0; i < numFiles; i++)
+    return 0;
+}
+
+// applies the points of one worker's queue to the tiles it owns, in the
+// order they were routed, then those still queued for its tiles
+void OutCoreInterp::ingestWorker(int worker)
+{
+    TileCache& cache = caches[worker];
+    boost::lockfree::spsc_queue<TileUpdate>& queue = *pool->queues[worker];
+    TileUpdate batch[256];
+    int idle = 0;
+
+    for(;;)
     {
-        if(qlist[i].size() != 0)
+        size_t n = queue.pop(batch, 256);
+
+        if(n == 0)
         {
-            if((gf = gridMap[i]->getGridFile()) == NULL)
+            // a point pushed before done was set is seen by this pop
+            if(pool->done && (n = queue.pop(batch, 256)) == 0)
+                break;
+            if(n == 0)
             {
-                cerr << "OutCoreInterp::finish() getGridFile() NULL" << endl;
-                return -1;
+                ingest_backoff(idle);
+                continue;
             }
+        }
 
-            gf->map();
-            openFile = i;
+        idle = 0;
+        for(size_t i = 0; i < n; i++)
+        {
+            if(applyPoint(batch[i].fileNum, batch[i].point, cache) < 0)
+            {
+                pool->failed = true;
+                return;
+            }
+        }
+    }
 
-            // flush UpdateInfo queue
-            // pop every update information
-            list<UpdateInfo>::const_iterator iter;
+    if(flushQueues(cache) < 0)
+        pool->failed = true;
+}
 
-            for(iter = qlist[i].begin(); iter!= qlist[i].end(); iter++) {
-                updateInterpArray(i, (*iter).data_x, (*iter).data_y, (*iter).data_z);
-            }
-            qlist[i].erase(qlist[i].begin(), qlist[i].end());
+// The requests of the tile I/O thread: (tile, prefetch) pairs, a
+// writeback when prefetch is false. The hints only open the tile's file
+// by name, so they never touch a mapping of the thread owning the tile.
+struct TileIO
+{
+    boost::mutex mutex;
+    boost::condition_variable ready;
+    std::deque< std::pair<int, bool> > requests;
+    boost::thread thread;
+    bool done;
+};
+
+void OutCoreInterp::startTileIO()
+{
+    tile_io = new TileIO;
+    tile_io->done = false;
+    tile_io->thread = boost::thread(boost::bind(&OutCoreInterp::tileIOThread, this));
+}
 
-            gf->unmap();
-            openFile = -1;
-            gf = NULL;
-        }
+// hints still pending are dropped, they would only slow down the rest
+void OutCoreInterp::stopTileIO()
+{
+    if(tile_io == NULL)
+        return;
+
+    {
+        boost::mutex::scoped_lock lock(tile_io->mutex);
+        tile_io->done = true;
     }
-    ////////////////////////////////////////////////////////////
+    tile_io->ready.notify_one();
+    tile_io->thread.join();
+
+    delete tile_io;
+    tile_io = NULL;
+}
 
-    for(i = 0; i < numFiles - 1; i++)
+void OutCoreInterp::requestTileIO(int fileNum, bool prefetch)
+{
+    if(tile_io == NULL)
+        return;
+
+    std::pair<int, bool> request(fileNum, prefetch);
     {
-        //////////////////////////////////////////////////////////////
-        // read the upside overlap
+        boost::mutex::scoped_lock lock(tile_io->mutex);
+
+        if(std::find(tile_io->requests.begin(), tile_io->requests.end(), request) != tile_io->requests.end())
+            return;
+        tile_io->requests.push_back(request);
+    }
+    tile_io->ready.notify_one();
+}
 
-        if((gf = gridMap[i]->getGridFile()) == NULL)
+void OutCoreInterp::tileIOThread()
+{
+    for(;;)
+    {
+        std::pair<int, bool> request;
         {
-            cerr << "OutCoreInterp::finish() getGridFile() NULL" << endl;
-            return -1;
+            boost::mutex::scoped_lock lock(tile_io->mutex);
+
+            while(tile_io->requests.empty() && !tile_io->done)
+                tile_io->ready.wait(lock);
+            if(tile_io->done)
+                return;
+
+            request = tile_io->requests.front();
+            tile_io->requests.pop_front();
         }
 
-        if(gf->map() != -1)
+        // a failed hint costs nothing but the overlap it was to bring
+        GridFile *gf = gridMap[request.first]->getGridFile();
+        if(request.second)
         {
-            openFile = i;
-            // Sriram's edit to copy over DEM values to overlap also
-            len_y = 2 * (gridMap[i]->getOverlapUpperBound() - gridMap[i]->getUpperBound() - 1);
+            if(gf->prefetch() == 0)
+                prefetches++;
+        }
+        else if(gf->writeback() == 0)
+            writebacks++;
+    }
+}
 
-            if((p = (GridPoint *)malloc(sizeof(GridPoint) * len_y * GRID_SIZE_X)) == NULL)
-            {
-                cerr << "OutCoreInterp::finish() malloc error" << endl;
-                return -1;
-            }
+int OutCoreInterp::update_batch(const double *data_x, const double *data_y, const double *data_z, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        if(OutCoreInterp::update(data_x[i], data_y[i], data_z[i]) < 0)
+            return -1;
+    }
 
-            int start = (gridMap[i]->getOverlapUpperBound() - gridMap[i]->getOverlapLowerBound() - len_y) * GRID_SIZE_X;
-            cerr << "copy from " << start << " to " << (start + len_y * GRID_SIZE_X) << endl;
+    return 0;
+}
 
-            memcpy(p, &(gf->interp[start]), sizeof(GridPoint) * len_y * (GRID_SIZE_X) );
+int OutCoreInterp::finish(const std::string& outputName, int outputFormat, unsigned int outputType)
+{
+    return finish(outputName, outputFormat, outputType, 0, 0);
+}
 
-            gf->unmap();
-            gf = NULL;
-            openFile = -1;
+int OutCoreInterp::finish(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt)
+{
+    int i;
 
-        } else {
-            cerr << "OutCoreInterp::finish() gf->map() error" << endl;
+    //struct tms tbuf;
+    clock_t t0, t1;
+
+    ////////////////////////////////////////////////////////////
+    // flushing
+    // the workers flush the queues of their own tiles as they stop
+    if(pool != NULL)
+    {
+        if(stopWorkers() < 0)
             return -1;
-        }
-        //////////////////////////////////////////////////////////////
+    } else if(flushQueues(caches[0]) < 0)
+        return -1;
+    stopTileIO();
+    ////////////////////////////////////////////////////////////
 
-        //////////////////////////////////////////////////////////////
-        // update (i+1)th component
-        if((gf = gridMap[i+1]->getGridFile()) == NULL)
+    cerr << "tile cache: " << getCacheHits() << " hits, " << getCacheMisses() << " misses, "
+         << getCacheEvictions() << " evictions, " << getPrefetches() << " prefetches, "
+         << getWritebacks() << " writebacks" << endl;
+
+    // from here on every tile is mapped only by the worker reconciling it,
+    // and the others read from its file; tiles no point reached get their
+    // file now
+    for(i = 0; i < numFiles; i++)
+    {
+        GridFile *gf = gridMap[i]->getGridFile();
+
+        if(!gf->isInitialized() && gf->map() < 0)
+        {
+            cerr << "OutCoreInterp::finish() map error" << endl;
+            return -1;
+        }
+        if(gf->unmap() < 0)
         {
-            cerr << "OutCoreInterp::finish() getGridFile() NULL" << endl;
+            cerr << "OutCoreInterp::finish() unmap error" << endl;
             return -1;
         }
+    }
+    for(i = 0; i < num_workers; i++)
+        caches[i].num_resident = 0;
+
+    if(reconcileHalos() < 0)
+        return -1;
 
-        if(gf->map() != -1)
+    if(grid_file_io != GRID_FILE_MMAP)
+    {
+        unsigned long long bytes_read = 0, bytes_written = 0;
+        double seconds = 0;
+        int direct = 0;
+        for(i = 0; i < numFiles; i++)
         {
-            offset = 0;
-            openFile = i - 1;
+            GridFile *gf = gridMap[i]->getGridFile();
+            bytes_read += gf->getBytesRead();
+            bytes_written += gf->getBytesWritten();
+            seconds += gf->getIOSeconds();
+            if(gf->getIOMode() == GRID_FILE_DIRECT)
+                direct++;
+        }
+        cerr << "tile I/O: " << bytes_read / (1024 * 1024) << " MB read, " << bytes_written / (1024 * 1024)
+             << " MB written, " << seconds << " s, " << direct << " of " << numFiles << " files O_DIRECT" << endl;
+    }
 
-            for(j = 0; j < len_y * GRID_SIZE_X; j++)
-            {
-                if(gf->interp[j + offset].Zmin > p[j].Zmin)
-                    gf->interp[j + offset].Zmin = p[j].Zmin;
-
-                if(gf->interp[j + offset].Zmax < p[j].Zmax)
-                    gf->interp[j + offset].Zmax = p[j].Zmax;
-
-                gf->interp[j + offset].Zmean += p[j].Zmean;
-                gf->interp[j + offset].count += p[j].count;
-
-		/*
-		// https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
-		double delta = p[j].Zstd_tmp - p[j].Zstd_tmp;
-		gf->interp[j + offset].Zstd_tmp += delta / gf->interp[j + offset].count;
-		gf->interp[j + offset].Zstd += delta * (
-		interp[x][y].Zstd += delta * (data_z-interp[x][y].Zstd_tmp);
-
-		gf->interp[j + offset].Zstd += p[j].Zstd;
-                gf->interp[j + offset].Zstd_tmp += p[j].Zstd_tmp;
-		*/
-
-                if (p[j].sum != -1) {
-                    gf->interp[j + offset].Zidw += p[j].Zidw;
-                    gf->interp[j + offset].sum += p[j].sum;
-                } else {
-                    gf->interp[j + offset].Zidw = p[j].Zidw;
-                    gf->interp[j + offset].sum = p[j].sum;
-                }
-            }
+    t0 = clock();
+    //t0 = times(&tbuf);
 
-            if(p != NULL) {
-                free(p);
-                p = NULL;
-            }
+    // merge pieces into one file
+    if(outputFile(outputName, outputFormat, outputType, adfGeoTransform, wkt) < 0)
+    {
+        cerr << "OutCoreInterp::finish outputFile error" << endl;
+        return -1;
+    }
 
-            gf->unmap();
-            gf = NULL;
-            openFile = -1;
+    t1 = clock();
+    //t1 = times(&tbuf);
+    cerr << "Output Execution time: " << (double)(t1 - t0)/CLOCKS_PER_SEC << std::endl;
 
-        } else {
-            cerr << "OutCoreInterp::finish() gf->map() error" << endl;
-            return -1;
-        }
-        //////////////////////////////////////////////////////////////
+    return 0;
+}
+
+unsigned long OutCoreInterp::getCacheHits() const
+{
+    unsigned long n = 0;
+    for(size_t i = 0; i < caches.size(); i++)
+        n += caches[i].hits;
+    return n;
+}
+
+unsigned long OutCoreInterp::getCacheMisses() const
+{
+    unsigned long n = 0;
+    for(size_t i = 0; i < caches.size(); i++)
+        n += caches[i].misses;
+    return n;
+}
+
+unsigned long OutCoreInterp::getCacheEvictions() const
+{
+    unsigned long n = 0;
+    for(size_t i = 0; i < caches.size(); i++)
+        n += caches[i].evictions;
+    return n;
+}
+
+// folds the cells of one tile's halo into the interior of another, as if
+// the interior cells had seen the points of both tiles
+static void merge_grid_point(GridPoint& dst, const GridPoint& src)
+{
+    // the min and max of a cell no point reached are not values
+    if(src.count != 0) {
+        span_cell_min(dst.Zmin, dst.count, src.Zmin);
+        span_cell_max(dst.Zmax, dst.count, src.Zmax);
+    }
+
+    dst.Zmean += src.Zmean;
+    dst.count += src.count;
+
+    // sum == -1 marks a point on the cell center, whose z is the idw value
+    if(dst.sum == -1)
+        return;
+
+    if(src.sum == -1) {
+        dst.Zidw = src.Zidw;
+        dst.sum = src.sum;
+    } else {
+        dst.Zidw += src.Zidw;
+        dst.sum += src.sum;
+    }
+}
+
+static int seek_file(FILE *fp, long long offset)
+{
+#ifdef _WIN32
+    return _fseeki64(fp, offset, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// reads the cells [x0, x1] x [y0, y1] of an unmapped tile from its file
+// into buffer, row by row
+int OutCoreInterp::readRegion(int fileNum, int x0, int x1, int y0, int y1, vector<GridPoint>& buffer)
+{
+    GridMap *m = gridMap[fileNum];
+    std::string name = m->getGridFile()->getFileName();
+    int width = m->getOverlapRightBound() - m->getOverlapLeftBound() + 1;
+    size_t len_x = x1 - x0 + 1;
+
+    FILE *fp = fopen(name.c_str(), "rb");
+    if(fp == NULL)
+    {
+        cerr << "File open error: " << name << endl;
+        return -1;
     }
 
-    for(i = numFiles -1; i > 0; i--)
+    buffer.resize(len_x * (y1 - y0 + 1));
+    for(int j = y0; j <= y1; j++)
     {
-        //////////////////////////////////////////////////////////////
-        // read the downside overlap
+        long long offset = ((long long)(j - m->getOverlapLowerBound()) * width +
+                            (x0 - m->getOverlapLeftBound())) * sizeof(GridPoint);
 
-        if((gf = gridMap[i]->getGridFile()) == NULL)
+        if(seek_file(fp, offset) != 0 || fread(&buffer[(size_t)(j - y0) * len_x], sizeof(GridPoint), len_x, fp) != len_x)
         {
-            cerr << "GridFile is NULL" << endl;
+            cerr << "OutCoreInterp::readRegion() read error: " << name << endl;
+            fclose(fp);
             return -1;
         }
+    }
+
+    fclose(fp);
+    return 0;
+}
 
-        if(gf->map() != -1)
+// the tiles whose interiors meet the halo of a tile, which are the ones
+// whose halos meet its interior
+void OutCoreInterp::tileNeighbours(int fileNum, vector<int>& neighbours) const
+{
+    GridMap *m = gridMap[fileNum];
+    int first_x = m->getOverlapLeftBound() / local_grid_size_x;
+    int last_x = m->getOverlapRightBound() / local_grid_size_x;
+    int first_y = m->getOverlapLowerBound() / local_grid_size_y;
+    int last_y = m->getOverlapUpperBound() / local_grid_size_y;
+
+    neighbours.clear();
+    for(int ny = first_y; ny <= last_y; ny++)
+    {
+        for(int nx = first_x; nx <= last_x; nx++)
         {
-            openFile = i;
-            len_y = 2 * (gridMap[i]->getLowerBound() - gridMap[i]->getOverlapLowerBound());
+            if(ny * tiles_x + nx != fileNum)
+                neighbours.push_back(ny * tiles_x + nx);
+        }
+    }
+}
 
-            if((p = (GridPoint *)malloc(sizeof(GridPoint) * len_y * GRID_SIZE_X)) == NULL)
-            {
-                cerr << "OutCoreInterp::finish() malloc error" << endl;
-                return -1;
-            }
+// One of the two visits reconcileHalos() makes to a tile, with the tile
+// mapped and its neighbours read from their files.
+// into_interior: adds the halo cells the neighbours hold over the tile's
+// interior, then divides the interior sums. Otherwise: overwrites the halo
+// with the neighbours' divided interiors, then fills the interior's nulls.
+int OutCoreInterp::reconcileTile(int fileNum, bool into_interior, vector<GridPoint>& buffer)
+{
+    vector<int> neighbours;
+    GridMap *target = gridMap[fileNum];
+    GridFile *gf = target->getGridFile();
 
-            memcpy(p, &(gf->interp[0]), len_y * sizeof(GridPoint) * GRID_SIZE_X);
+    if(gf->map() < 0)
+    {
+        cerr << "OutCoreInterp::reconcileTile() map error" << endl;
+        return -1;
+    }
 
-            //finalize();
+    int left = target->getOverlapLeftBound();
+    int width = target->getOverlapRightBound() - left + 1;
 
-            gf->unmap();
-            gf = NULL;
-            openFile = -1;
+    tileNeighbours(fileNum, neighbours);
+    for(size_t k = 0; k < neighbours.size(); k++)
+    {
+        GridMap *source = gridMap[neighbours[k]];
+        int x0, x1, y0, y1;
+        if(into_interior)
+        {
+            x0 = max(source->getOverlapLeftBound(), target->getLeftBound());
+            x1 = min(source->getOverlapRightBound(), target->getRightBound());
+            y0 = max(source->getOverlapLowerBound(), target->getLowerBound());
+            y1 = min(source->getOverlapUpperBound(), target->getUpperBound());
         } else {
-            cerr << "OutCoreInterp::finish gf->map() error" << endl;
-            return -1;
+            x0 = max(source->getLeftBound(), target->getOverlapLeftBound());
+            x1 = min(source->getRightBound(), target->getOverlapRightBound());
+            y0 = max(source->getLowerBound(), target->getOverlapLowerBound());
+            y1 = min(source->getUpperBound(), target->getOverlapUpperBound());
         }
-        //////////////////////////////////////////////////////////////
+        if(x0 > x1 || y0 > y1)
+            continue;
 
-        //////////////////////////////////////////////////////////////
-        // update (i-1)th component
-        if((gf = gridMap[i-1]->getGridFile()) == NULL)
+        if(readRegion(neighbours[k], x0, x1, y0, y1, buffer) < 0)
         {
-            cerr << "GridFile is NULL" << endl;
+            gf->unmap();
             return -1;
         }
 
-        if(gf->map() != -1)
+        int len_x = x1 - x0 + 1;
+        for(int j = y0; j <= y1; j++)
         {
-            offset = (gridMap[i-1]->getOverlapUpperBound() - gridMap[i-1]->getOverlapLowerBound() - len_y) * GRID_SIZE_X;
-            openFile = i - 1;
+            GridPoint *row = gf->interp + (size_t)(j - target->getOverlapLowerBound()) * width + (x0 - left);
+            const GridPoint *src = &buffer[(size_t)(j - y0) * len_x];
 
-            for(j = 0; j < len_y * GRID_SIZE_X; j++)
+            if(into_interior)
             {
-                // Sriram - the overlap already contains the correct values
-                gf->interp[j + offset].Zmin = p[j].Zmin;
-                gf->interp[j + offset].Zmax = p[j].Zmax;
-                gf->interp[j + offset].Zmean = p[j].Zmean;
-                gf->interp[j + offset].count = p[j].count;
-                gf->interp[j + offset].Zidw = p[j].Zidw;
-                gf->interp[j + offset].sum = p[j].sum;
-		//gf->interp[j + offset].Zstd = p[j].Zstd;
-		//gf->interp[j + offset].Zstd_tmp = p[j].Zstd_tmp;
-            }
+                for(int i = 0; i < len_x; i++)
+                    merge_grid_point(row[i], src[i]);
+            } else
+                memcpy(row, src, sizeof(GridPoint) * len_x);
+        }
+    }
 
-            //if(i - 1 == 0)
-            //finalize();
+    if(into_interior)
+        divideCells(fileNum);
+    else
+        fillCells(fileNum);
 
-            if(p != NULL) {
-                free(p);
-                p = NULL;
-            }
+    if(gf->unmap() < 0)
+    {
+        cerr << "OutCoreInterp::reconcileTile() unmap error" << endl;
+        return -1;
+    }
+    return 0;
+}
 
-            gf->unmap();
-            gf = NULL;
-            openFile = -1;
+// The tasks of reconcileHalos(): the first visit to every tile can run at
+// once, as it writes only the tile's interior and reads only the halos
+// of the others. The second visit to a tile writes its halo and reads
+// its neighbours' interiors, so it waits for the first visits to the
+// tile and to all of its neighbours.
+struct ReconcileQueue
+{
+    boost::mutex mutex;
+    boost::condition_variable ready;
+
+    // (tile, first visit) pairs ready to run
+    std::deque< std::pair<int, bool> > tasks;
+
+    // first visits the second visit to a tile still waits for
+    std::vector<int> waiting;
+    std::vector< std::vector<int> > neighbours;
+
+    int remaining;
+    bool failed;
+};
+
+void OutCoreInterp::reconcileWorker(ReconcileQueue *queue)
+{
+    vector<GridPoint> buffer;
+
+    for(;;)
+    {
+        std::pair<int, bool> task;
+        {
+            boost::mutex::scoped_lock lock(queue->mutex);
+
+            while(queue->tasks.empty() && queue->remaining > 0 && !queue->failed)
+                queue->ready.wait(lock);
+            if(queue->remaining == 0 || queue->failed)
+                return;
+
+            task = queue->tasks.front();
+            queue->tasks.pop_front();
+        }
+
+        int status = reconcileTile(task.first, task.second, buffer);
+
+        {
+            boost::mutex::scoped_lock lock(queue->mutex);
+
+            queue->remaining--;
+            if(status < 0)
+                queue->failed = true;
+            else if(task.second)
+            {
+                const vector<int>& next = queue->neighbours[task.first];
+
+                if(--queue->waiting[task.first] == 0)
+                    queue->tasks.push_back(std::make_pair(task.first, false));
+                for(size_t k = 0; k < next.size(); k++)
+                {
+                    if(--queue->waiting[next[k]] == 0)
+                        queue->tasks.push_back(std::make_pair(next[k], false));
+                }
+            }
         }
-        //////////////////////////////////////////////////////////////
+        queue->ready.notify_all();
     }
+}
+
+// Managing overlap: every interior cell collects what the points of the
+// neighbouring tiles left in their halos, then every halo takes the
+// complete cells of its neighbours for the null filling. Each tile is
+// mapped twice, by one of up to num_threads workers, as many as the
+// memory budget holds tiles.
+int OutCoreInterp::reconcileHalos()
+{
+    int i;
+    ReconcileQueue queue;
 
+    queue.neighbours.resize(numFiles);
+    queue.waiting.resize(numFiles);
     for(i = 0; i < numFiles; i++)
     {
-        gridMap[i]->getGridFile()->map();
-        openFile = i;
-        finalize();
-        gridMap[i]->getGridFile()->unmap();
-        openFile = -1;
+        tileNeighbours(i, queue.neighbours[i]);
+        queue.waiting[i] = (int)queue.neighbours[i].size() + 1;
+        queue.tasks.push_back(std::make_pair(i, true));
     }
+    queue.remaining = 2 * numFiles;
+    queue.failed = false;
 
-
-
-    t0 = clock();
-    //t0 = times(&tbuf);
-
-    // merge pieces into one file
-    if(outputFile(outputName, outputFormat, outputType, adfGeoTransform, wkt) < 0)
+    int workers = min(min(num_threads, max_resident), numFiles);
+    if(workers > 1)
     {
-        cerr << "OutCoreInterp::finish outputFile error" << endl;
+        boost::thread_group threads;
+        for(i = 1; i < workers; i++)
+            threads.create_thread(boost::bind(&OutCoreInterp::reconcileWorker, this, &queue));
+        reconcileWorker(&queue);
+        threads.join_all();
+    } else
+        reconcileWorker(&queue);
+
+    if(queue.failed)
+    {
+        cerr << "OutCoreInterp::reconcileHalos() error" << endl;
         return -1;
     }
 
-    t1 = clock();
-    //t1 = times(&tbuf);
-    cerr << "Output Execution time: " << (double)(t1 - t0)/CLOCKS_PER_SEC << std::endl;
-
     return 0;
 }
 
@@ -539,206 +1112,304 @@ void OutCoreInterp::isUserDefinedGrid(bool defined) {
     user_defined_grid = defined;
 }
 
-void OutCoreInterp::updateInterpArray(int fileNum, double data_x, double data_y, double data_z)
+void OutCoreInterp::updateInterpArray(int fileNum, double data_x, double data_y, double data_z, StencilCover& cover)
 {
-    double x;
-    double y;
+    GridMap *m = gridMap[fileNum];
+    GridFile *gf = m->getGridFile();
 
-    int lower_grid_x;
-    int lower_grid_y;
+    if(gf == NULL || gf->interp == NULL)
+    {
+        //cout << "OutCoreInterp::updateInterpArray() gridFile is NULL" << endl;
+        return;
+    }
 
-    lower_grid_x = (int)floor((double)data_x/GRID_DIST_X); // global/local coordinate
-    lower_grid_y = (int)floor((double)data_y/GRID_DIST_Y); // global coordinate
+    // the tile file holds its halo too, so its origin is the halo's corner
+    int lb = m->getOverlapLowerBound();
+    int left = m->getOverlapLeftBound();
+    int width = m->getOverlapRightBound() - left + 1;
 
-    x = data_x - lower_grid_x * GRID_DIST_X;
-    y = data_y - lower_grid_y * GRID_DIST_Y;
+    stencil.cover(data_x, data_y, left, m->getOverlapRightBound() + 1, lb, m->getOverlapUpperBound() + 1, cover);
 
-    //if(lower_grid_y == 30 && data_y > GRID_DIST_Y * lower_grid_y)
-    //printf("(%f %f) = (%d, %d)\n", data_x, data_y, lower_grid_x, lower_grid_y);
+    for(int s = 0; s < cover.num_spans; s++)
+    {
+        const StencilSpan& span = cover.spans[s];
+        GridPoint *row = gf->interp + (size_t)(span.row - lb) * width;
 
-    // if the opened file is not the 0th file, then you have to consider the offset of the grid of the file!!!
-    lower_grid_y -= gridMap[fileNum]->getOverlapLowerBound(); // local coordinate
+        for(int i = span.first; i <= span.last; i++)
+            updateGridPoint(row[i - left], data_z, cover.distance_sqr(span, i));
+    }
+}
 
-    //cout << fileNum << ":(" << lower_grid_x << "," << lower_grid_y << ")" << endl;
+void OutCoreInterp::updateGridPoint(GridPoint& gp, double data_z, double distance_sqr)
+{
+    span_cell_min(gp.Zmin, gp.count, data_z);
+    span_cell_max(gp.Zmax, gp.count, data_z);
 
-    update_first_quadrant(fileNum, data_z, lower_grid_x + 1, lower_grid_y + 1, GRID_DIST_X -x, GRID_DIST_Y - y);
-    update_second_quadrant(fileNum, data_z, lower_grid_x, lower_grid_y + 1, x, GRID_DIST_Y - y);
-    update_third_quadrant(fileNum, data_z, lower_grid_x, lower_grid_y, x, y);
-    update_fourth_quadrant(fileNum, data_z, lower_grid_x + 1, lower_grid_y, GRID_DIST_X - x, y);
-}
+    gp.Zmean += data_z;
+    gp.count++;
 
+    /*
+    // same as InCoreInterp::updateGridPoint
+    double delta = data_z - gp.Zstd_tmp;
+    gp.Zstd_tmp += delta/gp.count;
+    gp.Zstd += delta * (data_z - gp.Zstd_tmp);
+    */
 
-void OutCoreInterp::update_first_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y)
-{
-    // base_x, base_y: local coordinates
+    double dist;
+    if (idw_int_power >= 0)
+        dist = span_weight(distance_sqr, idw_int_power);
+    else
+        dist = pow(sqrt(distance_sqr), idw_power);
 
-    int i;
-    int j;
-    int ub = gridMap[fileNum]->getOverlapUpperBound() - gridMap[fileNum]->getOverlapLowerBound();
-    //int ub = gridMap[fileNum]->getOverlapUpperBound();
-    //cout << "fileNum: " << fileNum << " ub: " << ub << endl;
-    //double temp;
+    span_cell_idw(gp.Zidw, gp.sum, dist, data_z);
+}
 
-    //printf("radius: %f ", radius_sqrt);
+// prints the rows of the open ArcGIS and Grid ASCII files, reading the
+// tiles row by row straight from their files, top down
+int OutCoreInterp::writeRows(FILE **arcFiles, FILE **gridFiles, bool report)
+{
+    int j, k, l, t;
+    int numTypes = 6;
+    vector<GridPoint> row(GRID_SIZE_X);
+    vector<FILE *> tileFiles;
 
-    for(i = base_x; i < GRID_SIZE_X; i++)
+    for(t = tiles_y - 1; t >= 0; t--)
     {
-        for(j = base_y; j < ub; j++)
+        if(openTileRow(t, tileFiles) < 0)
+            return -1;
+
+        int start = gridMap[t * tiles_x]->getLowerBound();
+        int end = gridMap[t * tiles_x]->getUpperBound() + 1;
+
+        if(report)
+            cerr << "Merging tile row " << t << ": from " << (start) << " to " << (end) << endl;
+
+        for(j = end - 1; j >= start; j--)
         {
-            // i, j, base_x, base_y: local coordinates
-            double distance = 	((i - base_x)*GRID_DIST_X + x) * ((i - base_x)*GRID_DIST_X + x) +
-                                ((j - base_y)*GRID_DIST_Y + y) * ((j - base_y)*GRID_DIST_Y + y) ;
+            if(readGridRow(j, tileFiles, row) < 0)
+            {
+                closeTileRow(tileFiles);
+                return -1;
+            }
+
+            for(k = 0; k < GRID_SIZE_X; k++)
+            {
+                if(arcFiles != NULL)
+                {
+                    // Zmin
+                    if(arcFiles[0] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            //if(gf->interp[k][j].Zmin == 0)
+                            fprintf(arcFiles[0], "-9999 ");
+                        else
+                            //fprintf(arcFiles[0], "%f ", gf->interp[j][i].Zmin);
+                            fprintf(arcFiles[0], "%f ", row[k].Zmin);
+                    }
+
+                    // Zmax
+                    if(arcFiles[1] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(arcFiles[1], "-9999 ");
+                        else
+                            fprintf(arcFiles[1], "%f ", row[k].Zmax);
+                    }
+
+                    // Zmean
+                    if(arcFiles[2] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(arcFiles[2], "-9999 ");
+                        else
+                            fprintf(arcFiles[2], "%f ", row[k].Zmean);
+                    }
+
+                    // Zidw
+                    if(arcFiles[3] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(arcFiles[3], "-9999 ");
+                        else
+                            fprintf(arcFiles[3], "%f ", row[k].Zidw);
+                    }
+
+                    // count
+                    if(arcFiles[4] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(arcFiles[4], "-9999 ");
+                        else
+                            fprintf(arcFiles[4], "%d ", row[k].count);
+                    }
+
+                    // Zstd
+                    if(arcFiles[5] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(arcFiles[5], "-9999 ");
+                        else
+                            fprintf(arcFiles[5], "%f ", row[k].Zstd);
+                    }
+                }
+
+                if(gridFiles != NULL)
+                {
+                    // Zmin
+                    if(gridFiles[0] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(gridFiles[0], "-9999 ");
+                        else
+                            fprintf(gridFiles[0], "%f ", row[k].Zmin);
+                    }
+
+                    // Zmax
+                    if(gridFiles[1] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(gridFiles[1], "-9999 ");
+                        else
+                            fprintf(gridFiles[1], "%f ", row[k].Zmax);
+                    }
+
+                    // Zmean
+                    if(gridFiles[2] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(gridFiles[2], "-9999 ");
+                        else
+                            fprintf(gridFiles[2], "%f ", row[k].Zmean);
+                    }
+
+                    // Zidw
+                    if(gridFiles[3] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(gridFiles[3], "-9999 ");
+                        else
+                            fprintf(gridFiles[3], "%f ", row[k].Zidw);
+                    }
+
+                    // count
+                    if(gridFiles[4] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(gridFiles[4], "-9999 ");
+                        else
+                            fprintf(gridFiles[4], "%d ", row[k].count);
+                    }
+
+                    // Zstd
+                    if(gridFiles[5] != NULL)
+                    {
+                        if(row[k].empty == 0 &&
+                                row[k].filled == 0)
+                            fprintf(gridFiles[5], "-9999 ");
+                        else
+                            fprintf(gridFiles[5], "%f ", row[k].Zstd);
+                    }
+		}
+            }
 
-            if(distance <= radius_sqr)
-            {
-                // update GridPoint
-                updateGridPoint(fileNum, i, j, data_z, sqrt(distance));
+            if(arcFiles != NULL)
+                for(l = 0; l < numTypes; l++)
+                {
+                    if(arcFiles[l] != NULL)
+                        fprintf(arcFiles[l], "\n");
+                }
 
-            } else if(j == base_y) {
-                //printf("return ");
-                return;
-            } else {
-                //printf("break ");
-                break;
-            }
+            if(gridFiles != NULL)
+                for(l = 0; l < numTypes; l++)
+                {
+                    if(gridFiles[l] != NULL)
+                        fprintf(gridFiles[l], "\n");
+                }
         }
+
+        closeTileRow(tileFiles);
     }
+
+    return 0;
 }
 
+void OutCoreInterp::writeRowsWorker(FILE **arcFiles, FILE **gridFiles, int *status)
+{
+    *status = writeRows(arcFiles, gridFiles, false);
+}
 
-void OutCoreInterp::update_second_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y)
+// writeRows() for all the files, which with several threads are shared
+// out among them; each thread reads the tiles for itself
+int OutCoreInterp::writeFiles(FILE **arcFiles, FILE **gridFiles)
 {
-    int i;
-    int j;
-    int ub = gridMap[fileNum]->getOverlapUpperBound() - gridMap[fileNum]->getOverlapLowerBound();
-    //int ub = gridMap[fileNum]->getOverlapUpperBound();
+    int i, w;
+    int numTypes = 6;
+    int numOpen = 0;
 
-    for(i = base_x; i >= 0; i--)
+    for(i = 0; i < numTypes; i++)
     {
-        for(j = base_y; j < ub; j++)
-        {
-            double distance = 	((base_x - i)*GRID_DIST_X + x) * ((base_x - i)*GRID_DIST_X + x) +
-                                ((j - base_y)*GRID_DIST_Y + y) * ((j - base_y)*GRID_DIST_Y + y);
-
-            if(distance <= radius_sqr)
-            {
-                //printf("(%d %d) ", i, j);
-                //interp[i][j]++;
-
-                updateGridPoint(fileNum, i, j, data_z, sqrt(distance));
-
-            } else if(j == base_y) {
-                return;
-            } else {
-                break;
-            }
-        }
+        if(arcFiles != NULL && arcFiles[i] != NULL)
+            numOpen++;
+        if(gridFiles != NULL && gridFiles[i] != NULL)
+            numOpen++;
     }
 
-}
-
+    int workers = min(num_threads, numOpen);
+    if(workers <= 1)
+        return writeRows(arcFiles, gridFiles, true);
 
-void OutCoreInterp::update_third_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y)
-{
-    int i;
-    int j;
-    //int lb = gridMap[fileNum]->getOverlapLowerBound();
+    vector< vector<FILE *> > arcs(workers, vector<FILE *>(numTypes, (FILE *)NULL));
+    vector< vector<FILE *> > grids(workers, vector<FILE *>(numTypes, (FILE *)NULL));
+    vector<int> status(workers, 0);
 
-    for(i = base_x; i >= 0; i--)
+    w = 0;
+    for(i = 0; i < numTypes; i++)
     {
-        //for(j = base_y; j >= lb; j--)
-        for(j = base_y; j >= 0; j--)
+        if(arcFiles != NULL && arcFiles[i] != NULL)
         {
-            double distance = 	((base_x - i)*GRID_DIST_X + x) * ((base_x - i)*GRID_DIST_X + x) +
-                                ((base_y - j)*GRID_DIST_Y + y) * ((base_y - j)*GRID_DIST_Y + y);
-
-            if(distance <= radius_sqr)
-            {
-                updateGridPoint(fileNum, i, j, data_z, sqrt(distance));
-            } else if(j == base_y) {
-                return;
-            } else {
-                break;
-            }
+            arcs[w][i] = arcFiles[i];
+            w = (w + 1) % workers;
         }
-    }
-}
-
-void OutCoreInterp::update_fourth_quadrant(int fileNum, double data_z, int base_x, int base_y, double x, double y)
-{
-    int i, j;
-    //int lb = gridMap[fileNum]->getOverlapLowerBound();
-
-    for(i = base_x; i < GRID_SIZE_X; i++)
-    {
-        //for(j = base_y; j >= lb; j--)
-        for(j = base_y; j >= 0; j--)
+        if(gridFiles != NULL && gridFiles[i] != NULL)
         {
-            double distance = 	((i - base_x)*GRID_DIST_X + x) * ((i - base_x)*GRID_DIST_X + x) +
-                                ((base_y - j)*GRID_DIST_Y + y) * ((base_y - j)*GRID_DIST_Y + y);
-
-            if(distance <= radius_sqr)
-            {
-                //printf("(%d %d) ", i, j);
-                //interp[i][j]++;
-                updateGridPoint(fileNum, i, j, data_z, sqrt(distance));
-            } else if (j == base_y) {
-                return ;
-            } else {
-                break;
-            }
+            grids[w][i] = gridFiles[i];
+            w = (w + 1) % workers;
         }
     }
-}
 
-void OutCoreInterp::updateGridPoint(int fileNum, int x, int y, double data_z, double distance)
-{
-    unsigned int coord = y * local_grid_size_x + x;
-    GridFile *gf = gridMap[fileNum]->getGridFile();
+    cerr << "Writing " << numOpen << " files on " << workers << " threads" << endl;
 
-    if(gf == NULL || gf->interp == NULL || x >= local_grid_size_x)
-    {
-        //cout << "OutCoreInterp::updateGridPoint() gridFile is NULL" << endl;
-        return;
-    }
+    boost::thread_group threads;
+    for(w = 0; w < workers; w++)
+        threads.create_thread(boost::bind(&OutCoreInterp::writeRowsWorker, this,
+                                          arcFiles != NULL ? &arcs[w][0] : (FILE **)NULL,
+                                          gridFiles != NULL ? &grids[w][0] : (FILE **)NULL,
+                                          &status[w]));
+    threads.join_all();
 
-    if(coord < gf->getMemSize())
+    for(w = 0; w < workers; w++)
     {
-        if(gf->interp[coord].Zmin > data_z)
-            gf->interp[coord].Zmin = data_z;
-        if(gf->interp[coord].Zmax < data_z)
-            gf->interp[coord].Zmax = data_z;
-
-        gf->interp[coord].Zmean += data_z;
-        gf->interp[coord].count++;
-
-	/*
-	// same as InCoreInterp::updateGridPoint
-	double delta = data_z - gf->interp[coord].Zstd_tmp;
-	gf->interp[coord].Zstd_tmp += delta/gf->interp[coord].count;
-	gf->interp[coord].Zstd += delta * (data_z - gf->interp[coord].Zstd_tmp);
-	*/
-
-    double dist = pow(distance, Interpolation::WEIGHTER);
-        if (gf->interp[coord].sum != -1) {
-            if (dist != 0) {
-                gf->interp[coord].Zidw += data_z/dist;
-                gf->interp[coord].sum += 1/dist;
-            } else {
-                gf->interp[coord].Zidw = data_z;
-                gf->interp[coord].sum = -1;
-            }
-        } else {
-            // do nothing
-        }
-    } else {
-        cerr << "OutCoreInterp::updateGridPoint() Memory Access Violation! " << endl;
+        if(status[w] < 0)
+            return -1;
     }
+
+    return 0;
 }
 
 int OutCoreInterp::outputFile(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt)
 {
-    int i, j, k, l, t;
+    int i;
 
     FILE **arcFiles;
     char arcFileName[1024];
@@ -845,176 +1516,15 @@ int OutCoreInterp::outputFile(const std::string& outputName, int outputFormat, u
         }
     }
 
-    for(i = numFiles -1; i >= 0; i--)
-    {
-        GridFile *gf = gridMap[i]->getGridFile();
-        gf->map();
-
-        int start = gridMap[i]->getLowerBound() - gridMap[i]->getOverlapLowerBound();
-        int end = gridMap[i]->getUpperBound() - gridMap[i]->getOverlapLowerBound() + 1;
-
-        //int start = (gridMap[i]->getLowerBound() - gridMap[i]->getOverlapLowerBound()) * GRID_SIZE_X;
-        //int end = (gridMap[i]->getUpperBound() - gridMap[i]->getOverlapLowerBound() + 1) * GRID_SIZE_X;
-
-        cerr << "Merging " << i << ": from " << (start) << " to " << (end) << endl;
-        cerr << "        " << i << ": from " << (start/GRID_SIZE_X) << " to " << (end/GRID_SIZE_X) << endl;
-
-        for(j = end - 1; j >= start; j--)
-        {
-            for(k = 0; k < GRID_SIZE_X; k++)
-            {
-                int index = j * GRID_SIZE_X + k;
-
-                if(arcFiles != NULL)
-                {
-                    // Zmin
-                    if(arcFiles[0] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            //if(gf->interp[k][j].Zmin == 0)
-                            fprintf(arcFiles[0], "-9999 ");
-                        else
-                            //fprintf(arcFiles[0], "%f ", gf->interp[j][i].Zmin);
-                            fprintf(arcFiles[0], "%f ", gf->interp[index].Zmin);
-                    }
-
-                    // Zmax
-                    if(arcFiles[1] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(arcFiles[1], "-9999 ");
-                        else
-                            fprintf(arcFiles[1], "%f ", gf->interp[index].Zmax);
-                    }
-
-                    // Zmean
-                    if(arcFiles[2] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(arcFiles[2], "-9999 ");
-                        else
-                            fprintf(arcFiles[2], "%f ", gf->interp[index].Zmean);
-                    }
-
-                    // Zidw
-                    if(arcFiles[3] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(arcFiles[3], "-9999 ");
-                        else
-                            fprintf(arcFiles[3], "%f ", gf->interp[index].Zidw);
-                    }
-
-                    // count
-                    if(arcFiles[4] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(arcFiles[4], "-9999 ");
-                        else
-                            fprintf(arcFiles[4], "%d ", gf->interp[index].count);
-                    }
-
-                    // Zstd
-                    if(arcFiles[5] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(arcFiles[5], "-9999 ");
-                        else
-                            fprintf(arcFiles[5], "%f ", gf->interp[index].Zstd);
-                    }
-                }
-
-                if(gridFiles != NULL)
-                {
-                    // Zmin
-                    if(gridFiles[0] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(gridFiles[0], "-9999 ");
-                        else
-                            fprintf(gridFiles[0], "%f ", gf->interp[index].Zmin);
-                    }
-
-                    // Zmax
-                    if(gridFiles[1] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(gridFiles[1], "-9999 ");
-                        else
-                            fprintf(gridFiles[1], "%f ", gf->interp[index].Zmax);
-                    }
-
-                    // Zmean
-                    if(gridFiles[2] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(gridFiles[2], "-9999 ");
-                        else
-                            fprintf(gridFiles[2], "%f ", gf->interp[index].Zmean);
-                    }
-
-                    // Zidw
-                    if(gridFiles[3] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(gridFiles[3], "-9999 ");
-                        else
-                            fprintf(gridFiles[3], "%f ", gf->interp[index].Zidw);
-                    }
-
-                    // count
-                    if(gridFiles[4] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(gridFiles[4], "-9999 ");
-                        else
-                            fprintf(gridFiles[4], "%d ", gf->interp[index].count);
-                    }
-
-                    // Zstd
-                    if(gridFiles[5] != NULL)
-                    {
-                        if(gf->interp[index].empty == 0 &&
-                                gf->interp[index].filled == 0)
-                            fprintf(gridFiles[5], "-9999 ");
-                        else
-                            fprintf(gridFiles[5], "%f ", gf->interp[index].Zstd);
-                    }
-		}
-            }
-
-            if(arcFiles != NULL)
-                for(l = 0; l < numTypes; l++)
-                {
-                    if(arcFiles[l] != NULL)
-                        fprintf(arcFiles[l], "\n");
-                }
-
-            if(gridFiles != NULL)
-                for(l = 0; l < numTypes; l++)
-                {
-                    if(gridFiles[l] != NULL)
-                        fprintf(gridFiles[l], "\n");
-                }
-        }
-
-        gf->unmap();
-    }
+    if(writeFiles(arcFiles, gridFiles) < 0)
+        return -1;
 
 #ifdef HAVE_GDAL
+    int j, k, t;
     GDALDataset **gdalFiles;
     char gdalFileName[1024];
+    vector<GridPoint> row(GRID_SIZE_X);
+    vector<FILE *> tileFiles;
 
     // open GDAL GeoTIFF files
     if(outputFormat == OUTPUT_FORMAT_GDAL_GTIFF || outputFormat == OUTPUT_FORMAT_ALL)
@@ -1084,72 +1594,77 @@ int OutCoreInterp::outputFile(const std::string& outputName, int outputFormat, u
         {
             if(gdalFiles[t] != NULL)
             {
-                for(i = numFiles -1; i >= 0; i--)
-                {
-                    GridFile *gf = gridMap[i]->getGridFile();
-                    gf->map();
-
-                    int start = gridMap[i]->getLowerBound() - gridMap[i]->getOverlapLowerBound();
-                    int end = gridMap[i]->getUpperBound() - gridMap[i]->getOverlapLowerBound() + 1;
+                float *poRasterData = new float[GRID_SIZE_X*GRID_SIZE_Y];
 
-                    cerr << "Merging " << i << ": from " << (start) << " to " << (end) << endl;
-                    cerr << "        " << i << ": from " << (start/GRID_SIZE_X) << " to " << (end/GRID_SIZE_X) << endl;
-
-                    float *poRasterData = new float[GRID_SIZE_X*GRID_SIZE_Y];
-                    for (j = 0; j < GRID_SIZE_X*GRID_SIZE_Y; j++)
+                for(i = tiles_y - 1; i >= 0; i--)
+                {
+                    if(openTileRow(i, tileFiles) < 0)
                     {
-                        poRasterData[j] = 0;
+                        delete [] poRasterData;
+                        return -1;
                     }
 
+                    int start = gridMap[i * tiles_x]->getLowerBound();
+                    int end = gridMap[i * tiles_x]->getUpperBound() + 1;
+
                     for(j = end - 1; j >= start; j--)
                     {
+                        if(readGridRow(j, tileFiles, row) < 0)
+                        {
+                            closeTileRow(tileFiles);
+                            delete [] poRasterData;
+                            return -1;
+                        }
+
                         for(k = 0; k < GRID_SIZE_X; k++)
                         {
-                            int index = j * GRID_SIZE_X + k;
-                            int out_index = (end - 1 - j) * GRID_SIZE_X + k;
+                            int out_index = (GRID_SIZE_Y - 1 - j) * GRID_SIZE_X + k;
 
-                            if(gf->interp[index].empty == 0 &&
-                                    gf->interp[index].filled == 0)
+                            if(row[k].empty == 0 &&
+                                    row[k].filled == 0)
                             {
                                 poRasterData[out_index] = -9999.f;
                              } else {
                                 switch (t)
                                 {
                                     case 0:
-                                        poRasterData[out_index] = gf->interp[index].Zmin;
+                                        poRasterData[out_index] = row[k].Zmin;
                                         break;
 
                                     case 1:
-                                        poRasterData[out_index] = gf->interp[index].Zmax;
+                                        poRasterData[out_index] = row[k].Zmax;
                                         break;
 
                                     case 2:
-                                        poRasterData[out_index] = gf->interp[index].Zmean;
+                                        poRasterData[out_index] = row[k].Zmean;
                                         break;
 
                                     case 3:
-                                        poRasterData[out_index] = gf->interp[index].Zidw;
+                                        poRasterData[out_index] = row[k].Zidw;
                                         break;
 
                                     case 4:
-                                        poRasterData[out_index] = gf->interp[index].count;
+                                        poRasterData[out_index] = row[k].count;
                                         break;
 
                                     case 5:
-                                        poRasterData[out_index] = gf->interp[index].Zstd;
+                                        poRasterData[out_index] = row[k].Zstd;
                                         break;
                                 }
                             }
                         }
                     }
-                    GDALRasterBand *tBand = gdalFiles[t]->GetRasterBand(1);
-                    tBand->SetNoDataValue(-9999.f);
 
-                    if (GRID_SIZE_X > 0 && GRID_SIZE_Y > 0)
-                        tBand->RasterIO(GF_Write, 0, 0, GRID_SIZE_X, GRID_SIZE_Y, poRasterData, GRID_SIZE_X, GRID_SIZE_Y, GDT_Float32, 0, 0);
-                    GDALClose((GDALDatasetH) gdalFiles[t]);
-                    delete [] poRasterData;
+                    closeTileRow(tileFiles);
                 }
+
+                GDALRasterBand *tBand = gdalFiles[t]->GetRasterBand(1);
+                tBand->SetNoDataValue(-9999.f);
+
+                if (GRID_SIZE_X > 0 && GRID_SIZE_Y > 0)
+                    tBand->RasterIO(GF_Write, 0, 0, GRID_SIZE_X, GRID_SIZE_Y, poRasterData, GRID_SIZE_X, GRID_SIZE_Y, GDT_Float32, 0, 0);
+                GDALClose((GDALDatasetH) gdalFiles[t]);
+                delete [] poRasterData;
             }
         }
     }
@@ -1177,133 +1692,198 @@ int OutCoreInterp::outputFile(const std::string& outputName, int outputFormat, u
     return 0;
 }
 
-int OutCoreInterp::findFileNum(double data_y)
+// the tile owning the cell of (data_x, data_y); a point off the grid goes
+// to the tile nearest to it. Like InCoreInterp::update_batch(), points past
+// the far edges are dropped, as are points below the near edges whose
+// search radius cannot reach the grid; both return -1.
+int OutCoreInterp::findFileNum(double data_x, double data_y)
 {
-    int i;
+    double reach = sqrt(radius_sqr);
+    int grid_x = (int)floor(data_x / GRID_DIST_X);
+    int grid_y = (int)floor(data_y / GRID_DIST_Y);
 
-    for(i = 0; i < numFiles; i++)
+    if(grid_x > GRID_SIZE_X || grid_y > GRID_SIZE_Y ||
+            data_x < -reach - GRID_DIST_X || data_y < -reach - GRID_DIST_Y)
     {
-        if(data_y <= gridMap[i]->getUpperBound() * GRID_DIST_Y &&
-                data_y >= gridMap[i]->getLowerBound() * GRID_DIST_Y)
-            return i;
-        else if(i < numFiles - 1 &&
-                data_y > gridMap[i]->getUpperBound() * GRID_DIST_Y &&
-                data_y < gridMap[i+1]->getLowerBound() * GRID_DIST_Y)
-            return i;
-        else if(i == numFiles - 1 &&
-                data_y >= gridMap[i]->getUpperBound() * GRID_DIST_Y)
-        {
-            //cout << "here" << endl;
-            return i;
-        }
+        if (!user_defined_grid) cerr << "findFileNum() error" << endl;
+        return -1;
     }
 
-    if (!user_defined_grid) cerr << "findFileNum() error" << endl;
+    grid_x = min(max(grid_x, 0), GRID_SIZE_X - 1);
+    grid_y = min(max(grid_y, 0), GRID_SIZE_Y - 1);
 
-    return -1;
+    return (grid_y / local_grid_size_y) * tiles_x + grid_x / local_grid_size_x;
 }
 
-void OutCoreInterp::finalize()
+// the final sums of a mapped tile's interior, once it holds the points
+// its neighbours' halos caught
+void OutCoreInterp::divideCells(int fileNum)
 {
-    int i;
-    int start;
-    int end;
-    int overlapEnd;
-    GridFile *gf;
+    size_t i;
+    GridMap *m = gridMap[fileNum];
+    GridFile *gf = m->getGridFile();
 
-    if(openFile == -1)
+    if(gf == NULL || gf->interp == NULL)
     {
-        cerr << "OutCoreInterp::finalize() no open file" << endl;
+        cerr << "OutCoreInterp::divideCells() no open file" << endl;
         return;
     }
 
-    start = (gridMap[openFile]->getLowerBound() - gridMap[openFile]->getOverlapLowerBound()) * GRID_SIZE_X;
-    end = (gridMap[openFile]->getUpperBound() - gridMap[openFile]->getOverlapLowerBound() + 1) * GRID_SIZE_X;
-    overlapEnd = (gridMap[openFile]->getOverlapUpperBound() - gridMap[openFile]->getOverlapLowerBound() + 1) * GRID_SIZE_X;
-    gf = gridMap[openFile]->getGridFile();
-
-    cerr << openFile << ": from " << (start) << " to " << (end) << endl;
-    cerr << openFile << ": from " << (start/GRID_SIZE_X) << " to " << (end/GRID_SIZE_X) << endl;
+    int left = m->getOverlapLeftBound();
+    int lb = m->getOverlapLowerBound();
+    int width = m->getOverlapRightBound() - left + 1;
 
-    for(i = 0; i < overlapEnd; i++)
+    for(int y = m->getLowerBound(); y <= m->getUpperBound(); y++)
     {
-        if(gf->interp[i].Zmin == DBL_MAX)
-            gf->interp[i].Zmin = 0;
+        size_t rowEnd = (size_t)(y - lb) * width + (m->getRightBound() - left) + 1;
 
-        if(gf->interp[i].Zmax == -DBL_MAX)
-            gf->interp[i].Zmax = 0;
-
-        if(gf->interp[i].count != 0) {
-            gf->interp[i].Zmean /= gf->interp[i].count ;
-            gf->interp[i].empty = 1;
+        for(i = (size_t)(y - lb) * width + (m->getLeftBound() - left); i < rowEnd; i++)
+        {
+            if(gf->interp[i].count != 0) {
+                gf->interp[i].Zmean /= gf->interp[i].count ;
+                gf->interp[i].empty = 1;
+            }
+            else
+                gf->interp[i].Zmean = 0 ;
+
+	    /*
+	    if(gf->interp[i].count != 0) {
+	      gf->interp[i].Zstd = gf->interp[i].Zstd / (gf->interp[i].count);
+	    } else {
+	      gf->interp[i].Zstd = 0;
+	    }
+	    */
+
+	    if(gf->interp[i].sum != 0 && gf->interp[i].sum != -1)
+                gf->interp[i].Zidw /= gf->interp[i].sum;
+            else if (gf->interp[i].sum == -1) {
+                // do nothing
+            } else
+                gf->interp[i].Zidw = 0;
         }
-        else
-            gf->interp[i].Zmean = 0 ;
-
-	/*
-	if(gf->interp[i].count != 0) {
-	  gf->interp[i].Zstd = gf->interp[i].Zstd / (gf->interp[i].count);
-	} else {
-	  gf->interp[i].Zstd = 0;
-	}
-	*/
-
-	if(gf->interp[i].sum != 0 && gf->interp[i].sum != -1)
-            gf->interp[i].Zidw /= gf->interp[i].sum;
-        else if (gf->interp[i].sum == -1) {
-            // do nothing
-        } else
-            gf->interp[i].Zidw = 0;
     }
+}
+
+// the null filling of a mapped tile's interior, once its halo holds the
+// divided cells of its neighbours; it reads the halo like in-core reads
+// the neighbouring cells. The filling writes only empty cells, which the
+// neighbours copying this interior into their halos never use.
+void OutCoreInterp::fillCells(int fileNum)
+{
+    GridMap *m = gridMap[fileNum];
+    GridFile *gf = m->getGridFile();
+
+    if(gf == NULL || gf->interp == NULL)
+    {
+        cerr << "OutCoreInterp::fillCells() no open file" << endl;
+        return;
+    }
+
+    int left = m->getOverlapLeftBound();
+    int lb = m->getOverlapLowerBound();
+    int width = m->getOverlapRightBound() - left + 1;
 
     // Sriram's edit: Fill zeros using the window size parameter
     if (window_size != 0) {
         int window_dist = window_size / 2;
-        for (i = start; i < end; i++)
+        for (int y = m->getLowerBound(); y <= m->getUpperBound(); y++)
         {
-            double new_sum=0.0;
-            if (gf->interp[i].empty == 0) {
-                for (int p = 0; p < window_size; p++) {
-                    for (int q = 0; q < window_size; q++) {
-                        // make sure that this is not an edge
-                        int column = i - (i/local_grid_size_x)*local_grid_size_x;
-                        if (((column + (p-window_dist)) < 0) ||
-                                (column + (p-window_dist) >= local_grid_size_x)) {
-                            continue;
-                        }
-
-                        int neighbor = (q-window_dist)*local_grid_size_x + (p-window_dist) + i;
-                        if (neighbor == i)
-                            continue;
-
-                        if ((neighbor >= 0) && (neighbor < overlapEnd))
-                            if (gf->interp[neighbor].empty != 0) {
-
-                                double distance = max(abs(p-window_dist), abs(q-window_dist));
-                                gf->interp[i].Zmean += gf->interp[neighbor].Zmean/(pow(distance,Interpolation::WEIGHTER));
-                                gf->interp[i].Zidw += gf->interp[neighbor].Zidw/(pow(distance,Interpolation::WEIGHTER));
-                                gf->interp[i].Zmin += gf->interp[neighbor].Zmin/(pow(distance,Interpolation::WEIGHTER));
-                                gf->interp[i].Zmax += gf->interp[neighbor].Zmax/(pow(distance,Interpolation::WEIGHTER));
-                                //gf->interp[i].Zstd += gf->interp[neighbor].Zstd/(pow(distance,Interpolation::WEIGHTER));
-                                //gf->interp[i].Zstd_tmp += gf->interp[neighbor].Zstd_tmp/(pow(distance,Interpolation::WEIGHTER));
+            for (int x = m->getLeftBound(); x <= m->getRightBound(); x++)
+            {
+                GridPoint& gp = gf->interp[(size_t)(y - lb) * width + (x - left)];
+                double new_sum=0.0;
+                if (gp.empty == 0) {
+                    for (int p = x - window_dist; p <= x + window_dist; p++) {
+                        for (int q = y - window_dist; q <= y + window_dist; q++) {
+                            // make sure that this is not an edge
+                            if ((p < 0) || (p >= GRID_SIZE_X) || (q < 0) || (q >= GRID_SIZE_Y))
+                                continue;
+
+                            if ((p == x) && (q == y))
+                                continue;
+
+                            const GridPoint& neighbor = gf->interp[(size_t)(q - lb) * width + (p - left)];
+                            if (neighbor.empty != 0) {
+
+                                double distance = max(abs(p-x), abs(q-y));
+                                gp.Zmean += neighbor.Zmean/(pow(distance,Interpolation::WEIGHTER));
+                                gp.Zidw += neighbor.Zidw/(pow(distance,Interpolation::WEIGHTER));
+                                gp.Zmin += neighbor.Zmin/(pow(distance,Interpolation::WEIGHTER));
+                                gp.Zmax += neighbor.Zmax/(pow(distance,Interpolation::WEIGHTER));
+                                //gp.Zstd += neighbor.Zstd/(pow(distance,Interpolation::WEIGHTER));
+                                //gp.Zstd_tmp += neighbor.Zstd_tmp/(pow(distance,Interpolation::WEIGHTER));
                                 new_sum += 1/(pow(distance,Interpolation::WEIGHTER));
                             }
+                        }
                     }
                 }
+                if (new_sum > 0) {
+                    gp.Zmean /= new_sum;
+                    gp.Zidw /= new_sum;
+                    gp.Zmin /= new_sum;
+                    gp.Zmax /= new_sum;
+                    //gp.Zstd /= new_sum;
+                    //gp.Zstd_tmp /= new_sum;
+                    gp.filled = 1;
+                }
             }
-            if (new_sum > 0) {
-                gf->interp[i].Zmean /= new_sum;
-                gf->interp[i].Zidw /= new_sum;
-                gf->interp[i].Zmin /= new_sum;
-                gf->interp[i].Zmax /= new_sum;
-		//gf->interp[i].Zstd /= new_sum;
-		//gf->interp[i].Zstd_tmp /= new_sum;
-		gf->interp[i].filled = 1;
-            }
         }
     }
 }
 
+// reads grid row j, tile by tile, from the files of the tile row holding
+// it, opened by the caller
+int OutCoreInterp::readGridRow(int j, vector<FILE *>& files, vector<GridPoint>& row)
+{
+    int ty = j / local_grid_size_y;
+
+    for(int tx = 0; tx < tiles_x; tx++)
+    {
+        GridMap *m = gridMap[ty * tiles_x + tx];
+        int width = m->getOverlapRightBound() - m->getOverlapLeftBound() + 1;
+        size_t len_x = m->getRightBound() - m->getLeftBound() + 1;
+        long long offset = ((long long)(j - m->getOverlapLowerBound()) * width +
+                            (m->getLeftBound() - m->getOverlapLeftBound())) * sizeof(GridPoint);
+
+        if(seek_file(files[tx], offset) != 0 || fread(&row[m->getLeftBound()], sizeof(GridPoint), len_x, files[tx]) != len_x)
+        {
+            cerr << "OutCoreInterp::readGridRow() read error: " << m->getGridFile()->getFileName() << endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// opens the files of tile row ty for readGridRow()
+int OutCoreInterp::openTileRow(int ty, vector<FILE *>& files)
+{
+    files.assign(tiles_x, (FILE *)NULL);
+
+    for(int tx = 0; tx < tiles_x; tx++)
+    {
+        std::string name = gridMap[ty * tiles_x + tx]->getGridFile()->getFileName();
+        if((files[tx] = fopen(name.c_str(), "rb")) == NULL)
+        {
+            cerr << "File open error: " << name << endl;
+            closeTileRow(files);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void OutCoreInterp::closeTileRow(vector<FILE *>& files)
+{
+    for(size_t tx = 0; tx < files.size(); tx++)
+    {
+        if(files[tx] != NULL)
+            fclose(files[tx]);
+    }
+    files.clear();
+}
+
 void OutCoreInterp::get_temp_file_name(char *fname, size_t fname_len) {
     int tname = -1;
     std::string default_path("/tmp");
@@ -0,0 +1,184 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <points2grid/config.h>
+#include <points2grid/SpanKernels.hpp>
+
+#include <stddef.h>
+#include <iostream>
+
+namespace
+{
+
+void scalar_min(double *Zmin, const unsigned int *count, int n, double z)
+{
+    for(int i = 0; i < n; i++)
+        span_cell_min(Zmin[i], count[i], z);
+}
+
+void scalar_max(double *Zmax, const unsigned int *count, int n, double z)
+{
+    for(int i = 0; i < n; i++)
+        span_cell_max(Zmax[i], count[i], z);
+}
+
+void scalar_count(unsigned int *count, int n)
+{
+    for(int i = 0; i < n; i++)
+        count[i]++;
+}
+
+void scalar_mean(double *Zmean, int n, double z)
+{
+    for(int i = 0; i < n; i++)
+        Zmean[i] += z;
+}
+
+void scalar_std(double *Zstd, double *Zstd_tmp, const unsigned int *count, int n, double z)
+{
+    for(int i = 0; i < n; i++)
+        span_cell_std(Zstd[i], Zstd_tmp[i], count[i], z);
+}
+
+// Power is the IDW power, or 0 to use the power argument
+template<int Power>
+void scalar_idw_power(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    int p = Power != 0 ? Power : power;
+
+    for(int i = 0; i < n; i++)
+        span_cell_idw(Zidw[i], sum[i], span_weight(dx2[i] + dy2, p), z);
+}
+
+void scalar_idw(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    switch(power)
+    {
+    case 1: scalar_idw_power<1>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 2: scalar_idw_power<2>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 3: scalar_idw_power<3>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 4: scalar_idw_power<4>(Zidw, sum, dx2, dy2, n, z, power); break;
+    default: scalar_idw_power<0>(Zidw, sum, dx2, dy2, n, z, power); break;
+    }
+}
+
+const SpanKernels *select_span_kernels()
+{
+    const SpanKernels *kernels = &scalar_span_kernels;
+
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        kernels = &avx512_span_kernels;
+    else if(__builtin_cpu_supports("avx2"))
+        kernels = &avx2_span_kernels;
+    else if(__builtin_cpu_supports("sse2"))
+        kernels = &sse2_span_kernels;
+#endif
+
+    std::cerr << "Using " << kernels->name << " grid kernels" << std::endl;
+
+    return kernels;
+}
+
+}
+
+const SpanKernels scalar_span_kernels =
+{
+    "scalar",
+    scalar_min,
+    scalar_max,
+    scalar_count,
+    scalar_mean,
+    scalar_std,
+    scalar_idw
+};
+
+void span_idw_pow(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, double power)
+{
+    for(int i = 0; i < n; i++)
+        span_cell_idw(Zidw[i], sum[i], pow(sqrt(dx2[i] + dy2), power), z);
+}
+
+const SpanKernels& getSpanKernels()
+{
+    // picked on first use; function statics are initialized once even
+    // when several threads get here together
+    static const SpanKernels *kernels = select_span_kernels();
+    return *kernels;
+}
+
+namespace
+{
+
+// the best kernels and every narrower variant, ending with NULL
+struct AvailableSpanKernels
+{
+    const SpanKernels *list[5];
+
+    AvailableSpanKernels()
+    {
+        int n = 0;
+        const SpanKernels *best = &getSpanKernels();
+
+        list[n++] = &scalar_span_kernels;
+#ifdef HAVE_X86_SIMD
+        if(best != &scalar_span_kernels)
+            list[n++] = &sse2_span_kernels;
+        if(best == &avx2_span_kernels || best == &avx512_span_kernels)
+            list[n++] = &avx2_span_kernels;
+        if(best == &avx512_span_kernels)
+            list[n++] = &avx512_span_kernels;
+#endif
+        list[n] = NULL;
+        (void)best;
+    }
+};
+
+}
+
+const SpanKernels *const *getAvailableSpanKernels()
+{
+    static const AvailableSpanKernels available;
+    return available.list;
+}
@@ -0,0 +1,206 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+// built with -mavx2 -ffp-contract=off; see CMakeLists.txt
+
+#include <points2grid/SpanKernels.hpp>
+
+#include <immintrin.h>
+
+namespace
+{
+
+// all ones in the lanes of the four cells whose count is 0
+inline __m256d avx2_unset(const unsigned int *count)
+{
+    __m128i zero = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)count), _mm_setzero_si128());
+    return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(zero));
+}
+
+void avx2_min(double *Zmin, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m256d vz = _mm256_set1_pd(z);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256d m = _mm256_min_pd(vz, _mm256_loadu_pd(Zmin + i));
+        _mm256_storeu_pd(Zmin + i, _mm256_blendv_pd(m, vz, avx2_unset(count + i)));
+    }
+    for(; i < n; i++)
+        span_cell_min(Zmin[i], count[i], z);
+}
+
+void avx2_max(double *Zmax, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m256d vz = _mm256_set1_pd(z);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256d m = _mm256_max_pd(vz, _mm256_loadu_pd(Zmax + i));
+        _mm256_storeu_pd(Zmax + i, _mm256_blendv_pd(m, vz, avx2_unset(count + i)));
+    }
+    for(; i < n; i++)
+        span_cell_max(Zmax[i], count[i], z);
+}
+
+void avx2_count(unsigned int *count, int n)
+{
+    int i = 0;
+    __m256i one = _mm256_set1_epi32(1);
+
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256i *p = (__m256i *)(count + i);
+        _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), one));
+    }
+    for(; i < n; i++)
+        count[i]++;
+}
+
+void avx2_mean(double *Zmean, int n, double z)
+{
+    int i = 0;
+    __m256d vz = _mm256_set1_pd(z);
+
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(Zmean + i, _mm256_add_pd(_mm256_loadu_pd(Zmean + i), vz));
+    for(; i < n; i++)
+        Zmean[i] += z;
+}
+
+void avx2_std(double *Zstd, double *Zstd_tmp, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m256d vz = _mm256_set1_pd(z);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256d c = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(count + i)));
+        __m256d t = _mm256_loadu_pd(Zstd_tmp + i);
+        __m256d delta = _mm256_sub_pd(vz, t);
+
+        t = _mm256_add_pd(t, _mm256_div_pd(delta, c));
+        _mm256_storeu_pd(Zstd_tmp + i, t);
+        _mm256_storeu_pd(Zstd + i, _mm256_add_pd(_mm256_loadu_pd(Zstd + i), _mm256_mul_pd(delta, _mm256_sub_pd(vz, t))));
+    }
+    for(; i < n; i++)
+        span_cell_std(Zstd[i], Zstd_tmp[i], count[i], z);
+}
+
+// span_weight() on every lane
+inline __m256d weight(__m256d distance_sqr, int power)
+{
+    int m = power >> 1;
+    __m256d base = distance_sqr;
+    __m256d dist = (m & 1) ? distance_sqr : _mm256_set1_pd(1);
+
+    for(m >>= 1; m != 0; m >>= 1) {
+        base = _mm256_mul_pd(base, base);
+        if(m & 1)
+            dist = _mm256_mul_pd(dist, base);
+    }
+
+    if(power & 1)
+        dist = _mm256_mul_pd(_mm256_sqrt_pd(distance_sqr), dist);
+
+    return dist;
+}
+
+// Power is the IDW power, or 0 to use the power argument
+template<int Power>
+void avx2_idw_power(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    int i = 0;
+    int p = Power != 0 ? Power : power;
+    __m256d vz = _mm256_set1_pd(z);
+    __m256d vdy2 = _mm256_set1_pd(dy2);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d one = _mm256_set1_pd(1);
+    __m256d exact = _mm256_set1_pd(-1);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256d dist = weight(_mm256_add_pd(_mm256_loadu_pd(dx2 + i), vdy2), p);
+        __m256d w = _mm256_loadu_pd(Zidw + i);
+        __m256d s = _mm256_loadu_pd(sum + i);
+
+        // a point right on a cell center sets the cell to its value for good
+        __m256d hit = _mm256_cmp_pd(dist, zero, _CMP_EQ_OQ);
+        __m256d done = _mm256_cmp_pd(s, exact, _CMP_EQ_OQ);
+
+        __m256d nw = _mm256_blendv_pd(_mm256_add_pd(w, _mm256_div_pd(vz, dist)), vz, hit);
+        __m256d ns = _mm256_blendv_pd(_mm256_add_pd(s, _mm256_div_pd(one, dist)), exact, hit);
+
+        _mm256_storeu_pd(Zidw + i, _mm256_blendv_pd(nw, w, done));
+        _mm256_storeu_pd(sum + i, _mm256_blendv_pd(ns, s, done));
+    }
+    for(; i < n; i++)
+        span_cell_idw(Zidw[i], sum[i], span_weight(dx2[i] + dy2, p), z);
+}
+
+void avx2_idw(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    switch(power)
+    {
+    case 1: avx2_idw_power<1>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 2: avx2_idw_power<2>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 3: avx2_idw_power<3>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 4: avx2_idw_power<4>(Zidw, sum, dx2, dy2, n, z, power); break;
+    default: avx2_idw_power<0>(Zidw, sum, dx2, dy2, n, z, power); break;
+    }
+}
+
+}
+
+const SpanKernels avx2_span_kernels =
+{
+    "AVX2",
+    avx2_min,
+    avx2_max,
+    avx2_count,
+    avx2_mean,
+    avx2_std,
+    avx2_idw
+};
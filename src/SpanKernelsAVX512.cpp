@@ -0,0 +1,213 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+// built with -mavx512f -ffp-contract=off; see CMakeLists.txt
+
+#include <points2grid/SpanKernels.hpp>
+
+// GCC warns that the _mm512_undefined_* results the intrinsics start from
+// may be used uninitialized, a known false positive
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+
+// the lanes of the eight cells whose count is 0
+inline __mmask8 avx512_unset(const unsigned int *count)
+{
+    __m512i c = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)count));
+    return _mm512_cmpeq_epi64_mask(c, _mm512_setzero_si512());
+}
+
+void avx512_min(double *Zmin, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m512d vz = _mm512_set1_pd(z);
+
+    for(; i + 8 <= n; i += 8)
+    {
+        __m512d m = _mm512_min_pd(vz, _mm512_loadu_pd(Zmin + i));
+        _mm512_storeu_pd(Zmin + i, _mm512_mask_blend_pd(avx512_unset(count + i), m, vz));
+    }
+    for(; i < n; i++)
+        span_cell_min(Zmin[i], count[i], z);
+}
+
+void avx512_max(double *Zmax, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m512d vz = _mm512_set1_pd(z);
+
+    for(; i + 8 <= n; i += 8)
+    {
+        __m512d m = _mm512_max_pd(vz, _mm512_loadu_pd(Zmax + i));
+        _mm512_storeu_pd(Zmax + i, _mm512_mask_blend_pd(avx512_unset(count + i), m, vz));
+    }
+    for(; i < n; i++)
+        span_cell_max(Zmax[i], count[i], z);
+}
+
+void avx512_count(unsigned int *count, int n)
+{
+    int i = 0;
+    __m512i one = _mm512_set1_epi32(1);
+
+    for(; i + 16 <= n; i += 16)
+        _mm512_storeu_si512(count + i, _mm512_add_epi32(_mm512_loadu_si512(count + i), one));
+    for(; i < n; i++)
+        count[i]++;
+}
+
+void avx512_mean(double *Zmean, int n, double z)
+{
+    int i = 0;
+    __m512d vz = _mm512_set1_pd(z);
+
+    for(; i + 8 <= n; i += 8)
+        _mm512_storeu_pd(Zmean + i, _mm512_add_pd(_mm512_loadu_pd(Zmean + i), vz));
+    for(; i < n; i++)
+        Zmean[i] += z;
+}
+
+void avx512_std(double *Zstd, double *Zstd_tmp, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m512d vz = _mm512_set1_pd(z);
+
+    for(; i + 8 <= n; i += 8)
+    {
+        __m512d c = _mm512_cvtepu32_pd(_mm256_loadu_si256((const __m256i *)(count + i)));
+        __m512d t = _mm512_loadu_pd(Zstd_tmp + i);
+        __m512d delta = _mm512_sub_pd(vz, t);
+
+        t = _mm512_add_pd(t, _mm512_div_pd(delta, c));
+        _mm512_storeu_pd(Zstd_tmp + i, t);
+        _mm512_storeu_pd(Zstd + i, _mm512_add_pd(_mm512_loadu_pd(Zstd + i), _mm512_mul_pd(delta, _mm512_sub_pd(vz, t))));
+    }
+    for(; i < n; i++)
+        span_cell_std(Zstd[i], Zstd_tmp[i], count[i], z);
+}
+
+// span_weight() on every lane
+inline __m512d weight(__m512d distance_sqr, int power)
+{
+    int m = power >> 1;
+    __m512d base = distance_sqr;
+    __m512d dist = (m & 1) ? distance_sqr : _mm512_set1_pd(1);
+
+    for(m >>= 1; m != 0; m >>= 1) {
+        base = _mm512_mul_pd(base, base);
+        if(m & 1)
+            dist = _mm512_mul_pd(dist, base);
+    }
+
+    if(power & 1)
+        dist = _mm512_mul_pd(_mm512_sqrt_pd(distance_sqr), dist);
+
+    return dist;
+}
+
+// Power is the IDW power, or 0 to use the power argument
+template<int Power>
+void avx512_idw_power(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    int i = 0;
+    int p = Power != 0 ? Power : power;
+    __m512d vz = _mm512_set1_pd(z);
+    __m512d vdy2 = _mm512_set1_pd(dy2);
+    __m512d zero = _mm512_setzero_pd();
+    __m512d one = _mm512_set1_pd(1);
+    __m512d exact = _mm512_set1_pd(-1);
+
+    for(; i + 8 <= n; i += 8)
+    {
+        __m512d dist = weight(_mm512_add_pd(_mm512_loadu_pd(dx2 + i), vdy2), p);
+        __m512d w = _mm512_loadu_pd(Zidw + i);
+        __m512d s = _mm512_loadu_pd(sum + i);
+
+        // a point right on a cell center sets the cell to its value for good;
+        // cells already set that way are left alone
+        __mmask8 hit = _mm512_cmp_pd_mask(dist, zero, _CMP_EQ_OQ);
+        __mmask8 open = _mm512_cmp_pd_mask(s, exact, _CMP_NEQ_UQ);
+
+        __m512d nw = _mm512_mask_blend_pd(hit, _mm512_add_pd(w, _mm512_div_pd(vz, dist)), vz);
+        __m512d ns = _mm512_mask_blend_pd(hit, _mm512_add_pd(s, _mm512_div_pd(one, dist)), exact);
+
+        _mm512_mask_storeu_pd(Zidw + i, open, nw);
+        _mm512_mask_storeu_pd(sum + i, open, ns);
+    }
+    for(; i < n; i++)
+        span_cell_idw(Zidw[i], sum[i], span_weight(dx2[i] + dy2, p), z);
+}
+
+void avx512_idw(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    switch(power)
+    {
+    case 1: avx512_idw_power<1>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 2: avx512_idw_power<2>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 3: avx512_idw_power<3>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 4: avx512_idw_power<4>(Zidw, sum, dx2, dy2, n, z, power); break;
+    default: avx512_idw_power<0>(Zidw, sum, dx2, dy2, n, z, power); break;
+    }
+}
+
+}
+
+const SpanKernels avx512_span_kernels =
+{
+    "AVX-512",
+    avx512_min,
+    avx512_max,
+    avx512_count,
+    avx512_mean,
+    avx512_std,
+    avx512_idw
+};
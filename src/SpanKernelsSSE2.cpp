@@ -0,0 +1,213 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+// built with -msse2 -ffp-contract=off; see CMakeLists.txt
+
+#include <points2grid/SpanKernels.hpp>
+
+#include <emmintrin.h>
+
+namespace
+{
+
+// all ones in the lanes of the two cells whose count is 0
+inline __m128d sse2_unset(const unsigned int *count)
+{
+    __m128i zero = _mm_cmpeq_epi32(_mm_loadl_epi64((const __m128i *)count), _mm_setzero_si128());
+    return _mm_castsi128_pd(_mm_unpacklo_epi32(zero, zero));
+}
+
+void sse2_min(double *Zmin, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m128d vz = _mm_set1_pd(z);
+
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128d unset = sse2_unset(count + i);
+        __m128d m = _mm_min_pd(vz, _mm_loadu_pd(Zmin + i));
+        _mm_storeu_pd(Zmin + i, _mm_or_pd(_mm_and_pd(unset, vz), _mm_andnot_pd(unset, m)));
+    }
+    for(; i < n; i++)
+        span_cell_min(Zmin[i], count[i], z);
+}
+
+void sse2_max(double *Zmax, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m128d vz = _mm_set1_pd(z);
+
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128d unset = sse2_unset(count + i);
+        __m128d m = _mm_max_pd(vz, _mm_loadu_pd(Zmax + i));
+        _mm_storeu_pd(Zmax + i, _mm_or_pd(_mm_and_pd(unset, vz), _mm_andnot_pd(unset, m)));
+    }
+    for(; i < n; i++)
+        span_cell_max(Zmax[i], count[i], z);
+}
+
+void sse2_count(unsigned int *count, int n)
+{
+    int i = 0;
+    __m128i one = _mm_set1_epi32(1);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128i *p = (__m128i *)(count + i);
+        _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), one));
+    }
+    for(; i < n; i++)
+        count[i]++;
+}
+
+void sse2_mean(double *Zmean, int n, double z)
+{
+    int i = 0;
+    __m128d vz = _mm_set1_pd(z);
+
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(Zmean + i, _mm_add_pd(_mm_loadu_pd(Zmean + i), vz));
+    for(; i < n; i++)
+        Zmean[i] += z;
+}
+
+void sse2_std(double *Zstd, double *Zstd_tmp, const unsigned int *count, int n, double z)
+{
+    int i = 0;
+    __m128d vz = _mm_set1_pd(z);
+
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128d c = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)(count + i)));
+        __m128d t = _mm_loadu_pd(Zstd_tmp + i);
+        __m128d delta = _mm_sub_pd(vz, t);
+
+        t = _mm_add_pd(t, _mm_div_pd(delta, c));
+        _mm_storeu_pd(Zstd_tmp + i, t);
+        _mm_storeu_pd(Zstd + i, _mm_add_pd(_mm_loadu_pd(Zstd + i), _mm_mul_pd(delta, _mm_sub_pd(vz, t))));
+    }
+    for(; i < n; i++)
+        span_cell_std(Zstd[i], Zstd_tmp[i], count[i], z);
+}
+
+inline __m128d select(__m128d mask, __m128d a, __m128d b)
+{
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+// span_weight() on every lane
+inline __m128d weight(__m128d distance_sqr, int power)
+{
+    int m = power >> 1;
+    __m128d base = distance_sqr;
+    __m128d dist = (m & 1) ? distance_sqr : _mm_set1_pd(1);
+
+    for(m >>= 1; m != 0; m >>= 1) {
+        base = _mm_mul_pd(base, base);
+        if(m & 1)
+            dist = _mm_mul_pd(dist, base);
+    }
+
+    if(power & 1)
+        dist = _mm_mul_pd(_mm_sqrt_pd(distance_sqr), dist);
+
+    return dist;
+}
+
+// Power is the IDW power, or 0 to use the power argument
+template<int Power>
+void sse2_idw_power(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    int i = 0;
+    int p = Power != 0 ? Power : power;
+    __m128d vz = _mm_set1_pd(z);
+    __m128d vdy2 = _mm_set1_pd(dy2);
+    __m128d zero = _mm_setzero_pd();
+    __m128d one = _mm_set1_pd(1);
+    __m128d exact = _mm_set1_pd(-1);
+
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128d dist = weight(_mm_add_pd(_mm_loadu_pd(dx2 + i), vdy2), p);
+        __m128d w = _mm_loadu_pd(Zidw + i);
+        __m128d s = _mm_loadu_pd(sum + i);
+
+        // a point right on a cell center sets the cell to its value for good
+        __m128d hit = _mm_cmpeq_pd(dist, zero);
+        __m128d done = _mm_cmpeq_pd(s, exact);
+
+        __m128d nw = select(hit, vz, _mm_add_pd(w, _mm_div_pd(vz, dist)));
+        __m128d ns = select(hit, exact, _mm_add_pd(s, _mm_div_pd(one, dist)));
+
+        _mm_storeu_pd(Zidw + i, select(done, w, nw));
+        _mm_storeu_pd(sum + i, select(done, s, ns));
+    }
+    for(; i < n; i++)
+        span_cell_idw(Zidw[i], sum[i], span_weight(dx2[i] + dy2, p), z);
+}
+
+void sse2_idw(double *Zidw, double *sum, const double *dx2, double dy2, int n, double z, int power)
+{
+    switch(power)
+    {
+    case 1: sse2_idw_power<1>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 2: sse2_idw_power<2>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 3: sse2_idw_power<3>(Zidw, sum, dx2, dy2, n, z, power); break;
+    case 4: sse2_idw_power<4>(Zidw, sum, dx2, dy2, n, z, power); break;
+    default: sse2_idw_power<0>(Zidw, sum, dx2, dy2, n, z, power); break;
+    }
+}
+
+}
+
+const SpanKernels sse2_span_kernels =
+{
+    "SSE2",
+    sse2_min,
+    sse2_max,
+    sse2_count,
+    sse2_mean,
+    sse2_std,
+    sse2_idw
+};
@@ -0,0 +1,601 @@
+/*
+*
+COPYRIGHT AND LICENSE
+
+Copyright (c) 2011 The Regents of the University of California.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the following
+disclaimer in the documentation and/or other materials provided
+with the distribution.
+
+3. All advertising materials mentioning features or use of this
+software must display the following acknowledgement: This product
+includes software developed by the San Diego Supercomputer Center.
+
+4. Neither the names of the Centers nor the names of the contributors
+may be used to endorse or promote products derived from this
+software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS''
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE REGENTS
+OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <points2grid/config.h>
+#include <points2grid/SpillInterp.hpp>
+#include <points2grid/Global.hpp>
+#include <points2grid/GridCells.hpp>
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#ifdef HAVE_GDAL
+#include "gdal_priv.h"
+#include "ogr_spatialref.h"
+#endif
+
+SpillInterp::SpillInterp(double dist_x, double dist_y,
+                         int size_x, int size_y,
+                         double r_sqr,
+                         double _min_x, double _max_x,
+                         double _min_y, double _max_y,
+                         int _window_size)
+{
+    GRID_DIST_X = dist_x;
+    GRID_DIST_Y = dist_y;
+
+    GRID_SIZE_X = size_x;
+    GRID_SIZE_Y = size_y;
+
+    radius_sqr = r_sqr;
+    radius = sqrt(r_sqr);
+
+    min_x = _min_x;
+    max_x = _max_x;
+    min_y = _min_y;
+    max_y = _max_y;
+
+    window_size = _window_size;
+
+    // a point reaches the rows within the radius on either side of its own
+    reach_rows = (int)floor(radius / GRID_DIST_Y) + 1;
+    halo_rows = window_size / 2;
+
+    // the bands are laid out in init(), once the memory budget is known
+    num_bands = 0;
+    band_rows = 0;
+    parallel_bands = 1;
+    block_points = MIN_BLOCK_POINTS;
+    bands = NULL;
+
+    num_points = num_spilled = 0;
+}
+
+SpillInterp::~SpillInterp()
+{
+    closeOutput();
+
+    if(bands != NULL)
+    {
+        for(int i = 0; i < num_bands; i++)
+            delete bands[i].grid;
+        delete [] bands;
+    }
+}
+
+int SpillInterp::init()
+{
+    int i;
+
+    chooseBands();
+    band_rows = (GRID_SIZE_Y + num_bands - 1) / num_bands;
+
+    if((bands = new Band[num_bands]) == NULL)
+    {
+        cerr << "SpillInterp::init() band allocation error" << endl;
+        return -1;
+    }
+
+    for(i = 0; i < num_bands; i++)
+    {
+        bands[i].lower = i * band_rows;
+        bands[i].upper = min(bands[i].lower + band_rows, GRID_SIZE_Y) - 1;
+        bands[i].overlap_lower = max(bands[i].lower - halo_rows, 0);
+        bands[i].overlap_upper = min(bands[i].upper + halo_rows, GRID_SIZE_Y - 1);
+        bands[i].grid = NULL;
+        bands[i].status = 0;
+    }
+
+    // the band buffers and the blocks read back share what the grids leave
+    double free_bytes = memory_budget - (memoryRequired(num_bands, parallel_bands) - (num_bands + parallel_bands) * blockBytes(MIN_BLOCK_POINTS));
+    double points = free_bytes / (num_bands + parallel_bands) / blockBytes(1);
+
+    block_points = points > MAX_BLOCK_POINTS ? MAX_BLOCK_POINTS : (size_t)max(points, 0.0);
+    if(block_points < MIN_BLOCK_POINTS)
+        block_points = MIN_BLOCK_POINTS;
+
+    cerr << "SpillInterp::init() " << num_bands << " bands of " << band_rows << " rows, "
+         << parallel_bands << " gridded at once, blocks of " << block_points << " points" << endl;
+
+    num_points = num_spilled = 0;
+
+    return 0;
+}
+
+// the fewest bands that let parallel_bands of them, up to num_threads,
+// be gridded at once within the memory budget; fewer at once if even
+// one-row bands do not fit that way
+void SpillInterp::chooseBands()
+{
+    int n, p;
+    int best = GRID_SIZE_Y;
+
+    for(p = min(num_threads, GRID_SIZE_Y); p >= 1; p--)
+    {
+        for(n = p; n <= GRID_SIZE_Y; n++)
+        {
+            // band counts that leave the last bands without rows give
+            // nothing new
+            int rows = (GRID_SIZE_Y + n - 1) / n;
+            if((GRID_SIZE_Y + rows - 1) / rows != n)
+                continue;
+
+            if(memoryRequired(n, p) <= memory_budget)
+            {
+                num_bands = n;
+                parallel_bands = p;
+                return;
+            }
+            if(p == 1 && memoryRequired(n, 1) < memoryRequired(best, 1))
+                best = n;
+        }
+    }
+
+    num_bands = best;
+    parallel_bands = 1;
+    cerr << "SpillInterp: no band decomposition fits in the memory budget, using "
+         << num_bands << " bands" << endl;
+}
+
+// bytes used with the grid split into num_bands bands, parallel of them
+// gridded at once: their grids and the blocks read back for them, and the
+// buffer of every band
+double SpillInterp::memoryRequired(int bands_count, int parallel) const
+{
+    int rows = (GRID_SIZE_Y + bands_count - 1) / bands_count;
+    int grid_rows = min(rows + 2 * halo_rows, GRID_SIZE_Y);
+    if(bands_count > 1)
+        grid_rows += reach_rows;
+
+    double grid_bytes = InCoreInterp::memory_required(GRID_SIZE_X, grid_rows, output_type, 1);
+
+    return min(parallel, bands_count) * (grid_bytes + blockBytes(MIN_BLOCK_POINTS)) + bands_count * blockBytes(MIN_BLOCK_POINTS);
+}
+
+double SpillInterp::blockBytes(size_t points) const
+{
+    return (double)points * 3 * sizeof(double);
+}
+
+// rows of the grid of a band: its rows and halo, and below the top band
+// the rows above them that its points may still fall in, so that
+// InCoreInterp drops only the points it would drop for the whole grid.
+// Nothing is read from those extra rows.
+int SpillInterp::engineRows(const Band& band) const
+{
+    int rows = band.overlap_upper - band.overlap_lower + 1;
+
+    if(band.overlap_upper < GRID_SIZE_Y - 1)
+        rows += reach_rows;
+
+    return rows;
+}
+
+int SpillInterp::update(double data_x, double data_y, double data_z)
+{
+    int lower_grid_x = (int)floor(data_x / GRID_DIST_X);
+    int lower_grid_y = (int)floor(data_y / GRID_DIST_Y);
+
+    // InCoreInterp::update_batch() drops these, the others reach nothing
+    if(lower_grid_x > GRID_SIZE_X || lower_grid_y > GRID_SIZE_Y || data_x + radius < 0)
+        return 0;
+
+    // every band whose rows or halo the search radius reaches
+    int first_row = (int)floor((data_y - radius) / GRID_DIST_Y) - halo_rows;
+    int last_row = (int)floor((data_y + radius) / GRID_DIST_Y) + 1 + halo_rows;
+    if(last_row < 0)
+        return 0;
+
+    int first_band = max(first_row, 0) / band_rows;
+    int last_band = min(last_row, GRID_SIZE_Y - 1) / band_rows;
+
+    num_points++;
+
+    for(int b = first_band; b <= last_band; b++)
+    {
+        Band& band = bands[b];
+
+        if(band.x.capacity() == 0)
+        {
+            band.x.reserve(block_points);
+            band.y.reserve(block_points);
+            band.z.reserve(block_points);
+        }
+
+        band.x.push_back(data_x);
+        band.y.push_back(data_y);
+        band.z.push_back(data_z);
+
+        if(band.x.size() == block_points)
+        {
+            if(!band.spill.isOpen() && band.spill.create() < 0)
+                return -1;
+            if(band.spill.write(band.x, band.y, band.z) < 0)
+                return -1;
+
+            num_spilled += band.x.size();
+            band.x.clear();
+            band.y.clear();
+            band.z.clear();
+        }
+    }
+
+    return 0;
+}
+
+// grids one band from its spill file and buffer; the band's y coordinates
+// are taken relative to its first row
+void SpillInterp::gridBand(Band *band)
+{
+    size_t i;
+    double offset = band->overlap_lower * GRID_DIST_Y;
+
+    band->grid = new InCoreInterp(GRID_DIST_X, GRID_DIST_Y, GRID_SIZE_X, engineRows(*band), radius_sqr,
+                                  min_x, max_x, min_y + offset, max_y, window_size);
+    band->grid->setOutputType(output_type);
+    band->grid->setIdwPower(idw_power);
+
+    if(band->grid->init() < 0)
+    {
+        band->status = -1;
+        return;
+    }
+
+    if(band->spill.isOpen())
+    {
+        std::vector<double> x, y, z;
+
+        if(band->spill.rewind() < 0)
+        {
+            band->status = -1;
+            return;
+        }
+
+        while(band->spill.read(x, y, z))
+        {
+            for(i = 0; i < y.size(); i++)
+                y[i] -= offset;
+            band->grid->update_batch(&x[0], &y[0], &z[0], x.size());
+        }
+
+        band->spill.close();
+    }
+
+    for(i = 0; i < band->y.size(); i++)
+        band->y[i] -= offset;
+    if(!band->x.empty())
+        band->grid->update_batch(&band->x[0], &band->y[0], &band->z[0], band->x.size());
+
+    std::vector<double>().swap(band->x);
+    std::vector<double>().swap(band->y);
+    std::vector<double>().swap(band->z);
+
+    band->grid->calculate_grid_values();
+}
+
+int SpillInterp::finish(const std::string& outputName, int outputFormat, unsigned int outputType)
+{
+    return finish(outputName, outputFormat, outputType, 0, 0);
+}
+
+int SpillInterp::finish(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt)
+{
+    int b;
+
+    //struct tms tbuf;
+    clock_t t0, t1;
+
+    if((outputType & OUTPUT_TYPE_ALL) & ~GridCells::getStats(output_type))
+    {
+        cerr << "SpillInterp::finish output type was not accumulated, see setOutputType()" << endl;
+        return -1;
+    }
+
+    cerr << "spill: " << num_points << " points, " << num_spilled << " copies written to the spill files of "
+         << num_bands << " bands" << endl;
+
+    t0 = clock();
+
+    if(openOutput(outputName, outputFormat, outputType, adfGeoTransform, wkt) < 0)
+    {
+        closeOutput();
+        return -1;
+    }
+
+    // the top bands first, as the outputs run from north to south
+    for(int top = num_bands - 1; top >= 0; top -= parallel_bands)
+    {
+        int bottom = max(top - parallel_bands + 1, 0);
+        boost::thread_group threads;
+
+        for(b = top; b > bottom; b--)
+            threads.create_thread(boost::bind(&SpillInterp::gridBand, this, &bands[b]));
+        gridBand(&bands[bottom]);
+        threads.join_all();
+
+        for(b = top; b >= bottom; b--)
+        {
+            if(bands[b].status < 0)
+            {
+                cerr << "SpillInterp::finish() band " << b << " error" << endl;
+                closeOutput();
+                return -1;
+            }
+
+            writeBand(bands[b]);
+            delete bands[b].grid;
+            bands[b].grid = NULL;
+        }
+    }
+
+    closeOutput();
+
+    t1 = clock();
+    //t1 = times(&tbuf);
+    cerr << "Output Execution time: " << (double)(t1 - t0)/CLOCKS_PER_SEC << std::endl;
+
+    return 0;
+}
+
+int SpillInterp::openOutput(const std::string& outputName, int outputFormat, unsigned int outputType, double *adfGeoTransform, const char* wkt)
+{
+    int i;
+    std::string fileName;
+
+    const char *ext[6] = {".min", ".max", ".mean", ".idw", ".den", ".std"};
+    unsigned int type[6] = {OUTPUT_TYPE_MIN, OUTPUT_TYPE_MAX, OUTPUT_TYPE_MEAN, OUTPUT_TYPE_IDW, OUTPUT_TYPE_DEN, OUTPUT_TYPE_STD};
+    int numTypes = 6;
+
+    arcFiles.assign(numTypes, (FILE *)NULL);
+    gridFiles.assign(numTypes, (FILE *)NULL);
+    gdalFiles.assign(numTypes, (void *)NULL);
+    gdalRasters.assign(numTypes, (float *)NULL);
+
+#ifndef HAVE_GDAL
+    // only GDAL writes GeoTIFFs, with adfGeoTransform and wkt
+    if(outputFormat == OUTPUT_FORMAT_GDAL_GTIFF)
+    {
+        cerr << "SpillInterp::openOutput() GeoTIFF output needs a build with GDAL" << endl;
+        return -1;
+    }
+#endif
+
+    for(i = 0; i < numTypes; i++)
+    {
+        if(!(outputType & type[i]))
+            continue;
+
+        // open ArcGIS files and print their headers
+        if(outputFormat == OUTPUT_FORMAT_ARC_ASCII || outputFormat == OUTPUT_FORMAT_ALL)
+        {
+            fileName = outputName + ext[i] + ".asc";
+            if((arcFiles[i] = fopen(fileName.c_str(), "w+")) == NULL)
+            {
+                cerr << "File open error: " << fileName << endl;
+                return -1;
+            }
+
+            fprintf(arcFiles[i], "ncols %d\n", GRID_SIZE_X);
+            fprintf(arcFiles[i], "nrows %d\n", GRID_SIZE_Y);
+            fprintf(arcFiles[i], "xllcorner %f\n", min_x - 0.5*GRID_DIST_X);
+            fprintf(arcFiles[i], "yllcorner %f\n", min_y - 0.5*GRID_DIST_Y);
+            fprintf(arcFiles[i], "cellsize %f\n", GRID_DIST_X);
+            fprintf(arcFiles[i], "NODATA_value -9999\n");
+        }
+
+        // open Grid ASCII files and print their headers
+        if(outputFormat == OUTPUT_FORMAT_GRID_ASCII || outputFormat == OUTPUT_FORMAT_ALL)
+        {
+            fileName = outputName + ext[i] + ".grid";
+            if((gridFiles[i] = fopen(fileName.c_str(), "w+")) == NULL)
+            {
+                cerr << "File open error: " << fileName << endl;
+                return -1;
+            }
+
+            fprintf(gridFiles[i], "north: %f\n", min_y - 0.5*GRID_DIST_Y + GRID_DIST_Y*GRID_SIZE_Y);
+            fprintf(gridFiles[i], "south: %f\n", min_y - 0.5*GRID_DIST_Y);
+            fprintf(gridFiles[i], "east: %f\n", min_x - 0.5*GRID_DIST_X + GRID_DIST_X*GRID_SIZE_X);
+            fprintf(gridFiles[i], "west: %f\n", min_x - 0.5*GRID_DIST_X);
+            fprintf(gridFiles[i], "rows: %d\n", GRID_SIZE_Y);
+            fprintf(gridFiles[i], "cols: %d\n", GRID_SIZE_X);
+        }
+
+#ifdef HAVE_GDAL
+        // open GDAL GeoTIFF files; their rasters are written on closing
+        if(outputFormat == OUTPUT_FORMAT_GDAL_GTIFF || outputFormat == OUTPUT_FORMAT_ALL)
+        {
+            GDALAllRegister();
+
+            fileName = outputName + ext[i] + ".tif";
+            GDALDriver* tpDriver = GetGDALDriverManager()->GetDriverByName("GTIFF");
+
+            if (tpDriver && CSLFetchBoolean(tpDriver->GetMetadata(), GDAL_DCAP_CREATE, FALSE))
+            {
+                char **papszOptions = NULL;
+                GDALDataset *dataset = tpDriver->Create(fileName.c_str(), GRID_SIZE_X, GRID_SIZE_Y, 1, GDT_Float32, papszOptions);
+                if (dataset == NULL)
+                {
+                    cerr << "File open error: " << fileName << endl;
+                    return -1;
+                }
+
+                if (adfGeoTransform)
+                {
+                    dataset->SetGeoTransform(adfGeoTransform);
+                }
+                else
+                {
+                    double defaultTransform [6] = { min_x - 0.5*GRID_DIST_X,                            // top left x
+                                                    (double)GRID_DIST_X,                                // w-e pixel resolution
+                                                    0.0,                                                // no rotation/shear
+                                                    min_y - 0.5*GRID_DIST_Y + GRID_DIST_Y*GRID_SIZE_Y,  // top left y
+                                                    0.0,                                                // no rotation/shear
+                                                    -(double)GRID_DIST_Y };                             // n-x pixel resolution (negative value)
+                    dataset->SetGeoTransform(defaultTransform);
+                }
+                if (wkt)
+                    dataset->SetProjection(wkt);
+
+                gdalFiles[i] = dataset;
+                gdalRasters[i] = new float[(size_t)GRID_SIZE_X * GRID_SIZE_Y];
+            }
+        }
+#endif
+    }
+
+    return 0;
+}
+
+// one value of a cell the way the other engines print it
+static void print_cell(FILE *fp, int type, const GridPoint& gp)
+{
+    if(gp.empty == 0 && gp.filled == 0)
+    {
+        fprintf(fp, "-9999 ");
+        return;
+    }
+
+    switch(type)
+    {
+    case 0:
+        fprintf(fp, "%f ", gp.Zmin);
+        break;
+    case 1:
+        fprintf(fp, "%f ", gp.Zmax);
+        break;
+    case 2:
+        fprintf(fp, "%f ", gp.Zmean);
+        break;
+    case 3:
+        fprintf(fp, "%f ", gp.Zidw);
+        break;
+    case 4:
+        fprintf(fp, "%d ", gp.count);
+        break;
+    case 5:
+        fprintf(fp, "%f ", gp.Zstd);
+        break;
+    }
+}
+
+// prints the rows of a gridded band, top row first
+void SpillInterp::writeBand(Band& band)
+{
+    int i, j, t;
+    int numTypes = (int)arcFiles.size();
+
+    for(j = band.upper; j >= band.lower; j--)
+    {
+        int row = j - band.overlap_lower;
+
+        for(i = 0; i < GRID_SIZE_X; i++)
+        {
+            GridPoint gp = band.grid->get_grid_point(i, row);
+
+            for(t = 0; t < numTypes; t++)
+            {
+                if(arcFiles[t] != NULL)
+                    print_cell(arcFiles[t], t, gp);
+                if(gridFiles[t] != NULL)
+                    print_cell(gridFiles[t], t, gp);
+
+                if(gdalRasters[t] != NULL)
+                {
+                    float value;
+                    if(gp.empty == 0 && gp.filled == 0)
+                        value = -9999.f;
+                    else
+                    {
+                        double values[6] = {gp.Zmin, gp.Zmax, gp.Zmean, gp.Zidw, (double)gp.count, gp.Zstd};
+                        value = (float)values[t];
+                    }
+                    gdalRasters[t][(size_t)(GRID_SIZE_Y - 1 - j) * GRID_SIZE_X + i] = value;
+                }
+            }
+        }
+
+        for(t = 0; t < numTypes; t++)
+        {
+            if(arcFiles[t] != NULL)
+                fprintf(arcFiles[t], "\n");
+            if(gridFiles[t] != NULL)
+                fprintf(gridFiles[t], "\n");
+        }
+    }
+}
+
+void SpillInterp::closeOutput()
+{
+    for(size_t i = 0; i < arcFiles.size(); i++)
+    {
+        if(arcFiles[i] != NULL)
+            fclose(arcFiles[i]);
+        if(gridFiles[i] != NULL)
+            fclose(gridFiles[i]);
+
+#ifdef HAVE_GDAL
+        if(gdalFiles[i] != NULL)
+        {
+            GDALDataset *dataset = (GDALDataset *)gdalFiles[i];
+            GDALRasterBand *tBand = dataset->GetRasterBand(1);
+            tBand->SetNoDataValue(-9999.f);
+
+            if (GRID_SIZE_X > 0 && GRID_SIZE_Y > 0)
+                tBand->RasterIO(GF_Write, 0, 0, GRID_SIZE_X, GRID_SIZE_Y, gdalRasters[i], GRID_SIZE_X, GRID_SIZE_Y, GDT_Float32, 0, 0);
+            GDALClose((GDALDatasetH) dataset);
+        }
+#endif
+        delete [] gdalRasters[i];
+    }
+
+    arcFiles.clear();
+    gridFiles.clear();
+    gdalFiles.clear();
+    gdalRasters.clear();
+}
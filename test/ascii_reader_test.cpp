@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <points2grid/AsciiReader.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+#include "config.hpp"
+
+
+namespace points2grid
+{
+
+namespace
+{
+
+bool parse(const char *line, double& x, double& y, double& z)
+{
+    return AsciiReader::parseLine(line, line + strlen(line), x, y, z);
+}
+
+}
+
+TEST(AsciiReaderTest, ParseLine)
+{
+    double x, y, z;
+
+    EXPECT_TRUE(parse("1.5,-2.25,3e2", x, y, z));
+    EXPECT_EQ(1.5, x);
+    EXPECT_EQ(-2.25, y);
+    EXPECT_EQ(300.0, z);
+
+    // whitespace, a leading '+', repeated commas and a CR are ignored
+    EXPECT_TRUE(parse(" 10 ,,+20, 30.125\r", x, y, z));
+    EXPECT_EQ(10.0, x);
+    EXPECT_EQ(20.0, y);
+    EXPECT_EQ(30.125, z);
+
+    // extra columns are ignored
+    EXPECT_TRUE(parse("1,2,3,4", x, y, z));
+    EXPECT_EQ(3.0, z);
+
+    // rounding matches strtod
+    EXPECT_TRUE(parse("0.1,475000.123456789,2.2250738585072014e-308", x, y, z));
+    EXPECT_EQ(0.1, x);
+    EXPECT_EQ(475000.123456789, y);
+    EXPECT_EQ(2.2250738585072014e-308, z);
+
+    EXPECT_FALSE(parse("", x, y, z));
+    EXPECT_FALSE(parse("\r", x, y, z));
+    EXPECT_FALSE(parse("1,2", x, y, z));
+}
+
+TEST(AsciiReaderTest, ThreadsAndSpillKeepFileOrder)
+{
+    std::string infile = get_test_data_filename("ascii-reader.txt");
+    const int num_points = 20000;
+
+    FILE *fp = fopen(infile.c_str(), "w");
+    ASSERT_TRUE(fp != NULL);
+    fprintf(fp, "x,y,z\n");
+    for (int i = 0; i < num_points; ++i)
+    {
+        fprintf(fp, "%d.5,%d,%d\n", i, -i, i % 7);
+        if (i % 1000 == 0)
+            fprintf(fp, "\n");
+    }
+    fclose(fp);
+
+    int threads[] = {1, 3};
+    for (int t = 0; t < 2; ++t)
+    {
+        AsciiReader reader;
+        PointSpill spill;
+        std::vector<double> x, y, z;
+        int count = 0;
+
+        ASSERT_EQ(0, reader.open(infile, threads[t]));
+        ASSERT_EQ(0, spill.create());
+        while (reader.read(x, y, z))
+        {
+            for (size_t i = 0; i < x.size(); ++i, ++count)
+            {
+                EXPECT_EQ(count + 0.5, x[i]);
+                EXPECT_EQ(-count, y[i]);
+                EXPECT_EQ(count % 7, z[i]);
+            }
+            ASSERT_EQ(0, spill.write(x, y, z));
+        }
+        EXPECT_EQ(num_points, count);
+
+        count = 0;
+        ASSERT_EQ(0, spill.rewind());
+        while (spill.read(x, y, z))
+        {
+            for (size_t i = 0; i < x.size(); ++i, ++count)
+                EXPECT_EQ(count + 0.5, x[i]);
+        }
+        EXPECT_EQ(num_points, count);
+
+        reader.rewind();
+        ASSERT_TRUE(reader.read(x, y, z));
+        EXPECT_EQ(0.5, x[0]);
+    }
+
+    std::remove(infile.c_str());
+}
+
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <points2grid/DiskStencil.hpp>
+
+#include <math.h>
+
+
+namespace points2grid
+{
+
+namespace
+{
+
+// the cell-by-cell test the quadrant walks used to make
+bool in_disk(double data_x, double data_y, int i, int j,
+             double dist_x, double dist_y, double radius_sqr)
+{
+    int lower_grid_x = (int)floor(data_x / dist_x);
+    int lower_grid_y = (int)floor(data_y / dist_y);
+    double x = data_x - lower_grid_x * dist_x;
+    double y = data_y - lower_grid_y * dist_y;
+
+    double dx = i > lower_grid_x ? (i - (lower_grid_x + 1)) * dist_x + (dist_x - x) : (lower_grid_x - i) * dist_x + x;
+    double dy = j > lower_grid_y ? (j - (lower_grid_y + 1)) * dist_y + (dist_y - y) : (lower_grid_y - j) * dist_y + y;
+
+    return dx * dx + dy * dy <= radius_sqr;
+}
+
+}
+
+TEST(DiskStencilTest, CoverMatchesCellByCell)
+{
+    const int size_x = 40;
+    const int size_y = 30;
+    const double dist[][2] = {{1.0, 1.0}, {0.7, 1.3}, {2.0, 0.5}};
+    const double radius[] = {0.4, 1.0, 2.5, 4.05};
+    const double points[][2] = {{0.0, 0.0}, {13.37, 9.1}, {-1.5, 12.0}, {27.9, 31.2}, {20.0, 15.0}};
+
+    for (int d = 0; d < 3; ++d)
+        for (int r = 0; r < 4; ++r)
+        {
+            double radius_sqr = radius[r] * radius[r];
+            DiskStencil stencil;
+            StencilCover cover;
+            stencil.init(dist[d][0], dist[d][1], radius_sqr);
+
+            for (int p = 0; p < 5; ++p)
+            {
+                double data_x = points[p][0] * dist[d][0];
+                double data_y = points[p][1] * dist[d][1];
+                stencil.cover(data_x, data_y, 0, size_x, 2, size_y, cover);
+
+                int covered[size_y][size_x] = {{0}};
+                for (int s = 0; s < cover.num_spans; ++s)
+                {
+                    const StencilSpan& span = cover.spans[s];
+                    for (int i = span.first; i <= span.last; ++i)
+                    {
+                        ASSERT_TRUE(i >= 0 && i < size_x && span.row >= 2 && span.row < size_y);
+                        covered[span.row][i]++;
+                    }
+                }
+
+                for (int j = 2; j < size_y; ++j)
+                    for (int i = 0; i < size_x; ++i)
+                        EXPECT_EQ(in_disk(data_x, data_y, i, j, dist[d][0], dist[d][1], radius_sqr) ? 1 : 0,
+                                  covered[j][i]);
+            }
+        }
+}
+
+}
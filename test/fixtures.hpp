@@ -1,6 +1,12 @@
 #pragma once
 
 #include <gtest/gtest.h>
+#include <points2grid/InCoreInterp.hpp>
+#include <points2grid/Global.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
 
 #include "config.hpp"
 
@@ -69,4 +75,66 @@ public:
 };
 
 
+// deterministic pseudo-random coordinates, so every run grids the same cloud
+inline double next_value(unsigned int& state, double range)
+{
+    state = state * 1103515245u + 12345u;
+    return range * ((state >> 8) & 0xFFFF) / 65536.0;
+}
+
+// points in a few clumps over a size_x by size_y grid of cells dist apart,
+// so the null filling has gaps to fill between them
+inline void fill_clumped_grid(CoreInterp& interp, int size_x, int size_y, double dist, int num_points)
+{
+    unsigned int state = 7;
+
+    for (int i = 0; i < num_points; ++i)
+    {
+        double x = next_value(state, (size_x - 1) * dist);
+        double y = next_value(state, (size_y - 1) * dist);
+        double z = 100.0 + next_value(state, 50.0);
+        if (((int)x / 20 + (int)y / 15) % 3 == 0)
+            continue;
+        interp.update(x, y, z);
+    }
+}
+
+// compares the Arc ASCII output outfile + ext, one of ".mean.asc",
+// ".idw.asc", ".den.asc" or ".std.asc", with the grid of incore, and
+// removes it
+inline void expect_asc_matches_incore(const std::string& outfile, const std::string& ext, InCoreInterp& incore, int size_x, int size_y)
+{
+    std::string name = outfile + ext;
+    std::ifstream is(name.c_str());
+    ASSERT_TRUE(is.good());
+
+    std::string line;
+    for (int i = 0; i < 6; ++i)
+        std::getline(is, line);
+
+    for (int j = size_y - 1; j >= 0; --j)
+    {
+        for (int i = 0; i < size_x; ++i)
+        {
+            double value;
+            ASSERT_TRUE(static_cast<bool>(is >> value));
+
+            GridPoint e = incore.get_grid_point(i, j);
+            if (e.empty == 0 && e.filled == 0)
+                EXPECT_EQ(-9999, value);
+            else if (ext == ".mean.asc")
+                EXPECT_NEAR(e.Zmean, value, 1e-5);
+            else if (ext == ".idw.asc")
+                EXPECT_NEAR(e.Zidw, value, 1e-5);
+            else if (ext == ".den.asc")
+                EXPECT_EQ(e.count, value);
+            else
+                EXPECT_NEAR(e.Zstd, value, 1e-5);
+        }
+    }
+
+    is.close();
+    std::remove(name.c_str());
+}
+
 }
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+#include <points2grid/InCoreInterp.hpp>
+#include <points2grid/GridCells.hpp>
+
+#include <points2grid/config.h>
+#include <points2grid/Global.hpp>
+
+#include "fixtures.hpp"
+
+
+namespace points2grid
+{
+
+namespace
+{
+
+const int GRID_X = 37;
+const int GRID_Y = 53;
+const double DIST = 2.0;
+
+void fill_grid(InCoreInterp& interp, int num_points)
+{
+    unsigned int state = 42;
+
+    interp.init();
+    for (int i = 0; i < num_points; ++i)
+    {
+        double x = next_value(state, (GRID_X - 1) * DIST);
+        double y = next_value(state, (GRID_Y - 1) * DIST);
+        double z = 100.0 + next_value(state, 50.0);
+        interp.update(x, y, z);
+    }
+    interp.calculate_grid_values();
+}
+
+void expect_same_grid(InCoreInterp& expected, InCoreInterp& actual, int size_x = GRID_X, int size_y = GRID_Y)
+{
+    for (int i = 0; i < size_x; ++i)
+    {
+        for (int j = 0; j < size_y; ++j)
+        {
+            const GridPoint& e = expected.get_grid_point(i, j);
+            const GridPoint& a = actual.get_grid_point(i, j);
+
+            EXPECT_EQ(e.count, a.count);
+            EXPECT_EQ(e.Zmin, a.Zmin);
+            EXPECT_EQ(e.Zmax, a.Zmax);
+            EXPECT_EQ(e.Zmean, a.Zmean);
+            EXPECT_EQ(e.Zidw, a.Zidw);
+            EXPECT_EQ(e.Zstd, a.Zstd);
+            EXPECT_EQ(e.empty, a.empty);
+            EXPECT_EQ(e.filled, a.filled);
+        }
+    }
+}
+
+}
+
+TEST(InCoreInterpTest, ThreadedMatchesSerial)
+{
+    double radius = 2.5 * DIST;
+
+    InCoreInterp serial(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                        0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 3);
+    fill_grid(serial, 300);
+
+    int threads[] = {2, 4, 7};
+    for (int t = 0; t < 3; ++t)
+    {
+        InCoreInterp threaded(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                              0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 3);
+        threaded.setThreads(threads[t]);
+        fill_grid(threaded, 300);
+
+        expect_same_grid(serial, threaded);
+    }
+}
+
+TEST(InCoreInterpTest, BatchMatchesPointUpdates)
+{
+    double radius = 2.5 * DIST;
+    const int num_points = 300;
+
+    std::vector<double> x(num_points), y(num_points), z(num_points);
+    unsigned int state = 42;
+    for (int i = 0; i < num_points; ++i)
+    {
+        x[i] = next_value(state, (GRID_X - 1) * DIST);
+        y[i] = next_value(state, (GRID_Y - 1) * DIST);
+        z[i] = 100.0 + next_value(state, 50.0);
+    }
+
+    InCoreInterp serial(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                        0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 3);
+    fill_grid(serial, num_points);
+
+    int threads[] = {1, 3};
+    for (int t = 0; t < 2; ++t)
+    {
+        InCoreInterp batched(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                             0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 3);
+        batched.setThreads(threads[t]);
+        batched.init();
+
+        // uneven batches through the base class entry point
+        CoreInterp& core = batched;
+        EXPECT_EQ(0, core.update_batch(&x[0], &y[0], &z[0], 1));
+        EXPECT_EQ(0, core.update_batch(&x[1], &y[1], &z[1], 0));
+        EXPECT_EQ(0, core.update_batch(&x[1], &y[1], &z[1], num_points - 1));
+        batched.calculate_grid_values();
+
+        expect_same_grid(serial, batched);
+    }
+}
+
+TEST(InCoreInterpTest, SelectedOutputTypesMatchAll)
+{
+    double radius = 2.5 * DIST;
+
+    InCoreInterp all(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                     0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 3);
+    fill_grid(all, 300);
+
+    unsigned int types[] = {OUTPUT_TYPE_MIN, OUTPUT_TYPE_MAX, OUTPUT_TYPE_MEAN,
+                            OUTPUT_TYPE_IDW, OUTPUT_TYPE_DEN, OUTPUT_TYPE_STD,
+                            OUTPUT_TYPE_MAX | OUTPUT_TYPE_IDW};
+    for (int t = 0; t < 7; ++t)
+    {
+        InCoreInterp selected(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                              0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 3);
+        selected.setOutputType(types[t]);
+        fill_grid(selected, 300);
+
+        for (int i = 0; i < GRID_X; ++i)
+        {
+            for (int j = 0; j < GRID_Y; ++j)
+            {
+                GridPoint e = all.get_grid_point(i, j);
+                GridPoint a = selected.get_grid_point(i, j);
+
+                EXPECT_EQ(e.empty, a.empty);
+                EXPECT_EQ(e.filled, a.filled);
+                if (types[t] & OUTPUT_TYPE_MIN)
+                {
+                    EXPECT_EQ(e.Zmin, a.Zmin);
+                }
+                if (types[t] & OUTPUT_TYPE_MAX)
+                {
+                    EXPECT_EQ(e.Zmax, a.Zmax);
+                }
+                if (types[t] & OUTPUT_TYPE_MEAN)
+                {
+                    EXPECT_EQ(e.Zmean, a.Zmean);
+                }
+                if (types[t] & OUTPUT_TYPE_IDW)
+                {
+                    EXPECT_EQ(e.Zidw, a.Zidw);
+                }
+                if (types[t] & OUTPUT_TYPE_DEN)
+                {
+                    EXPECT_EQ(e.count, a.count);
+                }
+                if (types[t] & OUTPUT_TYPE_STD)
+                {
+                    EXPECT_EQ(e.Zstd, a.Zstd);
+                }
+            }
+        }
+    }
+
+    EXPECT_EQ(sizeof(double) + sizeof(unsigned int) + 1, GridCells::getCellSize(OUTPUT_TYPE_MAX));
+    EXPECT_EQ(sizeof(unsigned int) + 1, GridCells::getCellSize(OUTPUT_TYPE_DEN));
+    EXPECT_LE(GridCells::getCellSize(OUTPUT_TYPE_ALL), sizeof(GridPoint));
+}
+
+TEST(InCoreInterpTest, SparseTilesMatchDense)
+{
+    // a corridor a few cells wide across a grid of 5 x 4 sparse tiles
+    const int size_x = 600;
+    const int size_y = 400;
+    double radius = 1.5;
+
+    InCoreInterp *grids[3];
+    for (int g = 0; g < 3; ++g)
+    {
+        grids[g] = new InCoreInterp(1.0, 1.0, size_x, size_y, radius * radius,
+                                    0, size_x - 1, 0, size_y - 1, 7);
+        grids[g]->setSparse(g > 0);
+        grids[g]->setThreads(g == 2 ? 3 : 1);
+        ASSERT_EQ(0, grids[g]->init());
+
+        unsigned int state = 42;
+        for (int i = 0; i < 20000; ++i)
+        {
+            double x = next_value(state, size_x - 1);
+            double y = x * (size_y - 1) / (size_x - 1) + next_value(state, 8.0) - 4.0;
+            double z = 100.0 + next_value(state, 50.0);
+            // gaps along the corridor for the null filling
+            if (((int)x / 10) % 4 == 0 || y < 0)
+                continue;
+            grids[g]->update(x, y, z);
+        }
+        grids[g]->calculate_grid_values();
+    }
+
+    EXPECT_EQ(1u, grids[0]->getNumTiles());
+    for (int g = 1; g < 3; ++g)
+    {
+        EXPECT_LT(grids[g]->getNumTiles(), 12u);
+        expect_same_grid(*grids[0], *grids[g], size_x, size_y);
+    }
+
+    for (int g = 0; g < 3; ++g)
+        delete grids[g];
+}
+
+}
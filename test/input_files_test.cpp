@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <points2grid/InputFiles.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "config.hpp"
+
+
+namespace points2grid
+{
+
+namespace fs = boost::filesystem;
+
+class InputFilesTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        dir = fs::temp_directory_path() / fs::unique_path("p2g-inputs-%%%%-%%%%");
+        fs::create_directory(dir);
+
+        const char *names[] = {"b.las", "a.LAS", "c.las", "notes.txt"};
+        for (int i = 0; i < 4; ++i)
+            std::ofstream((dir / names[i]).string().c_str()) << "x";
+    }
+
+    virtual void TearDown()
+    {
+        fs::remove_all(dir);
+    }
+
+    std::string path(const std::string& name) const
+    {
+        return (dir / name).string();
+    }
+
+    fs::path dir;
+};
+
+TEST_F(InputFilesTest, DirectoryStandsForItsLasFiles)
+{
+    std::vector<std::string> specs(1, dir.string()), files;
+    ASSERT_EQ(0, expand_input_files(specs, files));
+
+    ASSERT_EQ(3u, files.size());
+    EXPECT_EQ(path("a.LAS"), files[0]);
+    EXPECT_EQ(path("b.las"), files[1]);
+    EXPECT_EQ(path("c.las"), files[2]);
+}
+
+TEST_F(InputFilesTest, PatternsMatchInTheirDirectory)
+{
+    std::vector<std::string> specs, files;
+    specs.push_back(path("[!a]?las"));
+    specs.push_back(path("*.txt"));
+    ASSERT_EQ(0, expand_input_files(specs, files));
+
+    ASSERT_EQ(3u, files.size());
+    EXPECT_EQ(path("b.las"), files[0]);
+    EXPECT_EQ(path("c.las"), files[1]);
+    EXPECT_EQ(path("notes.txt"), files[2]);
+
+    // a pattern matching nothing is an error, a plain name is kept as is
+    specs.assign(1, path("*.laz"));
+    EXPECT_EQ(-1, expand_input_files(specs, files));
+    specs.assign(1, path("missing.las"));
+    ASSERT_EQ(0, expand_input_files(specs, files));
+    EXPECT_EQ(path("missing.las"), files[0]);
+}
+
+TEST_F(InputFilesTest, UnterminatedBracketIsLiteral)
+{
+    std::ofstream(path("tile[").c_str()) << "x";
+    std::ofstream(path("tile[!").c_str()) << "x";
+
+    std::vector<std::string> specs, files;
+    specs.push_back(path("tile["));
+    specs.push_back(path("tile[!"));
+    specs.push_back(path("*[!"));
+    ASSERT_EQ(0, expand_input_files(specs, files));
+
+    ASSERT_EQ(3u, files.size());
+    EXPECT_EQ(path("tile["), files[0]);
+    EXPECT_EQ(path("tile[!"), files[1]);
+    EXPECT_EQ(path("tile[!"), files[2]);
+}
+
+TEST_F(InputFilesTest, ListFileSkipsBlanksAndComments)
+{
+    std::string list = path("inputs.lst");
+    std::ofstream(list.c_str()) << "# tiles\n" << path("c.las") << "\n\n  " << path("a*") << "  \n";
+
+    std::vector<std::string> specs, files;
+    ASSERT_EQ(0, read_input_list(list, specs));
+    ASSERT_EQ(2u, specs.size());
+    ASSERT_EQ(0, expand_input_files(specs, files));
+
+    ASSERT_EQ(2u, files.size());
+    EXPECT_EQ(path("c.las"), files[0]);
+    EXPECT_EQ(path("a.LAS"), files[1]);
+
+    EXPECT_EQ(-1, read_input_list(path("missing.lst"), specs));
+}
+
+}
@@ -1,7 +1,9 @@
 #include <gtest/gtest.h>
 #include <points2grid/Interpolation.hpp>
+#include <points2grid/SpillInterp.hpp>
 
 #include "gdal_priv.h"
+#include "ogr_spatialref.h"
 
 #include <points2grid/Global.hpp>
 
@@ -68,4 +70,53 @@ TEST_F(InterpolationGeotiffTest, GeotiffHeadersUserGrid)
 }
 
 
+TEST_F(InterpolationGeotiffTest, SpillGeotiffHeaders)
+{
+    Interpolation interp(1, 1, 1, 3, INTERP_SPILL);
+    interp.init(infile, INPUT_ASCII);
+    interp.interpolation(infile, outfile, INPUT_ASCII, OUTPUT_FORMAT_ALL, OUTPUT_TYPE_ALL);
+
+    GDALDataset *dataset;
+    GDALAllRegister();
+    dataset = (GDALDataset *) GDALOpen((outfile + ".idw.tif").c_str(), GA_ReadOnly);
+    ASSERT_TRUE(dataset != NULL);
+    double adfGeoTransform[6];
+    EXPECT_EQ(dataset->GetGeoTransform(adfGeoTransform), CE_None);
+    EXPECT_DOUBLE_EQ(adfGeoTransform[0], 0.5);
+    EXPECT_DOUBLE_EQ(adfGeoTransform[1], 1.0);
+    EXPECT_DOUBLE_EQ(adfGeoTransform[2], 0.0);
+    EXPECT_DOUBLE_EQ(adfGeoTransform[3], 2.5);
+    EXPECT_DOUBLE_EQ(adfGeoTransform[4], 0.0);
+    EXPECT_DOUBLE_EQ(adfGeoTransform[5], -1.0);
+    delete dataset;
+}
+
+
+TEST_F(InterpolationGeotiffTest, SpillGeotiffGeoreference)
+{
+    SpillInterp spill(1, 1, 4, 3, 1, 0, 3, 0, 2, 0);
+    ASSERT_EQ(0, spill.init());
+    spill.update(1, 1, 5);
+
+    OGRSpatialReference srs;
+    srs.SetWellKnownGeogCS("WGS84");
+    char *wkt = NULL;
+    srs.exportToWkt(&wkt);
+
+    double transform[6] = {100.0, 2.0, 0.0, 200.0, 0.0, -2.0};
+    ASSERT_EQ(0, spill.finish(outfile, OUTPUT_FORMAT_GDAL_GTIFF, OUTPUT_TYPE_MEAN, transform, wkt));
+
+    GDALAllRegister();
+    GDALDataset *dataset = (GDALDataset *) GDALOpen((outfile + ".mean.tif").c_str(), GA_ReadOnly);
+    ASSERT_TRUE(dataset != NULL);
+    double adfGeoTransform[6];
+    EXPECT_EQ(dataset->GetGeoTransform(adfGeoTransform), CE_None);
+    for (int i = 0; i < 6; ++i)
+        EXPECT_DOUBLE_EQ(transform[i], adfGeoTransform[i]);
+    EXPECT_STRNE("", dataset->GetProjectionRef());
+    delete dataset;
+    CPLFree(wkt);
+}
+
+
 }
@@ -0,0 +1,315 @@
+#include <gtest/gtest.h>
+#include <points2grid/lasfile.hpp>
+#include <points2grid/LasReader.hpp>
+
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <string.h>
+#include <vector>
+
+#include "config.hpp"
+
+
+namespace points2grid
+{
+
+namespace
+{
+
+template<typename T>
+void put(std::vector<char>& buffer, size_t offset, T value)
+{
+    memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+// the filter applied one point at a time through the las_file accessors,
+// the reference for the filter on raw records
+bool excluded(const LasFilter& filter, int classification, int return_number, int max_returns)
+{
+    // a listed classification is left out
+    if (std::find(filter.exclude_classes.begin(), filter.exclude_classes.end(), classification) != filter.exclude_classes.end())
+        return true;
+
+    // keeping the first return leaves out every other one, keeping the
+    // last leaves out those before the pulse's last
+    if (filter.filter_returns)
+        return filter.keep_first_return ? return_number != 1 : return_number != max_returns;
+
+    return false;
+}
+
+// a LAS 1.4 file of count format 6 points, the legacy count left at 0 and
+// an extended variable length record after the points
+void write_las14(const std::string& name, unsigned int count)
+{
+    const size_t header = 375, record = 30;
+    std::vector<char> file(header + count * record + 60, 0);
+
+    memcpy(&file[0], "LASF", 4);
+    file[24] = 1;
+    file[25] = 4;
+    put<unsigned short>(file, 94, header);
+    put<unsigned int>(file, 96, header);
+    file[104] = 6;
+    put<unsigned short>(file, 105, record);
+    for (int k = 0; k < 3; ++k)
+    {
+        put<double>(file, 131 + 8 * k, 0.01);
+        put<double>(file, 155 + 8 * k, 1000.0 * (k + 1));
+    }
+    put<double>(file, 179, 1000.0 + 0.01 * (count - 1));
+    put<double>(file, 187, 1000.0);
+    put<double>(file, 195, 2000.0 + 0.02 * (count - 1));
+    put<double>(file, 203, 2000.0);
+    put<unsigned long long>(file, 235, header + count * record);
+    put<unsigned int>(file, 243, 1);
+    put<unsigned long long>(file, 247, count);
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        size_t at = header + i * record;
+        put<int>(file, at, i);
+        put<int>(file, at + 4, 2 * i);
+        put<int>(file, at + 8, 3 * i);
+        // return numbers and classes beyond what the old formats hold
+        file[at + 14] = (char)((i % 15 + 1) | (15 << 4));
+        file[at + 16] = (char)(100 + i % 100);
+    }
+
+    std::ofstream os(name.c_str(), std::ios::binary);
+    os.write(&file[0], file.size());
+}
+
+}
+
+TEST(LasDecodeTest, BlocksMatchPointAccessors)
+{
+    las_file las;
+    las.open(get_test_data_filename("example.las"));
+
+    size_t count = las.points_count();
+    ASSERT_GT(count, 0u);
+
+    std::vector<double> x(count), y(count), z(count);
+    std::vector<unsigned char> returns(count), classes(count);
+
+    // odd block sizes so blocks straddle the decoder's internal chunks
+    size_t blocks[] = {1, 7, 300, count};
+    for (int b = 0; b < 4; ++b)
+    {
+        for (size_t first = 0; first < count; first += blocks[b])
+        {
+            size_t n = std::min(blocks[b], count - first);
+            las.decode_points(first, n, &x[first], &y[first], &z[first],
+                              &returns[first], &classes[first]);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            EXPECT_EQ(las.getX(i), x[i]);
+            EXPECT_EQ(las.getY(i), y[i]);
+            EXPECT_EQ(las.getZ(i), z[i]);
+            EXPECT_EQ(las.getClassification(i), classes[i]);
+            EXPECT_EQ(las.getReturnNumber(i), returns[i] & 0x0F);
+            EXPECT_EQ(las.getNumberOfReturns(i), returns[i] >> 4);
+        }
+    }
+
+    // the return and class arrays are optional
+    las.decode_points(0, count, &x[0], &y[0], &z[0]);
+    EXPECT_EQ(las.getZ(count - 1), z[count - 1]);
+}
+
+TEST(LasDecodeTest, ReaderKeepsFileOrder)
+{
+    std::string name = get_test_data_filename("example.las");
+    las_file las;
+    las.open(name);
+
+    LasFilter filter;
+    filter.exclude_classes.push_back(2);
+    filter.filter_returns = true;
+    filter.keep_first_return = false;
+
+    std::vector<double> ex, ey, ez;
+    for (size_t i = 0; i < las.points_count(); ++i)
+    {
+        if (excluded(filter, las.getClassification(i), las.getReturnNumber(i), las.getNumberOfReturns(i)))
+            continue;
+        ex.push_back(las.getX(i) - 10);
+        ey.push_back(las.getY(i) - 20);
+        ez.push_back(las.getZ(i));
+    }
+    ASSERT_GT(ex.size(), 0u);
+
+    // inline, and with more decoder threads than batches
+    int decoders[] = {0, 1, 3};
+    for (int d = 0; d < 3; ++d)
+    {
+        LasReader reader;
+        ASSERT_EQ(0, reader.open(name, decoders[d], filter, 10, 20));
+        EXPECT_EQ(las.points_count(), reader.pointsCount());
+
+        std::vector<double> x, y, z, ax, ay, az;
+        while (reader.read(x, y, z))
+        {
+            ax.insert(ax.end(), x.begin(), x.end());
+            ay.insert(ay.end(), y.begin(), y.end());
+            az.insert(az.end(), z.begin(), z.end());
+        }
+        EXPECT_EQ(ex, ax);
+        EXPECT_EQ(ey, ay);
+        EXPECT_EQ(ez, az);
+    }
+}
+
+TEST(LasDecodeTest, FilterOnRawRecords)
+{
+    las_file las;
+    las.open(get_test_data_filename("example.las"));
+    size_t count = (size_t)las.points_count();
+    ASSERT_LT(0u, count);
+
+    std::vector<double> x(count), y(count), z(count);
+    las.decode_points(0, count, &x[0], &y[0], &z[0]);
+
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        LasFilter filter;
+        filter.exclude_classes.push_back(2);
+        filter.exclude_classes.push_back(300);
+        filter.filter_returns = mode != 0;
+        filter.keep_first_return = mode == 1;
+
+        las_point_filter compiled;
+        filter.compile(compiled);
+
+        std::vector<uint32_t> selected(count);
+        size_t kept = las.filter_points(0, count, compiled, &selected[0]);
+
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!excluded(filter, las.getClassification(i), las.getReturnNumber(i), las.getNumberOfReturns(i)))
+                expected.push_back((uint32_t)i);
+        }
+        ASSERT_EQ(expected.size(), kept);
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), selected.begin()));
+
+        std::vector<double> sx(count), sy(count), sz(count);
+        las.decode_selected(0, &selected[0], kept, &sx[0], &sy[0], &sz[0]);
+        for (size_t j = 0; j < kept; ++j)
+        {
+            EXPECT_EQ(x[selected[j]], sx[j]);
+            EXPECT_EQ(y[selected[j]], sy[j]);
+            EXPECT_EQ(z[selected[j]], sz[j]);
+        }
+    }
+
+    // nothing to filter keeps every record
+    std::vector<uint32_t> selected(count);
+    EXPECT_EQ(count, las.filter_points(0, count, las_point_filter(), &selected[0]));
+    EXPECT_EQ(count - 1, selected[count - 1]);
+}
+
+TEST(LasDecodeTest, ClipOnRawRecords)
+{
+    las_file las;
+    las.open(get_test_data_filename("example.las"));
+    size_t count = (size_t)las.points_count();
+
+    std::vector<double> x(count), y(count), z(count);
+    las.decode_points(0, count, &x[0], &y[0], &z[0]);
+
+    // the middle of the extent
+    double *mins = las.minimums(), *maxs = las.maximums();
+    double min_x = mins[0] + (maxs[0] - mins[0]) / 4, max_x = maxs[0] - (maxs[0] - mins[0]) / 4;
+    double min_y = mins[1] + (maxs[1] - mins[1]) / 4, max_y = maxs[1] - (maxs[1] - mins[1]) / 4;
+
+    las_point_filter filter;
+    las.clip_filter(filter, min_x, min_y, max_x, max_y);
+    ASSERT_TRUE(filter.clip);
+
+    std::vector<uint32_t> selected(count);
+    size_t kept = las.filter_points(0, count, filter, &selected[0]);
+    ASSERT_LT(0u, kept);
+    ASSERT_GT(count, kept);
+
+    // every point inside is kept, and those kept outside are within a unit
+    // of the record scale
+    size_t inside = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (x[i] >= min_x && x[i] <= max_x && y[i] >= min_y && y[i] <= max_y)
+            inside++;
+    }
+    EXPECT_LE(inside, kept);
+    for (size_t j = 0; j < kept; ++j)
+    {
+        EXPECT_LE(min_x - 2 * las.scale()[0], x[selected[j]]);
+        EXPECT_GE(max_x + 2 * las.scale()[0], x[selected[j]]);
+        EXPECT_LE(min_y - 2 * las.scale()[1], y[selected[j]]);
+        EXPECT_GE(max_y + 2 * las.scale()[1], y[selected[j]]);
+    }
+
+    // a box around the whole extent needs no clip
+    las_point_filter all;
+    las.clip_filter(all, mins[0] - 1, mins[1] - 1, maxs[0] + 1, maxs[1] + 1);
+    EXPECT_FALSE(all.clip);
+    EXPECT_TRUE(all.keeps_all());
+}
+
+TEST(LasDecodeTest, Las14ExtendedFormat)
+{
+    std::string name = get_test_data_filename("las14.las");
+    const unsigned int count = 5000;
+    write_las14(name, count);
+
+    {
+        las_file las;
+        las.open(name);
+        ASSERT_EQ(count, las.points_count());
+        EXPECT_EQ(6, las.point_format());
+
+        std::vector<double> x(count), y(count), z(count);
+        std::vector<unsigned char> returns(count), classes(count);
+        las.decode_points(0, count, &x[0], &y[0], &z[0], &returns[0], &classes[0]);
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            EXPECT_DOUBLE_EQ(1000.0 + 0.01 * i, x[i]);
+            EXPECT_DOUBLE_EQ(2000.0 + 0.02 * i, y[i]);
+            EXPECT_DOUBLE_EQ(3000.0 + 0.03 * i, z[i]);
+            EXPECT_EQ((int)(i % 15 + 1), returns[i] & 0x0F);
+            EXPECT_EQ(15, returns[i] >> 4);
+            EXPECT_EQ((int)(100 + i % 100), classes[i]);
+            EXPECT_EQ(las.getReturnNumber(i), returns[i] & 0x0F);
+            EXPECT_EQ(las.getNumberOfReturns(i), returns[i] >> 4);
+            EXPECT_EQ(las.getClassification(i), classes[i]);
+        }
+    }
+
+    // only the last of the 15 returns, and not class 150
+    LasFilter filter;
+    filter.exclude_classes.push_back(150);
+    filter.filter_returns = true;
+
+    LasReader reader;
+    ASSERT_EQ(0, reader.open(name, 2, filter, 1000, 2000));
+    std::vector<double> x, y, z, kept;
+    while (reader.read(x, y, z))
+        kept.insert(kept.end(), z.begin(), z.end());
+
+    std::vector<double> expected;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        if (i % 15 == 14 && i % 100 != 50)
+            expected.push_back(3000.0 + 0.03 * i);
+    }
+    EXPECT_EQ(expected, kept);
+
+    std::remove(name.c_str());
+}
+
+}
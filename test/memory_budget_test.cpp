@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <points2grid/MemoryBudget.hpp>
+
+
+namespace points2grid
+{
+
+TEST(MemoryBudgetTest, CgroupLimits)
+{
+    // cgroup v2
+    EXPECT_EQ(2147483648.0, parse_cgroup_limit("2147483648\n"));
+    EXPECT_EQ(0, parse_cgroup_limit("max\n"));
+
+    // cgroup v1, where no limit is the largest page-aligned 64-bit value
+    EXPECT_EQ(536870912.0, parse_cgroup_limit("536870912\n"));
+    EXPECT_EQ(0, parse_cgroup_limit("9223372036854771712\n"));
+
+    // unreadable or empty files
+    EXPECT_EQ(0, parse_cgroup_limit(""));
+    EXPECT_EQ(0, parse_cgroup_limit("garbage"));
+}
+
+TEST(MemoryBudgetTest, CgroupStat)
+{
+    const char *stat =
+        "anon 1048576\n"
+        "file 8388608\n"
+        "active_file 2097152\n"
+        "inactive_file 6291456\n";
+
+    EXPECT_EQ(6291456.0, parse_cgroup_stat(stat, "inactive_file"));
+    EXPECT_EQ(1048576.0, parse_cgroup_stat(stat, "anon"));
+    EXPECT_EQ(0, parse_cgroup_stat(stat, "total_inactive_file"));
+    EXPECT_EQ(0, parse_cgroup_stat("", "inactive_file"));
+}
+
+TEST(MemoryBudgetTest, Meminfo)
+{
+    const char *meminfo =
+        "MemTotal:       16318508 kB\n"
+        "MemFree:         1207608 kB\n"
+        "MemAvailable:    9800000 kB\n"
+        "Buffers:          201464 kB\n";
+
+    EXPECT_EQ(9800000.0 * 1024, parse_meminfo_available(meminfo));
+    EXPECT_EQ(0, parse_meminfo_available("MemTotal:       16318508 kB\n"));
+}
+
+TEST(MemoryBudgetTest, HeadroomLeftByUsage)
+{
+    double gb = 1024.0 * 1024 * 1024;
+
+    // a busy cgroup has only what its usage leaves, and inactive page
+    // cache does not count as used
+    EXPECT_EQ(4 * gb, cgroup_headroom(8 * gb, 4 * gb, 0));
+    EXPECT_EQ(6 * gb, cgroup_headroom(8 * gb, 4 * gb, 2 * gb));
+    EXPECT_EQ(8 * gb, cgroup_headroom(8 * gb, 1 * gb, 2 * gb));
+
+    // at or over its limit it still has one; without a limit it has none
+    EXPECT_EQ(1, cgroup_headroom(8 * gb, 9 * gb, 0));
+    EXPECT_EQ(0, cgroup_headroom(0, 4 * gb, 0));
+}
+
+TEST(MemoryBudgetTest, SmallerLimit)
+{
+    double gb = 1024.0 * 1024 * 1024;
+
+    // a cgroup limit above the physical memory leaves the system's figure
+    EXPECT_EQ(16 * gb, smaller_memory_limit(64 * gb, 16 * gb));
+    EXPECT_EQ(2 * gb, smaller_memory_limit(2 * gb, 16 * gb));
+    EXPECT_EQ(16 * gb, smaller_memory_limit(0, 16 * gb));
+    EXPECT_EQ(2 * gb, smaller_memory_limit(2 * gb, 0));
+    EXPECT_EQ(0, smaller_memory_limit(0, 0));
+}
+
+}
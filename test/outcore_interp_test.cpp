@@ -0,0 +1,337 @@
+#include <gtest/gtest.h>
+#include <points2grid/InCoreInterp.hpp>
+#include <points2grid/OutCoreInterp.hpp>
+#include <points2grid/GridFile.hpp>
+
+#include <points2grid/config.h>
+#include <points2grid/Global.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "config.hpp"
+#include "fixtures.hpp"
+
+
+namespace points2grid
+{
+
+namespace
+{
+
+const int GRID_X = 150;
+const int GRID_Y = 150;
+const double DIST = 1.0;
+
+}
+
+TEST(OutCoreInterpTest, TilesMatchInCore)
+{
+    double radius = 1.8 * DIST;
+    std::string outfile = get_test_data_filename("outcore-tiles");
+
+    InCoreInterp incore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                        0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 5);
+    incore.init();
+
+    // a budget of the grid's size leaves no room for the queues, so the
+    // grid is split in both directions
+    OutCoreInterp outcore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                          0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 5);
+    outcore.setMemoryBudget(GRID_X * GRID_Y * sizeof(GridPoint));
+    // the points are applied, and the halos reconciled, by as many
+    // workers as tiles fit the budget
+    outcore.setThreads(3);
+    ASSERT_EQ(0, outcore.init());
+    EXPECT_GT(outcore.getTilesX(), 1);
+    EXPECT_GT(outcore.getTilesY(), 1);
+    EXPECT_EQ(3, outcore.getNumWorkers());
+
+    // besides the clumps, points within the search radius of the seams
+    // between the tiles, so that they reach the halos of two tiles, or
+    // of four near the corners
+    int width = (GRID_X + outcore.getTilesX() - 1) / outcore.getTilesX();
+    int height = (GRID_Y + outcore.getTilesY() - 1) / outcore.getTilesY();
+    unsigned int state = 17;
+    CoreInterp *engines[2] = {&incore, &outcore};
+    for (int e = 0; e < 2; ++e)
+        fill_clumped_grid(*engines[e], GRID_X, GRID_Y, DIST, 20000);
+    for (int k = 0; k < 4000; ++k)
+    {
+        double x = next_value(state, (GRID_X - 1) * DIST);
+        double y = next_value(state, (GRID_Y - 1) * DIST);
+        double z = 100.0 + next_value(state, 50.0);
+        int seam_x = ((int)(x / DIST) + width / 2) / width * width;
+        int seam_y = ((int)(y / DIST) + height / 2) / height * height;
+        if (k % 3 != 1 && seam_x > 0 && seam_x < GRID_X)
+            x = seam_x * DIST - radius + next_value(state, 2 * radius);
+        if (k % 3 != 0 && seam_y > 0 && seam_y < GRID_Y)
+            y = seam_y * DIST - radius + next_value(state, 2 * radius);
+
+        for (int e = 0; e < 2; ++e)
+            engines[e]->update(x, y, z);
+    }
+
+    incore.calculate_grid_values();
+    ASSERT_EQ(0, outcore.finish(outfile, OUTPUT_FORMAT_ARC_ASCII, OUTPUT_TYPE_MEAN | OUTPUT_TYPE_IDW | OUTPUT_TYPE_DEN));
+
+    // and the tiles did not all fit at once
+    EXPECT_GT(outcore.getCacheEvictions(), 0ul);
+
+    const char *ext[3] = {".mean.asc", ".idw.asc", ".den.asc"};
+    for (int t = 0; t < 3; ++t)
+        expect_asc_matches_incore(outfile, ext[t], incore, GRID_X, GRID_Y);
+}
+
+// the tiles apply their queued points in row order, not input order; the
+// first of several points on a cell center must still set its IDW value
+TEST(OutCoreInterpTest, ExactHitsMatchInCore)
+{
+    double radius = 1.8 * DIST;
+    std::string outfile = get_test_data_filename("outcore-exact");
+
+    InCoreInterp incore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                        0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 0);
+    OutCoreInterp outcore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                          0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 0);
+    outcore.setMemoryBudget(GRID_X * GRID_Y * sizeof(GridPoint));
+    incore.init();
+    ASSERT_EQ(0, outcore.init());
+    EXPECT_GT(outcore.getTilesY(), 1);
+
+    // two points on each of a few cell centers, with points of lower rows
+    // around and between them
+    unsigned int state = 11;
+    CoreInterp *engines[2] = {&incore, &outcore};
+    for (int k = 0; k < 2000; ++k)
+    {
+        double cx = (int)next_value(state, GRID_X - 1) * DIST;
+        double cy = (int)next_value(state, GRID_Y - 1) * DIST;
+        double x = next_value(state, (GRID_X - 1) * DIST);
+        double y = next_value(state, (GRID_Y - 1) * DIST);
+
+        for (int e = 0; e < 2; ++e)
+        {
+            engines[e]->update(x, y, 150.0);
+            engines[e]->update(cx, cy, 100.0 + k);
+            engines[e]->update(cx + 0.5 * DIST, cy - DIST, 120.0);
+            engines[e]->update(cx, cy, 50.0 - k);
+        }
+    }
+
+    incore.calculate_grid_values();
+    ASSERT_EQ(0, outcore.finish(outfile, OUTPUT_FORMAT_ARC_ASCII, OUTPUT_TYPE_IDW | OUTPUT_TYPE_MEAN));
+    expect_asc_matches_incore(outfile, ".idw.asc", incore, GRID_X, GRID_Y);
+    expect_asc_matches_incore(outfile, ".mean.asc", incore, GRID_X, GRID_Y);
+}
+
+// points only around the corner shared by four tiles, so the other tiles
+// are never mapped while the points are applied and reconcile against
+// neighbours whose halos hold nothing
+TEST(OutCoreInterpTest, EmptyNeighboursMatchInCore)
+{
+    double radius = 1.8 * DIST;
+    std::string outfile = get_test_data_filename("outcore-empty");
+
+    InCoreInterp incore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                        0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 5);
+    OutCoreInterp outcore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                          0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 5);
+    outcore.setMemoryBudget(GRID_X * GRID_Y * sizeof(GridPoint));
+    outcore.setThreads(2);
+    incore.init();
+    ASSERT_EQ(0, outcore.init());
+    ASSERT_EQ(2, outcore.getTilesX());
+    ASSERT_GT(outcore.getTilesY(), 2);
+
+    int width = (GRID_X + 1) / 2;
+    int height = (GRID_Y + outcore.getTilesY() - 1) / outcore.getTilesY();
+
+    unsigned int state = 13;
+    CoreInterp *engines[2] = {&incore, &outcore};
+    for (int k = 0; k < 3000; ++k)
+    {
+        double x = (width - 15 + next_value(state, 30)) * DIST;
+        double y = (height - 10 + next_value(state, 20)) * DIST;
+        double z = 100.0 + next_value(state, 50.0);
+
+        for (int e = 0; e < 2; ++e)
+            engines[e]->update(x, y, z);
+    }
+
+    incore.calculate_grid_values();
+    ASSERT_EQ(0, outcore.finish(outfile, OUTPUT_FORMAT_ARC_ASCII, OUTPUT_TYPE_MEAN | OUTPUT_TYPE_IDW | OUTPUT_TYPE_DEN));
+
+    const char *ext[3] = {".mean.asc", ".idw.asc", ".den.asc"};
+    for (int t = 0; t < 3; ++t)
+        expect_asc_matches_incore(outfile, ext[t], incore, GRID_X, GRID_Y);
+}
+
+// every tile is owned by one worker, which gets the tile's points in input
+// order, so the grid does not depend on how many workers there are, even
+// when they have to swap their tiles
+TEST(OutCoreInterpTest, WorkersMatchOneThread)
+{
+    double radius = 1.8 * DIST;
+    std::string outfile[2] = {get_test_data_filename("outcore-one"), get_test_data_filename("outcore-workers")};
+    int threads[2] = {1, 3};
+    std::string grid[2];
+
+    for (int r = 0; r < 2; ++r)
+    {
+        OutCoreInterp outcore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                              0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 0);
+        outcore.setMemoryBudget(GRID_X * GRID_Y * sizeof(GridPoint));
+        outcore.setThreads(threads[r]);
+        ASSERT_EQ(0, outcore.init());
+        EXPECT_EQ(threads[r], outcore.getNumWorkers());
+        fill_clumped_grid(outcore, GRID_X, GRID_Y, DIST, 20000);
+        ASSERT_EQ(0, outcore.finish(outfile[r], OUTPUT_FORMAT_ARC_ASCII, OUTPUT_TYPE_MEAN));
+
+        // the resident tiles are split among the workers, so some of them
+        // hold fewer than they own
+        if (threads[r] > 1)
+            EXPECT_GT(outcore.getCacheEvictions(), 0ul);
+
+        std::string name = outfile[r] + ".mean.asc";
+        std::ifstream is(name.c_str());
+        ASSERT_TRUE(is.good());
+        std::getline(is, grid[r], '\0');
+        is.close();
+        std::remove(name.c_str());
+    }
+
+    EXPECT_FALSE(grid[0].empty());
+    EXPECT_TRUE(grid[0] == grid[1]);
+}
+
+// a full queue maps its tile, evicting the least recently used one
+TEST(OutCoreInterpTest, CacheEvictsLeastRecentlyUsed)
+{
+    double radius = 1.8 * DIST;
+    OutCoreInterp outcore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                          0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 0);
+    outcore.setMemoryBudget(GRID_X * GRID_Y * sizeof(GridPoint));
+    ASSERT_EQ(0, outcore.init());
+
+    int tiles_x = outcore.getTilesX();
+    int num_tiles = tiles_x * outcore.getTilesY();
+    int resident = outcore.getResidentTiles();
+    size_t limit = outcore.getQueueLimit();
+    ASSERT_GE(resident, 2);
+    ASSERT_GT(num_tiles, resident);
+
+    // the center of every tile
+    int width = (GRID_X + tiles_x - 1) / tiles_x;
+    int height = (GRID_Y + outcore.getTilesY() - 1) / outcore.getTilesY();
+    std::vector<double> cx(num_tiles), cy(num_tiles);
+    for (int t = 0; t < num_tiles; ++t)
+    {
+        cx[t] = std::min((t % tiles_x) * width + width / 2, GRID_X - 1) * DIST;
+        cy[t] = std::min((t / tiles_x) * height + height / 2, GRID_Y - 1) * DIST;
+    }
+
+    // init() maps tile 0; filling the queues of tiles 1 to resident maps
+    // each in turn, the last one in place of tile 0
+    EXPECT_EQ(1ul, outcore.getCacheMisses());
+    for (int t = 1; t <= resident; ++t)
+        for (size_t i = 0; i < limit; ++i)
+            outcore.update(cx[t], cy[t], 100.0);
+    EXPECT_EQ((unsigned long)resident + 1, outcore.getCacheMisses());
+    EXPECT_EQ(1ul, outcore.getCacheEvictions());
+    EXPECT_EQ(0ul, outcore.getCacheHits());
+
+    // touching tile 1 makes tile 2 the least recently used, so mapping
+    // tile 0 again evicts tile 2 and tile 1 stays mapped
+    outcore.update(cx[1], cy[1], 100.0);
+    for (size_t i = 0; i < limit; ++i)
+        outcore.update(cx[0], cy[0], 100.0);
+    outcore.update(cx[1], cy[1], 100.0);
+    outcore.update(cx[2], cy[2], 100.0);
+    EXPECT_EQ((unsigned long)resident + 2, outcore.getCacheMisses());
+    EXPECT_EQ(2ul, outcore.getCacheEvictions());
+    EXPECT_EQ(2ul, outcore.getCacheHits());
+}
+
+TEST(OutCoreInterpTest, PreadTileRoundTrip)
+{
+    std::string name = get_test_data_filename("pread-tile");
+    std::vector<char> fname(name.begin(), name.end());
+    fname.push_back('\0');
+
+    // larger than one I/O chunk, so the untouched chunks stay holes
+    int size_x = 300, size_y = 1000;
+    GridFile gf(0, &fname[0], size_x, size_y);
+    gf.setIOMode(GRID_FILE_PREAD);
+
+    ASSERT_EQ(0, gf.map());
+    EXPECT_EQ(0u, gf.interp[0].count);
+    gf.interp[7].count = 3;
+    gf.interp[7].Zmean = 42.5;
+    gf.interp[size_x * size_y - 1].Zmax = 9;
+    ASSERT_EQ(0, gf.unmap());
+    EXPECT_EQ(0ull, gf.getBytesRead());
+    EXPECT_LT(gf.getBytesWritten(), (unsigned long long)sizeof(GridPoint) * size_x * size_y);
+
+    ASSERT_EQ(0, gf.map());
+    EXPECT_EQ(3u, gf.interp[7].count);
+    EXPECT_EQ(42.5, gf.interp[7].Zmean);
+    EXPECT_EQ(9, gf.interp[size_x * size_y - 1].Zmax);
+    EXPECT_EQ(0u, gf.interp[size_x * 500].count);
+    EXPECT_GE(gf.getBytesRead(), (unsigned long long)sizeof(GridPoint) * size_x * size_y);
+    ASSERT_EQ(0, gf.unmap());
+}
+
+// the hints the tile I/O thread gives an evicted tile and the tile mapped
+// next leave its contents as they were
+TEST(OutCoreInterpTest, WritebackPrefetchRoundTrip)
+{
+    std::string name = get_test_data_filename("hinted-tile");
+    std::vector<char> fname(name.begin(), name.end());
+    fname.push_back('\0');
+
+    int size_x = 300, size_y = 200;
+    int modes[2] = {GRID_FILE_MMAP, GRID_FILE_PREAD};
+
+    for (int m = 0; m < 2; ++m)
+    {
+        std::remove(name.c_str());
+        GridFile gf(0, &fname[0], size_x, size_y);
+        gf.setIOMode(modes[m]);
+
+        // no file to give hints for before the first map()
+        EXPECT_FALSE(gf.isInitialized());
+#ifndef _WIN32
+        EXPECT_EQ(-1, gf.prefetch());
+#endif
+
+        ASSERT_EQ(0, gf.map());
+        for (int i = 0; i < size_x * size_y; i += 97)
+        {
+            gf.interp[i].count = i % 13 + 1;
+            gf.interp[i].Zmean = i * 0.5;
+        }
+        ASSERT_EQ(0, gf.unmap());
+        EXPECT_TRUE(gf.isInitialized());
+
+        EXPECT_EQ(0, gf.writeback());
+        EXPECT_EQ(0, gf.prefetch());
+
+        ASSERT_EQ(0, gf.map());
+        for (int i = 0; i < size_x * size_y; ++i)
+        {
+            if (i % 97 == 0)
+            {
+                EXPECT_EQ((unsigned int)(i % 13 + 1), gf.interp[i].count);
+                EXPECT_EQ(i * 0.5, gf.interp[i].Zmean);
+            }
+            else
+                EXPECT_EQ(0u, gf.interp[i].count);
+        }
+        ASSERT_EQ(0, gf.unmap());
+    }
+    std::remove(name.c_str());
+}
+
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <points2grid/SpanKernels.hpp>
+
+#include <vector>
+
+
+namespace points2grid
+{
+
+namespace
+{
+
+const int SPAN = 37;
+
+double next_value(unsigned int& state, double range)
+{
+    state = state * 1103515245u + 12345u;
+    return range * ((state >> 8) & 0xFFFF) / 65536.0;
+}
+
+struct Span
+{
+    std::vector<double> Zmin, Zmax, Zmean, Zidw, sum, Zstd, Zstd_tmp;
+    std::vector<unsigned int> count;
+
+    Span() : Zmin(SPAN, 0), Zmax(SPAN, 0), Zmean(SPAN, 0), Zidw(SPAN, 0),
+             sum(SPAN, 0), Zstd(SPAN, 0), Zstd_tmp(SPAN, 0), count(SPAN, 0) {}
+};
+
+// runs the same point sequence over every span length and offset
+void run(const SpanKernels& kernels, Span& span, int power)
+{
+    unsigned int state = 7;
+    std::vector<double> dx2(SPAN);
+
+    for (int p = 0; p < 400; ++p)
+    {
+        int first = p % 5;
+        int n = (p * 7) % (SPAN - first + 1);
+        double z = 100.0 + next_value(state, 50.0);
+        double dy2 = (p % 11 == 0) ? 0.0 : next_value(state, 4.0);
+
+        for (int i = 0; i < SPAN; ++i)
+            dx2[i] = next_value(state, 9.0);
+        // some points land right on a cell center
+        if (p % 11 == 0)
+            dx2[(p / 11) % SPAN] = 0.0;
+
+        kernels.min(&span.Zmin[first], &span.count[first], n, z);
+        kernels.max(&span.Zmax[first], &span.count[first], n, z);
+        kernels.count(&span.count[first], n);
+        kernels.mean(&span.Zmean[first], n, z);
+        kernels.std(&span.Zstd[first], &span.Zstd_tmp[first], &span.count[first], n, z);
+        kernels.idw(&span.Zidw[first], &span.sum[first], &dx2[first], dy2, n, z, power);
+    }
+}
+
+}
+
+TEST(SpanKernelsTest, VectorKernelsMatchScalar)
+{
+    const SpanKernels *const *available = getAvailableSpanKernels();
+
+    int powers[] = {1, 2, 3, 4, 7};
+
+    for (int p = 0; p < 5; ++p)
+    {
+        for (int k = 0; available[k] != NULL; ++k)
+        {
+            Span expected;
+            run(scalar_span_kernels, expected, powers[p]);
+
+            Span actual;
+            run(*available[k], actual, powers[p]);
+
+            for (int i = 0; i < SPAN; ++i)
+            {
+                EXPECT_EQ(expected.Zmin[i], actual.Zmin[i]) << available[k]->name << " power " << powers[p];
+                EXPECT_EQ(expected.Zmax[i], actual.Zmax[i]) << available[k]->name << " power " << powers[p];
+                EXPECT_EQ(expected.count[i], actual.count[i]) << available[k]->name << " power " << powers[p];
+                EXPECT_EQ(expected.Zmean[i], actual.Zmean[i]) << available[k]->name << " power " << powers[p];
+                EXPECT_EQ(expected.Zstd[i], actual.Zstd[i]) << available[k]->name << " power " << powers[p];
+                EXPECT_EQ(expected.Zstd_tmp[i], actual.Zstd_tmp[i]) << available[k]->name << " power " << powers[p];
+                EXPECT_EQ(expected.Zidw[i], actual.Zidw[i]) << available[k]->name << " power " << powers[p];
+                EXPECT_EQ(expected.sum[i], actual.sum[i]) << available[k]->name << " power " << powers[p];
+            }
+        }
+    }
+}
+
+TEST(SpanKernelsTest, IntegerWeights)
+{
+    double distance_sqr = 2.25;
+
+    EXPECT_EQ(1.0, span_weight(distance_sqr, 0));
+    EXPECT_EQ(1.5, span_weight(distance_sqr, 1));
+    EXPECT_EQ(distance_sqr, span_weight(distance_sqr, 2));
+    EXPECT_DOUBLE_EQ(pow(1.5, 3), span_weight(distance_sqr, 3));
+    EXPECT_DOUBLE_EQ(pow(1.5, 6), span_weight(distance_sqr, 6));
+    EXPECT_DOUBLE_EQ(pow(1.5, 7), span_weight(distance_sqr, 7));
+}
+
+// zeroed cells take the first point, so a minimum above zero and a
+// maximum below it come out right
+TEST(SpanKernelsTest, ZeroCellsTakeFirstPoint)
+{
+    const SpanKernels *const *available = getAvailableSpanKernels();
+    double z[3] = {5.0, 3.0, 7.0};
+
+    for (int k = 0; available[k] != NULL; ++k)
+    {
+        Span span;
+        for (int p = 0; p < 3; ++p)
+        {
+            available[k]->min(&span.Zmin[0], &span.count[0], SPAN, z[p]);
+            available[k]->max(&span.Zmax[0], &span.count[0], SPAN, -z[p]);
+            available[k]->count(&span.count[0], SPAN);
+        }
+
+        for (int i = 0; i < SPAN; ++i)
+        {
+            EXPECT_EQ(3.0, span.Zmin[i]) << available[k]->name;
+            EXPECT_EQ(-3.0, span.Zmax[i]) << available[k]->name;
+        }
+    }
+}
+
+}
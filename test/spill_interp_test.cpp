@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <points2grid/InCoreInterp.hpp>
+#include <points2grid/SpillInterp.hpp>
+
+#include <points2grid/config.h>
+#include <points2grid/Global.hpp>
+
+#include <limits>
+
+#include "config.hpp"
+#include "fixtures.hpp"
+
+
+namespace points2grid
+{
+
+namespace
+{
+
+const int GRID_X = 150;
+const int GRID_Y = 150;
+const double DIST = 1.0;
+
+}
+
+TEST(SpillInterpTest, BandsMatchInCore)
+{
+    double radius = 1.8 * DIST;
+    std::string outfile = get_test_data_filename("spill-bands");
+
+    InCoreInterp incore(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                        0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 5);
+    incore.init();
+
+    // a budget just above the grid's size needs several bands, two of
+    // them gridded at once
+    SpillInterp spill(DIST, DIST, GRID_X, GRID_Y, radius * radius,
+                      0, (GRID_X - 1) * DIST, 0, (GRID_Y - 1) * DIST, 5);
+    spill.setThreads(2);
+    spill.setMemoryBudget(GRID_X * GRID_Y * sizeof(GridPoint) * 1.2);
+    ASSERT_EQ(0, spill.init());
+    EXPECT_GT(spill.getNumBands(), 2);
+    EXPECT_EQ(2, spill.getParallelBands());
+
+    // enough points that every band spills blocks of them to its file,
+    // and points around the edges of the grid, which the bands have to
+    // drop, or keep, just like the whole grid does
+    CoreInterp *engines[2] = {&incore, &spill};
+    for (int e = 0; e < 2; ++e)
+        fill_clumped_grid(*engines[e], GRID_X, GRID_Y, DIST, 60000);
+
+    unsigned int state = 19;
+    for (int k = 0; k < 400; ++k)
+    {
+        double along = next_value(state, (GRID_X - 1) * DIST);
+        double across = next_value(state, 4 * radius) - 2 * radius;
+        double z = 100.0 + next_value(state, 50.0);
+        double x = k % 2 ? along : (k % 4 ? -across : (GRID_X - 1) * DIST + across);
+        double y = k % 2 ? (k % 4 == 1 ? -across : (GRID_Y - 1) * DIST + across) : along;
+
+        for (int e = 0; e < 2; ++e)
+            engines[e]->update(x, y, z);
+    }
+
+    incore.calculate_grid_values();
+    ASSERT_EQ(0, spill.finish(outfile, OUTPUT_FORMAT_ARC_ASCII, OUTPUT_TYPE_MEAN | OUTPUT_TYPE_IDW | OUTPUT_TYPE_DEN | OUTPUT_TYPE_STD));
+    EXPECT_GT(spill.getSpilledPoints(), 0ul);
+
+    const char *ext[4] = {".mean.asc", ".idw.asc", ".den.asc", ".std.asc"};
+    for (int t = 0; t < 4; ++t)
+        expect_asc_matches_incore(outfile, ext[t], incore, GRID_X, GRID_Y);
+}
+
+#ifndef HAVE_GDAL
+TEST(SpillInterpTest, GeotiffNeedsGdal)
+{
+    std::string outfile = get_test_data_filename("spill-geotiff");
+
+    SpillInterp spill(DIST, DIST, 4, 3, DIST * DIST, 0, 3 * DIST, 0, 2 * DIST, 0);
+    ASSERT_EQ(0, spill.init());
+    spill.update(1, 1, 5);
+    EXPECT_EQ(-1, spill.finish(outfile, OUTPUT_FORMAT_GDAL_GTIFF, OUTPUT_TYPE_MEAN));
+}
+#endif
+
+}